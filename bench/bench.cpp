@@ -0,0 +1,501 @@
+// End-to-end benchmark: generates reproducible XYZ, GeoTIFF and GeoPackage
+// corpora, times the XYZ parser, the GDAL readers, the writer and full
+// xyz2las runs separately, and reports points/s, MB/s and peak RSS as JSON.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <liblas/liblas.hpp>
+#include "gdal_priv.h"
+#include "ogrsf_frmts.h"
+#include "InputProcessor.hpp"
+#include "LasOutput.hpp"
+#include "ParallelChunks.hpp"
+#include "PointCollector.hpp"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <cxxopts.hpp>
+
+namespace {
+  // Fixed-seed generator, so corpora are identical across runs and machines
+  struct Lcg {
+    uint64_t state;
+    explicit Lcg(uint64_t seed) : state(seed) {}
+    double next() {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      return static_cast<double>(state >> 11) * (1.0 / 9007199254740992.0);
+    }
+  };
+
+  // Smooth terrain shared by every corpus, over a 10 km square
+  void samplePoint(Lcg& rng, double& x, double& y, double& z) {
+    x = 500000.0 + rng.next() * 10000.0;
+    y = 6000000.0 + rng.next() * 10000.0;
+    z = 100.0 + 40.0 * std::sin(x * 0.001) * std::cos(y * 0.0013) + rng.next();
+  }
+
+  struct XyzVariant {
+    const char* name;
+    int         decimals;
+    bool        crlf;
+    bool        comments; // a comment header and a comment line every 1000 points
+    int         columns;  // 3, or 6 with R G B after X Y Z
+  };
+
+  const XyzVariant kXyzVariants[] = {
+      {"xyz-p2-lf", 2, false, false, 3},
+      {"xyz-p6-crlf", 6, true, false, 3},
+      {"xyz-p3-comments", 3, false, true, 3},
+      {"xyz-p3-6col", 3, false, false, 6},
+  };
+
+  bool fileExists(const std::string& path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    return in.is_open();
+  }
+
+  uint64_t fileSize(const std::string& path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary | std::ios::ate);
+    return in.is_open() ? static_cast<uint64_t>(in.tellg()) : 0;
+  }
+
+  void generateXyz(const std::string& path, const XyzVariant& v, uint64_t points) {
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) {
+      throw std::runtime_error("Cannot create corpus: " + path);
+    }
+    const char* eol = v.crlf ? "\r\n" : "\n";
+    std::string buffer;
+    buffer.reserve(8 << 20);
+    if (v.comments) {
+      buffer += std::string("# synthetic terrain, ") + std::to_string(points) + " points" + eol;
+      buffer += std::string("# x y z") + eol;
+    }
+    Lcg  rng(42);
+    char line[160];
+    for (uint64_t i = 0; i < points; ++i) {
+      double x, y, z;
+      samplePoint(rng, x, y, z);
+      int n = std::snprintf(line, sizeof(line), "%.*f %.*f %.*f", v.decimals, x, v.decimals, y, v.decimals, z);
+      buffer.append(line, n);
+      if (v.columns == 6) {
+        n = std::snprintf(line, sizeof(line), " %u %u %u", static_cast<unsigned>(i % 256),
+                          static_cast<unsigned>((i / 7) % 256), static_cast<unsigned>((i / 13) % 256));
+        buffer.append(line, n);
+      }
+      buffer += eol;
+      if (v.comments && i % 1000 == 999) {
+        buffer += std::string("# block ") + std::to_string(i / 1000) + eol;
+      }
+      if (buffer.size() >= (8 << 20) - 256) {
+        std::fwrite(buffer.data(), 1, buffer.size(), out);
+        buffer.clear();
+      }
+    }
+    std::fwrite(buffer.data(), 1, buffer.size(), out);
+    if (std::fclose(out) != 0) {
+      throw std::runtime_error("Cannot write corpus: " + path);
+    }
+  }
+
+  // Float32 DEM of about `points` cells, tiled in 256x256 blocks or striped.
+  void generateGeoTiff(const std::string& path, uint64_t points, bool tiled) {
+    int         side    = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(points))));
+    const char* tiles[] = {"TILED=YES", "BLOCKXSIZE=256", "BLOCKYSIZE=256", nullptr};
+    GDALDriver* driver  = GetGDALDriverManager()->GetDriverByName("GTiff");
+    if (!driver) {
+      throw std::runtime_error("GDAL has no GTiff driver");
+    }
+    GDALDataset* ds =
+        driver->Create(path.c_str(), side, side, 1, GDT_Float32, tiled ? const_cast<char**>(tiles) : nullptr);
+    if (!ds) {
+      throw std::runtime_error("Cannot create corpus: " + path);
+    }
+    double transform[6] = {500000.0, 10000.0 / side, 0.0, 6010000.0, 0.0, -10000.0 / side};
+    ds->SetGeoTransform(transform);
+    std::vector<float> row(side);
+    for (int r = 0; r < side; ++r) {
+      double y = transform[3] + (r + 0.5) * transform[5];
+      for (int c = 0; c < side; ++c) {
+        double x = transform[0] + (c + 0.5) * transform[1];
+        row[c]   = static_cast<float>(100.0 + 40.0 * std::sin(x * 0.001) * std::cos(y * 0.0013));
+      }
+      if (ds->GetRasterBand(1)->RasterIO(GF_Write, 0, r, side, 1, &row[0], side, 1, GDT_Float32, 0, 0) != CE_None) {
+        GDALClose(ds);
+        throw std::runtime_error("Cannot write corpus: " + path);
+      }
+    }
+    GDALClose(ds);
+  }
+
+  void generateGpkg(const std::string& path, uint64_t points) {
+    GDALDriver* driver = GetGDALDriverManager()->GetDriverByName("GPKG");
+    if (!driver) {
+      throw std::runtime_error("GDAL has no GPKG driver");
+    }
+    GDALDataset* ds = driver->Create(path.c_str(), 0, 0, 0, GDT_Unknown, nullptr);
+    if (!ds) {
+      throw std::runtime_error("Cannot create corpus: " + path);
+    }
+    OGRLayer* layer = ds->CreateLayer("points", nullptr, wkbPoint25D, nullptr);
+    if (!layer) {
+      GDALClose(ds);
+      throw std::runtime_error("Cannot create point layer in " + path);
+    }
+    Lcg rng(42);
+    ds->StartTransaction();
+    for (uint64_t i = 0; i < points; ++i) {
+      double x, y, z;
+      samplePoint(rng, x, y, z);
+      OGRFeature* feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+      feature->SetGeometryDirectly(new OGRPoint(x, y, z));
+      OGRErr err = layer->CreateFeature(feature);
+      OGRFeature::DestroyFeature(feature);
+      if (err != OGRERR_NONE) {
+        ds->RollbackTransaction();
+        GDALClose(ds);
+        throw std::runtime_error("Cannot write corpus: " + path);
+      }
+      if (i % 100000 == 99999) {
+        ds->CommitTransaction();
+        ds->StartTransaction();
+      }
+    }
+    ds->CommitTransaction();
+    GDALClose(ds);
+  }
+
+  // Peak RSS tracking. On Linux the high-water mark is reset before each
+  // measurement, so every result reports its own peak; elsewhere it is the
+  // process-wide peak so far.
+  void resetPeakRss() {
+#if defined(__linux__)
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+#endif
+  }
+
+  double peakRssMB() {
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string   line;
+    while (std::getline(status, line)) {
+      if (line.compare(0, 6, "VmHWM:") == 0) {
+        return std::strtod(line.c_str() + 6, nullptr) / 1024.0;
+      }
+    }
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#else
+    return 0.0;
+#endif
+  }
+
+  struct Result {
+    std::string phase;
+    std::string corpus;
+    uint64_t    points;
+    uint64_t    bytes; // input bytes for readers and runs, output bytes for the writer
+    double      seconds;
+    double      peakRssMB;
+  };
+
+  void writeJson(std::ostream& out, const std::vector<Result>& results, uint64_t points, int threads) {
+    out << "{\n";
+    out << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n";
+    out << "  \"points\": " << points << ",\n";
+    out << "  \"threads\": " << threads << ",\n";
+    out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+      const Result& r = results[i];
+      double        s = std::max(r.seconds, 1e-9);
+      out << (i ? ",\n" : "\n") << "    {\"phase\": \"" << r.phase << "\", \"corpus\": \"" << r.corpus
+          << "\", \"points\": " << r.points << ", \"bytes\": " << r.bytes << ", \"seconds\": " << r.seconds
+          << ", \"points_per_second\": " << r.points / s << ", \"mb_per_second\": " << r.bytes / (1024.0 * 1024.0) / s
+          << ", \"peak_rss_mb\": " << r.peakRssMB << "}";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+  double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // Times one reader over `path`, counting points without writing them.
+  Result timeReader(const std::string& phase, const std::string& corpus, const std::string& path, int threads,
+                    bool gdal) {
+    PointCollector pc;
+    pc.quiet   = true;
+    pc.threads = threads;
+    resetPeakRss();
+    auto        start = std::chrono::steady_clock::now();
+    std::string srs;
+    bool        ok = gdal ? processGDAL(path, pc, srs) : processXYZ(path, pc);
+    double      seconds = secondsSince(start);
+    if (!ok) {
+      throw std::runtime_error("Cannot read corpus: " + path);
+    }
+    Result r = {phase, corpus, pc.count, fileSize(path), seconds, peakRssMB()};
+    return r;
+  }
+
+  // Times LasOutput alone: encoding, compression and I/O of generated points.
+  Result timeWriter(const std::string& path, uint64_t points, int threads) {
+    liblas::Header header;
+    header.SetVersionMajor(1);
+    header.SetVersionMinor(2);
+    header.SetScale(0.01, 0.01, 0.01);
+    header.SetDataFormatId(liblas::ePointFormat0);
+    header.SetCompressed(path.size() > 4 && path.compare(path.size() - 4, 4, ".laz") == 0);
+    header.SetPointRecordsCount(static_cast<uint32_t>(points));
+    header.SetMin(500000.0, 6000000.0, 50.0);
+    header.SetMax(510000.0, 6010000.0, 150.0);
+    header.SetOffset(500000.0, 6000000.0, 0.0);
+
+    // One reusable batch of generated points keeps generation out of the timing
+    PointBatch batch;
+    Lcg        rng(42);
+    for (size_t i = 0; i < std::min<uint64_t>(points, 1000000); ++i) {
+      double x, y, z;
+      samplePoint(rng, x, y, z);
+      batch.addPoint(x, y, z);
+    }
+
+    OutputOptions options;
+    options.threads       = threads;
+    options.inflightBytes = static_cast<size_t>(256) << 20;
+    resetPeakRss();
+    auto      start = std::chrono::steady_clock::now();
+    LasOutput output;
+    if (!output.open(path, header, options)) {
+      throw std::runtime_error("Cannot open output: " + path);
+    }
+    PointCollector pc;
+    pc.quiet       = true;
+    pc.threads     = threads;
+    pc.totalPoints = points;
+    output.attach(pc);
+    for (uint64_t done = 0; done < points; done += batch.size()) {
+      if (points - done < batch.size()) {
+        PointBatch tail;
+        tail.xyz.assign(batch.xyz.begin(), batch.xyz.begin() + 3 * (points - done));
+        pc.addBatch(tail);
+      } else {
+        pc.addBatch(batch);
+      }
+    }
+    if (!output.close(pc)) {
+      throw std::runtime_error("Cannot finalize output: " + path);
+    }
+    double seconds = secondsSince(start);
+    Result r       = {"writer", path.substr(path.find_last_of("/\\") + 1), points, fileSize(path), seconds, peakRssMB()};
+    return r;
+  }
+
+  // Times a full xyz2las process; its peak RSS comes from the child's rusage.
+  Result timeRun(const std::string& xyz2las, const std::string& corpus, const std::vector<std::string>& args,
+                 uint64_t points, uint64_t bytes) {
+    auto   start = std::chrono::steady_clock::now();
+    double rss   = 0.0;
+#if defined(__unix__) || defined(__APPLE__)
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(xyz2las.c_str()));
+    for (const std::string& a : args) {
+      argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (!freopen("/dev/null", "w", stdout)) {
+        _exit(127);
+      }
+      execv(argv[0], &argv[0]);
+      _exit(127);
+    }
+    int           status = 0;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      throw std::runtime_error("xyz2las run failed on " + corpus);
+    }
+#if defined(__APPLE__)
+    rss = usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    rss = usage.ru_maxrss / 1024.0;
+#endif
+#else
+    std::string command = "\"" + xyz2las + "\"";
+    for (const std::string& a : args) {
+      command += " \"" + a + "\"";
+    }
+    if (std::system(command.c_str()) != 0) {
+      throw std::runtime_error("xyz2las run failed on " + corpus);
+    }
+#endif
+    Result r = {"xyz2las", corpus, points, bytes, secondsSince(start), rss};
+    return r;
+  }
+} // namespace
+
+int main(int argc, char* argv[]) {
+  GDALAllRegister();
+  OGRRegisterAll();
+
+  cxxopts::Options options("xyz2las_bench", "Benchmark xyz2las on generated corpora and report JSON");
+  options.add_options()
+    ("points", "Points per XYZ corpus and written by the writer benchmark", cxxopts::value<uint64_t>()->default_value("10000000"))
+    ("raster-points", "Cells per GeoTIFF corpus (0 = --points)", cxxopts::value<uint64_t>()->default_value("0"))
+    ("vector-points", "Points in the GeoPackage corpus", cxxopts::value<uint64_t>()->default_value("1000000"))
+    ("dir", "Directory for corpora and outputs", cxxopts::value<std::string>()->default_value("."))
+    ("phases", "Comma separated phases: xyz, gdal, writer, xyz2las", cxxopts::value<std::string>()->default_value("xyz,gdal,writer,xyz2las"))
+    ("xyz2las", "xyz2las executable for full runs (default: next to this benchmark)", cxxopts::value<std::string>())
+    ("j,threads", "Threads (0 = all cores)", cxxopts::value<int>()->default_value("0"))
+    ("json", "Write results to this file instead of stdout", cxxopts::value<std::string>())
+    ("regenerate", "Rebuild corpora even if present", cxxopts::value<bool>()->default_value("false"))
+    ("h,help", "Print usage");
+
+  cxxopts::ParseResult result;
+  try {
+    result = options.parse(argc, argv);
+  } catch (const cxxopts::exceptions::exception& e) {
+    std::cerr << "Error parsing options: " << e.what() << std::endl;
+    return 1;
+  }
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+
+  uint64_t    points       = std::max<uint64_t>(1, result["points"].as<uint64_t>());
+  uint64_t    rasterPoints = result["raster-points"].as<uint64_t>();
+  uint64_t    vectorPoints = std::max<uint64_t>(1, result["vector-points"].as<uint64_t>());
+  std::string dir          = result["dir"].as<std::string>() + "/";
+  std::string phases       = "," + result["phases"].as<std::string>() + ",";
+  int         threads      = result["threads"].as<int>();
+  bool        regenerate   = result["regenerate"].as<bool>();
+  if (rasterPoints == 0) {
+    rasterPoints = points;
+  }
+  if (points > UINT32_MAX) {
+    std::cerr << "Error: --points must fit a LAS 1.2 point count." << std::endl;
+    return 1;
+  }
+  std::string xyz2las;
+  if (result.count("xyz2las")) {
+    xyz2las = result["xyz2las"].as<std::string>();
+  } else {
+    std::string self = argv[0];
+    size_t      sep  = self.find_last_of("/\\");
+    xyz2las          = (sep == std::string::npos ? std::string() : self.substr(0, sep + 1)) + "xyz2las";
+  }
+  auto enabled = [&](const char* phase) { return phases.find("," + std::string(phase) + ",") != std::string::npos; };
+
+  std::vector<Result> results;
+  try {
+    // Corpora are named after their parameters and reused across runs
+    auto corpus = [&](const std::string& name, const std::function<void(const std::string&)>& generate) {
+      std::string path = dir + name;
+      if (regenerate || !fileExists(path)) {
+        std::cerr << "Generating " << path << std::endl;
+        std::remove(path.c_str());
+        generate(path);
+      }
+      return path;
+    };
+
+    std::vector<std::pair<std::string, std::string>> xyzCorpora, gdalCorpora;
+    if (enabled("xyz") || enabled("xyz2las")) {
+      for (const XyzVariant& v : kXyzVariants) {
+        std::string name = std::string(v.name) + "-" + std::to_string(points) + ".xyz";
+        xyzCorpora.push_back(std::make_pair(name, corpus(name, [&](const std::string& p) { generateXyz(p, v, points); })));
+      }
+    }
+    if (enabled("gdal") || enabled("xyz2las")) {
+      for (int tiled = 1; tiled >= 0; --tiled) {
+        std::string name = std::string(tiled ? "dem-tiled-" : "dem-striped-") + std::to_string(rasterPoints) + ".tif";
+        gdalCorpora.push_back(
+            std::make_pair(name, corpus(name, [&](const std::string& p) { generateGeoTiff(p, rasterPoints, tiled != 0); })));
+      }
+      std::string name = "points-" + std::to_string(vectorPoints) + ".gpkg";
+      gdalCorpora.push_back(std::make_pair(name, corpus(name, [&](const std::string& p) { generateGpkg(p, vectorPoints); })));
+    }
+
+    if (enabled("xyz")) {
+      for (const auto& c : xyzCorpora) {
+        std::cerr << "processXYZ " << c.first << std::endl;
+        results.push_back(timeReader("processXYZ", c.first, c.second, threads, false));
+      }
+    }
+    if (enabled("gdal")) {
+      for (const auto& c : gdalCorpora) {
+        std::cerr << "processGDAL " << c.first << std::endl;
+        results.push_back(timeReader("processGDAL", c.first, c.second, threads, true));
+      }
+    }
+    if (enabled("writer")) {
+      const char* outputs[] = {"bench-writer.las", "bench-writer.laz"};
+      for (const char* name : outputs) {
+        std::cerr << "writer " << name << std::endl;
+        results.push_back(timeWriter(dir + name, points, threads));
+        std::remove((dir + name).c_str());
+      }
+    }
+    if (enabled("xyz2las")) {
+      std::vector<std::pair<std::string, std::string>> runs(xyzCorpora);
+      runs.insert(runs.end(), gdalCorpora.begin(), gdalCorpora.end());
+      for (const auto& c : runs) {
+        // Counted up front so the run's rate is in points actually converted
+        PointCollector counted;
+        counted.quiet   = true;
+        counted.threads = threads;
+        std::string srs;
+        processInput(c.second, counted, srs);
+        for (const char* ext : {".las", ".laz"}) {
+          std::string out = dir + "bench-run" + ext;
+          std::cerr << "xyz2las " << c.first << " -> " << ext << std::endl;
+          results.push_back(timeRun(xyz2las, c.first + " -> " + ext,
+                                    {c.second, out, "--threads", std::to_string(threads)},
+                                    counted.count, fileSize(c.second)));
+          std::remove(out.c_str());
+        }
+      }
+    }
+  } catch (std::exception const& e) {
+    std::cerr << "Benchmark failed: " << e.what() << std::endl;
+    return 1;
+  }
+
+  int resolved = resolveThreadCount(threads);
+  if (result.count("json")) {
+    std::ofstream out(result["json"].as<std::string>());
+    writeJson(out, results, points, resolved);
+    if (!out) {
+      std::cerr << "Cannot write " << result["json"].as<std::string>() << std::endl;
+      return 1;
+    }
+  } else {
+    writeJson(std::cout, results, points, resolved);
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SpscQueue.hpp"
+
+// Output file buffer for large sequential writes. Bytes fill a page-aligned
+// buffer; each full buffer is written by a background thread while the next
+// one fills (double buffering), so the producer never waits on small writes
+// and the kernel sees a few large ones. With `directIO` the file is opened with
+// O_DIRECT where the file system allows it, which keeps huge outputs out of
+// the page cache; the last buffer is padded to the alignment and the file is
+// truncated back on close.
+//
+// Seeking back behind the append position (to patch a chunk table offset or
+// rewrite a header) switches to in-place writes until the stream seeks back
+// to its end. Seeking past the end is not supported.
+struct AlignedFileBuf : std::streambuf {
+  AlignedFileBuf();
+  ~AlignedFileBuf();
+
+  // Creates or truncates `filename`, with buffers of `bufferBytes` rounded up
+  // to the alignment. Returns false if the file cannot be created (or on
+  // platforms without positional writes).
+  bool open(const std::string& filename, size_t bufferBytes, bool directIO);
+  // Writes what is left, trims the padding and closes the file. Returns false
+  // if any write failed.
+  bool close();
+
+  bool isOpen() const { return fd >= 0; }
+  bool usingDirectIO() const { return direct; }
+
+protected:
+  int_type        overflow(int_type c) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+  pos_type        seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+  pos_type        seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+  struct Block {
+    char*    data;
+    size_t   size;   // bytes to write
+    uint64_t offset; // file offset of data[0]
+  };
+
+  uint64_t appendPos() const;
+  // Hands the current buffer to the writer thread and starts the next one.
+  void submit();
+  // Waits until no buffer is being written.
+  void drain();
+  void enterPatchMode(uint64_t pos);
+  void leavePatchMode();
+  // pbump() in int-sized steps, for buffers of 2 GB and more.
+  void advancePut(size_t n);
+  // Writes at `patchPos`, behind the append position.
+  bool patch(const char* s, size_t n);
+  bool writeAt(int file, const char* s, size_t n, uint64_t offset);
+  void run();
+
+  int                 fd;
+  int                 bufferedFd; // O_DIRECT: a second descriptor for unaligned writes
+  bool                direct;
+  size_t              capacity;
+  Block               current;    // buffer being filled (the put area outside patch mode)
+  std::vector<Block>  idle;       // buffers neither filling nor being written
+  std::vector<char*>  allocations;
+  SpscQueue<Block>    full;
+  SpscQueue<Block>    empty;
+  std::thread         writer;
+  std::atomic<bool>   failed;
+  bool                patching;
+  uint64_t            patchPos;
+};
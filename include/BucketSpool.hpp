@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Append-only files keyed by a 64-bit bucket id, for spreading a record stream
+// over more buckets than can be held in memory or kept open at once. Bytes are
+// buffered per bucket, appended to the bucket's file once its buffer holds
+// `bucketBufferBytes` (or all buffers hold `totalBufferBytes`), through an LRU
+// of at most `maxOpenFiles` streams. `pathFor` names a bucket's file and
+// `onCreate`, if set, writes a prologue when the file is first created.
+struct BucketSpool {
+  typedef std::function<std::string(uint64_t)>         PathFn;
+  typedef std::function<void(std::ostream&, uint64_t)> CreateFn;
+
+  explicit BucketSpool(const PathFn& pathFor, const CreateFn& onCreate = CreateFn(),
+                       size_t bucketBufferBytes = 256 * 1024, size_t totalBufferBytes = 256 << 20,
+                       size_t maxOpenFiles = 128);
+  ~BucketSpool();
+
+  void append(uint64_t bucket, const char* data, size_t bytes);
+
+  // Writes out every buffer and closes all files; they can then be read back.
+  void finish();
+
+  // Deletes every bucket file.
+  void remove();
+
+  std::vector<uint64_t> keys() const;
+  const std::string&    path(uint64_t bucket) const;
+  uint64_t              bytes(uint64_t bucket) const; // appended so far, prologue excluded
+
+private:
+  struct Bucket {
+    uint64_t                       key;
+    std::string                    path;
+    std::vector<char>              buffer;
+    uint64_t                       bytes;
+    std::unique_ptr<std::ofstream> file;    // open while in the LRU
+    std::list<Bucket*>::iterator   lruPos;
+    bool                           created;
+  };
+
+  void           flush(Bucket& bucket);
+  void           flushAll();
+  std::ofstream& open(Bucket& bucket);
+  void           closeFile(Bucket& bucket);
+
+  PathFn                               pathFor;
+  CreateFn                             onCreate;
+  size_t                               bucketBufferBytes;
+  size_t                               totalBufferBytes;
+  size_t                               maxOpenFiles;
+  size_t                               buffered; // bytes across all buffers
+  std::unordered_map<uint64_t, Bucket> buckets;
+  std::list<Bucket*>                   lru;      // open buckets, most recent first
+};
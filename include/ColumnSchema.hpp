@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What one whitespace separated field of an XYZ text line holds.
+enum ColumnField {
+  kColumnSkip           = 0,
+  kColumnX              = 1,
+  kColumnY              = 2,
+  kColumnZ              = 3,
+  kColumnIntensity      = 4,
+  kColumnRed            = 5,
+  kColumnGreen          = 6,
+  kColumnBlue           = 7,
+  kColumnClassification = 8,
+  kColumnReturnNumber   = 9,
+  kColumnTime           = 10,
+  kColumnReturnCount    = 11
+};
+
+// One character per ColumnField, in enum order, for ColumnSchema::code().
+inline char columnCode(int field) {
+  return "_xyzirgbcntm"[field];
+}
+
+// Per-point LAS fields beyond the coordinates, as read from --columns inputs.
+// Values are clamped to the field ranges of LAS 1.2 (colors are stored as
+// given, 16 bits per channel).
+struct PointAttributes {
+  uint16_t intensity;
+  uint16_t rgb[3];
+  uint8_t  classification;  // 0-31
+  uint8_t  returnNumber;    // 0-7
+  uint8_t  numberOfReturns; // 0-7
+  double   time;            // GPS time
+
+  PointAttributes() : intensity(0), classification(0), returnNumber(0), numberOfReturns(0), time(0.0) {
+    rgb[0] = rgb[1] = rgb[2] = 0;
+  }
+};
+
+// Field layout of XYZ text input, e.g. "x,y,z,i,r,g,b,skip,c". Fields after
+// the last named one are ignored without being tokenized.
+struct ColumnSchema {
+  std::vector<ColumnField> fields; // trailing skips trimmed
+
+  ColumnSchema();
+
+  // Parses a comma separated list of x, y, z, i|intensity, r|red, g|green,
+  // b|blue, c|class, n|return, m|returns, t|time and skip. X, Y and Z must appear once;
+  // the rest at most once, with all of r, g and b or none. On failure returns
+  // false with a message in `error`.
+  static bool parse(const std::string& spec, ColumnSchema& schema, std::string& error);
+
+  bool has(ColumnField field) const;
+  // Plain "x y z" lines, which the structural scanner parses fastest.
+  bool isDefault() const;
+  // Fields other than coordinates (which need the attribute-carrying paths).
+  bool hasAttributes() const;
+  bool hasColor() const { return has(kColumnRed); }
+  bool hasTime() const { return has(kColumnTime); }
+  // A return number without a number of returns: each point is then taken
+  // as the last return of its pulse, so its number of returns is set to its
+  // return number, the least a valid file allows.
+  bool infersReturnCount() const { return has(kColumnReturnNumber) && !has(kColumnReturnCount); }
+
+  // The fields as one columnCode() each, e.g. "xyzirgb_c".
+  std::string code() const;
+
+  // LAS 1.2 point format holding these fields: 1 with time, 2 with color
+  // (from the columns or `colorize`), 3 with both, else 0.
+  int pointFormat(bool colorize) const;
+};
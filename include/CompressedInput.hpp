@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Compression of an input file, recognized by its magic bytes.
+enum Compression {
+  kCompressionNone  = 0,
+  kCompressionGzip  = 1, // including BGZF and concatenated members
+  kCompressionZstd  = 2,
+  kCompressionBzip2 = 3
+};
+
+Compression detectCompression(const char* data, size_t size);
+const char* compressionName(Compression compression);
+// False for the optional codecs (zstd, bzip2) when this build lacks them.
+bool compressionAvailable(Compression compression);
+
+struct CompressedRange {
+  const char* begin;
+  const char* end;
+};
+
+// Consecutive pieces of a compressed file that decode independently of each
+// other: BGZF blocks or zstd frames. Any other stream is a single piece.
+std::vector<CompressedRange> independentMembers(const char* data, size_t size, Compression compression);
+
+// Incremental decoder over compressed bytes in memory. Concatenated gzip
+// members, zstd frames and bzip2 streams decode as one stream. Throws
+// std::runtime_error on corrupt or truncated input, and for codecs this build
+// does not have.
+struct Decompressor {
+  Decompressor(const char* data, size_t size, Compression compression);
+  ~Decompressor();
+
+  // Decodes up to `capacity` bytes into `out`; returns how many, 0 at the end.
+  size_t read(char* out, size_t capacity);
+  // Compressed bytes consumed so far.
+  size_t consumed() const;
+
+  struct Codec;
+
+private:
+  std::unique_ptr<Codec> codec;
+};
+
+// Decodes all of [data, data + size) into `out`.
+void decompressAll(const char* data, size_t size, Compression compression, std::vector<char>& out);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <liblas/liblas.hpp>
+#include "BucketSpool.hpp"
+#include "LasEncoder.hpp"
+
+// RecordSink that drops every record whose quantized X, Y and Z repeat an
+// earlier record's, keeping the first. The keys seen are held in a flat
+// open-addressing set of 16-byte slots (key plus a hash tag, so most probes
+// touch a single cache line), and records with new keys are passed to
+// `downstream` as they arrive.
+//
+// Once the set outgrows `memoryBytes` its keys are spooled to hash partitions
+// in `tempPrefix`.dedupe-*.tmp files and every later record is spooled to its
+// partition instead of being checked. A key lies in exactly one partition, so
+// close() checks the partitions one at a time, each against the keys already
+// written, and splits any that are still too large into quarters on further
+// hash bits. Records spooled this way follow the in-memory ones, in partition
+// order.
+struct DedupeSink : RecordSink {
+  DedupeSink(RecordSink& downstream, const liblas::Header& header, size_t memoryBytes, const std::string& tempPrefix);
+  ~DedupeSink();
+
+  void write(const char* records, size_t count, size_t recordLength) override;
+  void close() override;
+
+  // Points written downstream and their bounds (X, Y, Z); valid after close().
+  uint64_t keptCount() const { return kept; }
+  uint64_t duplicateCount() const { return duplicates; }
+  void     keptBounds(double minXYZ[3], double maxXYZ[3]) const;
+
+  // Spooled partitions, 0 when every key fit in memory.
+  size_t partitionCount() const { return partitions ? partitions->keys().size() : 0; }
+
+private:
+  struct Slot {
+    int32_t  key[3];
+    uint32_t tag; // high hash bits, never 0; 0 marks a free slot
+  };
+
+  bool   insert(const int32_t key[3]);
+  void   grow();
+  size_t tableBytes() const { return slots.size() * sizeof(Slot); }
+  void   clearTable();
+
+  void pass(const char* record);
+  void flush();
+  void spillTable();
+  void checkPartitions(int depth, BucketSpool& keySpool, BucketSpool& recordSpool);
+  void checkPartition(int depth, uint64_t partition, uint64_t keyBytes, uint64_t recordBytes);
+  std::string partitionPath(const char* kind, int depth, uint64_t partition) const;
+
+  RecordSink&                  downstream;
+  size_t                       memoryBytes;
+  std::string                  tempPrefix;
+  double                       scale[3], offset[3];
+  size_t                       recordLength;
+  std::vector<Slot>            slots;
+  size_t                       entries;
+  std::vector<char>            staging;     // kept records not yet written downstream
+  size_t                       pending;
+  std::unique_ptr<BucketSpool> seenKeys;    // keys of the spilled set, per partition
+  std::unique_ptr<BucketSpool> partitions;  // records arriving after the spill
+  uint64_t                     kept;
+  uint64_t                     duplicates;
+  int32_t                      minRaw[3], maxRaw[3];
+  bool                         closed;
+};
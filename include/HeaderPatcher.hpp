@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "PointCollector.hpp"
+
+// Rewrites the point count and min/max fields of the public header block of an
+// already written LAS/LAZ file with the totals accumulated in `pc`. Used when
+// points were streamed out behind a placeholder header. Fails for more than
+// 2^32 - 1 points unless the file is LAS 1.4, whose counts are 64-bit.
+bool patchLasHeader(const std::string& filename, const PointCollector& pc);
+
+// Same with explicit totals; `minXYZ`/`maxXYZ` hold X, Y, Z.
+bool patchLasHeader(const std::string& filename, uint64_t count, const double minXYZ[3], const double maxXYZ[3]);
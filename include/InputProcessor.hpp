@@ -3,6 +3,15 @@
 #include <string>
 #include "PointCollector.hpp"
 
+// Input name that reads XYZ text from standard input.
+const char* const kStdinName = "-";
+
+// Whether `filename` can only be read once, front to back: standard input,
+// a FIFO or a character device (e.g. /dev/stdin or a shell's <(producer)).
+bool isStream(const std::string& filename);
+
 bool processGDAL(const std::string& filename, PointCollector& pc, std::string& srsWKT);
+// Parses XYZ text, plain or compressed. Standard input ("-"), pipes and FIFOs
+// are read front to back in blocks instead of mapped.
 bool processXYZ(const std::string& filename, PointCollector& pc);
 bool processInput(const std::string& filename, PointCollector& pc, std::string& srsWKT);
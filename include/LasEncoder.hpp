@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <liblas/liblas.hpp>
+#include "ColumnSchema.hpp"
+
+// Destination for runs of packed LAS point records.
+struct RecordSink {
+  virtual ~RecordSink() {}
+  virtual void write(const char* records, size_t count, size_t recordLength) = 0;
+  virtual void close() {}
+};
+
+// Appends records to an output stream.
+struct StreamSink : RecordSink {
+  std::ostream& os;
+
+  explicit StreamSink(std::ostream& os) : os(os) {}
+  void write(const char* records, size_t count, size_t recordLength) override;
+};
+
+// Re-emits packed records point by point through a liblas::Writer, for output
+// that only liblas can produce (LAZ without the parallel chunk compressor).
+struct WriterSink : RecordSink {
+  liblas::Writer& writer;
+  liblas::Point   point;
+  int             formatId;
+  size_t          colorOffset;
+  bool            hasColor;
+
+  WriterSink(liblas::Writer& writer, const liblas::Header& header);
+  void write(const char* records, size_t count, size_t recordLength) override;
+};
+
+// Encodes points of formats 0-3 (LAS 1.2) or 6-7 (LAS 1.4) straight into a
+// buffer of packed records, quantized with the header scale/offset, and hands
+// full buffers to a RecordSink. Fields other than coordinates, color and the
+// PointAttributes ones are left zero, as liblas::Point does. Assumes a
+// little-endian host, like the LAS format.
+struct LasPointEncoder {
+  RecordSink&       sink;
+  double            scaleX, scaleY, scaleZ;
+  double            offsetX, offsetY, offsetZ;
+  int               formatId;
+  size_t            recordLength;
+  bool              hasColor;
+  bool              hasTime;
+  size_t            colorOffset;
+  size_t            classOffset;  // classification byte
+  size_t            timeOffset;
+  uint8_t           returnMask;   // bits of the return number and of the number of returns
+  uint8_t           returnsShift; // position of the number of returns in byte 14
+  uint8_t           classMask;    // classification bits of the classification byte
+  size_t            batchPoints;
+  std::vector<char> buffer;
+  size_t            pending;
+  uint64_t          written;
+  uint64_t          maxPoints; // most points the file can count; flush() throws past it
+
+  // Packs records of the header's point format, or of `formatId` when given
+  // (LAS 1.4 formats, which liblas headers cannot hold).
+  LasPointEncoder(const liblas::Header& header, RecordSink& sink, size_t batchPoints = 65536, int formatId = -1);
+
+  void add(double x, double y, double z, uint16_t red, uint16_t green, uint16_t blue) {
+    if (hasColor) {
+      put<true>(x, y, z, red, green, blue);
+    } else {
+      put<false>(x, y, z, red, green, blue);
+    }
+  }
+
+  // add() for a format known to carry (kRgb) or lack RGB, for callers that
+  // resolved the format once up front.
+  template <bool kRgb>
+  void put(double x, double y, double z, uint16_t red, uint16_t green, uint16_t blue) {
+    char* rec = &buffer[pending * recordLength];
+    putInt32(rec, quantize(x, offsetX, scaleX));
+    putInt32(rec + 4, quantize(y, offsetY, scaleY));
+    putInt32(rec + 8, quantize(z, offsetZ, scaleZ));
+    if (kRgb) {
+      uint16_t rgb[3] = {red, green, blue};
+      std::memcpy(rec + colorOffset, rgb, sizeof(rgb));
+    }
+    if (++pending == batchPoints) {
+      flush();
+    }
+  }
+
+  void add(double x, double y, double z, const PointAttributes& a, const uint16_t rgb[3]) {
+    if (hasTime && hasColor) {
+      put<true, true>(x, y, z, a, rgb);
+    } else if (hasTime) {
+      put<false, true>(x, y, z, a, rgb);
+    } else if (hasColor) {
+      put<true, false>(x, y, z, a, rgb);
+    } else {
+      put<false, false>(x, y, z, a, rgb);
+    }
+  }
+
+  // Points with attributes: intensity, return number and number of returns,
+  // classification and, on formats with them, GPS time (kTime) and `rgb`
+  // (kRgb).
+  template <bool kRgb, bool kTime>
+  void put(double x, double y, double z, const PointAttributes& a, const uint16_t rgb[3]) {
+    char* rec = &buffer[pending * recordLength];
+    putInt32(rec, quantize(x, offsetX, scaleX));
+    putInt32(rec + 4, quantize(y, offsetY, scaleY));
+    putInt32(rec + 8, quantize(z, offsetZ, scaleZ));
+    std::memcpy(rec + 12, &a.intensity, sizeof(uint16_t));
+    rec[14]          = static_cast<char>((a.returnNumber & returnMask) | (a.numberOfReturns & returnMask) << returnsShift);
+    rec[classOffset] = static_cast<char>(a.classification & classMask);
+    if (kTime) {
+      std::memcpy(rec + timeOffset, &a.time, sizeof(double));
+    }
+    if (kRgb) {
+      std::memcpy(rec + colorOffset, rgb, 3 * sizeof(uint16_t));
+    }
+    if (++pending == batchPoints) {
+      flush();
+    }
+  }
+
+  // Hands buffered records to the sink.
+  void flush();
+
+  // Same rounding as liblas (half away from zero)
+  static int32_t quantize(double value, double offset, double scale) {
+    double v = (value - offset) / scale;
+    return static_cast<int32_t>(v >= 0.0 ? std::floor(v + 0.5) : std::ceil(v - 0.5));
+  }
+
+  static void putInt32(char* dst, int32_t v) {
+    std::memcpy(dst, &v, sizeof(v));
+  }
+
+  // Record size in bytes of point formats 0-3 and 6-7, or 0 if unsupported.
+  static size_t recordLengthFor(int formatId);
+};
+
+// LAS 1.4 point format holding the fields of LAS 1.2 format `legacyFormat`:
+// 7 with color, else 6 (which always carries GPS time).
+int extendedPointFormat(int legacyFormat);
+
+// Copies `a` onto a liblas point of `formatId`, the color too if `withColor`.
+void setPointAttributes(liblas::Point& point, const PointAttributes& a, int formatId, bool withColor);
+
+// Writes the public header block and VLRs for `header` (rendered by liblas)
+// to `os`, leaving it positioned at the start of point data. Returns the header
+// as liblas completed it, including generated VLRs such as the LASzip one.
+liblas::Header writeLasHeader(std::ostream& os, const liblas::Header& header);
+
+// Writes a LAS 1.4 public header block for point format `formatId` (6 or 7)
+// with the scale, offset, bounds and VLRs of `header`, whose spatial reference
+// becomes an OGC WKT VLR as formats 6 and up require. liblas cannot write
+// LAS 1.4, so the header is laid out here. The point counts are left zero for
+// patchLasHeader. Returns the offset to point data.
+uint32_t writeLas14Header(std::ostream& os, const liblas::Header& header, int formatId);
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <liblas/liblas.hpp>
+#include "AlignedFileBuf.hpp"
+#include "DedupeSink.hpp"
+#include "LasEncoder.hpp"
+#include "LaxIndex.hpp"
+#include "PointCollector.hpp"
+#include "PointPipeline.hpp"
+#include "SortingSink.hpp"
+#include "TileSink.hpp"
+#include "VoxelFilter.hpp"
+
+// How LasOutput writes points, beyond what the header describes.
+struct OutputOptions {
+  int       threads;          // LAZ compression workers, 0 = all cores
+  size_t    inflightBytes;    // pipelined write pass budget, 0 = synchronous
+  SortOrder sort;             // space-filling curve order of the output points
+  size_t    spillMemoryBytes; // memory of the sorter, voxel filter or dedupe set before they spill
+  double    tileSize;         // split into square tiles of this size, 0 = single file
+  bool      lax;              // write a LASindex (.lax) spatial index next to the output
+  double    voxelSize;        // keep one point per voxel of this size, 0 = all points
+  VoxelMode voxelMode;        // which point a voxel keeps
+  bool      dedupe;           // drop points repeating an earlier point's quantized X, Y and Z
+  size_t    bufferBytes;      // file buffers written in the background, 0 = std::ofstream
+  bool      directIO;         // write the file with O_DIRECT, bypassing the page cache
+  bool      las14;            // LAS 1.4 with point format 6 or 7 and 64-bit counts (uncompressed, single file)
+
+  OutputOptions()
+      : threads(1), inflightBytes(0), sort(kSortNone), spillMemoryBytes(static_cast<size_t>(1) << 30), tileSize(0.0),
+        lax(false), voxelSize(0.0), voxelMode(kVoxelFirst), dedupe(false), bufferBytes(0), directIO(false), las14(false) {}
+};
+
+// The output file of a conversion. Points are packed by the native
+// LasPointEncoder and either written straight out (LAS) or compressed into
+// LASzip chunks on `threads` workers (LAZ). Builds without access to LASzip's
+// chunk coder, and single-threaded runs, compress through liblas::Writer.
+// Either way the point count and bounds are back-patched on close.
+//
+// With a sort order the records pass through a SortingSink, spilling sorted
+// runs next to the output file, and reach the file on close. With a tile size
+// the output is a grid of tile files written by a TileSink instead.
+//
+// With `lax` a LaxIndexSink in front of the file records which points fall in
+// which quadtree cell, in final file order, and writes <output>.lax on close.
+// Headers with a point count (two-pass) carry the bounds, so points are
+// indexed as they pass; otherwise, and when thinning or deduplication leaves
+// fewer points than the header counts, their X/Y are spooled until the end.
+//
+// With `dedupe` a DedupeSink right behind the encoder drops repeated points,
+// and with a voxel size a VoxelFilterSink behind it thins them; the header
+// gets the count and bounds of the points the last of them kept.
+//
+// With a non-zero in-flight budget the write pass is pipelined: encoding runs
+// on a PointPipeline thread and output I/O on an AsyncSink thread, connected
+// by bounded rings that hold at most `inflightBytes` of points and records.
+//
+// With a buffer size the file (not tiles, which have their own streams) is
+// written through an AlignedFileBuf, in large aligned writes from a
+// background thread and optionally with O_DIRECT.
+//
+// With `las14` the file is LAS 1.4: the header still describes point format
+// 0-3 (liblas knows no other), and the encoder packs the matching format 6 or
+// 7 behind a natively written 1.4 header whose 64-bit count lifts the 2^32
+// point limit. LASzip 2.2 cannot compress those formats, so LAZ and tiles
+// stay on LAS 1.2.
+struct LasOutput {
+  std::string                      filename;
+  liblas::Header                   header;
+  std::ofstream                    ofs;
+  AlignedFileBuf                   fileBuf;
+  std::ostream                     out; // over `fileBuf` or `ofs`
+  std::unique_ptr<liblas::Writer>  writer;
+  OutputOptions                    options;
+  // Declared in pipeline order so they are torn down consumer-last
+  std::unique_ptr<RecordSink>      sink;
+  std::unique_ptr<LaxIndexSink>    laxIndex;
+  std::unique_ptr<AsyncSink>       asyncSink;
+  std::unique_ptr<SortingSink>     sorter;
+  std::unique_ptr<VoxelFilterSink> voxel;
+  std::unique_ptr<DedupeSink>      dedupe;
+  std::unique_ptr<LasPointEncoder> encoder;
+  std::unique_ptr<PointPipeline>   pipeline;
+  TileSink*                        tiles; // `sink` when writing tiles
+
+  LasOutput() : out(nullptr), tiles(nullptr) {}
+
+  bool open(const std::string& filename, const liblas::Header& header, const OutputOptions& options = OutputOptions());
+
+  // Points `pc` at this output and selects its kernels, on the calling thread.
+  void attach(PointCollector& pc);
+
+  // Flushes and finalizes the point stream, then patches the header.
+  bool close(const PointCollector& pc);
+
+  // Points in the output once closed: those `pc` collected, after thinning
+  // and duplicate removal.
+  uint64_t pointCount(const PointCollector& pc) const {
+    return voxel ? voxel->keptCount() : dedupe ? dedupe->keptCount() : pc.count;
+  }
+
+private:
+  // First sink of the record chain behind the encoder.
+  RecordSink* head();
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <liblas/liblas.hpp>
+#include "LasEncoder.hpp"
+
+// Quadtree of LASindex (LAStools' .lax files). The bounding box is grown to
+// whole cells of `cellSize` and then to a power-of-two number of cells, and
+// is kept in single precision like LASlib does, so cell indices computed here
+// match the ones readers compute from the stored box.
+struct LaxQuadtree {
+  uint32_t levels;
+  float    minX, maxX, minY, maxY;
+
+  LaxQuadtree() : levels(0), minX(0), maxX(0), minY(0), maxY(0) {}
+
+  void setup(double boundsMinX, double boundsMaxX, double boundsMinY, double boundsMaxY, float cellSize);
+
+  // Index of the leaf cell holding (x, y); cells of all levels are numbered
+  // consecutively, root first.
+  uint32_t cellIndex(double x, double y) const;
+
+  static uint32_t levelOffset(uint32_t level) { return static_cast<uint32_t>(((uint64_t(1) << (2 * level)) - 1) / 3); }
+  static uint32_t levelOf(uint32_t cell);
+};
+
+// Point index intervals per quadtree cell, as in LASlib's LASinterval: a
+// point within `threshold` of the end of its cell's last interval extends it.
+// complete() then coarsens groups of four sibling cells holding fewer than
+// `minimumPoints` together and merges the smallest gaps until at most
+// `maximumIntervals` intervals remain (negative: that many per cell).
+struct LaxIndex {
+  explicit LaxIndex(uint32_t threshold = 1000);
+
+  void add(uint32_t point, uint32_t cell);
+  void complete(uint32_t minimumPoints = 100000, int maximumIntervals = -20);
+
+  // Writes the LASX file: quadtree ("LASS"/"LASQ") then intervals ("LASV").
+  bool write(const std::string& path, const LaxQuadtree& tree) const;
+
+  struct Cell {
+    uint32_t                                   full; // points in the cell
+    std::vector<std::pair<uint32_t, uint32_t>> intervals; // inclusive, ascending
+  };
+  std::map<uint32_t, Cell> cells;
+
+private:
+  uint32_t threshold;
+  Cell*    last;
+  uint32_t lastCell;
+};
+
+// RecordSink that indexes the records passing through it to `downstream`, in
+// file order, and writes the .lax file at `laxPath` on close. With the bounds
+// known up front (`boundsKnown`, from `header`) each record costs one cell
+// computation; otherwise the quantized X/Y are spooled to `laxPath`.tmp and
+// indexed on close against the bounds seen.
+struct LaxIndexSink : RecordSink {
+  LaxIndexSink(RecordSink& downstream, const liblas::Header& header, const std::string& laxPath, bool boundsKnown);
+  ~LaxIndexSink();
+
+  void write(const char* records, size_t count, size_t recordLength) override;
+  void close() override;
+
+  // Path of the index of output `filename`: its extension replaced by .lax.
+  static std::string laxPathFor(const std::string& filename);
+
+private:
+  RecordSink&   downstream;
+  double        scale[2], offset[2];
+  std::string   laxPath;
+  std::string   spoolPath;
+  std::ofstream spool;
+  LaxQuadtree   tree;
+  LaxIndex      index;
+  uint32_t      points;
+  int32_t       minRaw[2], maxRaw[2];
+  bool          closed;
+};
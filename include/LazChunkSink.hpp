@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <liblas/liblas.hpp>
+#include "LasEncoder.hpp"
+
+class LASzip;
+
+// True when the build can compress LAZ chunks itself (needs LASzip's internal
+// entropy coder for the chunk table, available when LASzip is fetched).
+bool parallelLazAvailable();
+
+// RecordSink that splits the point stream into standard LASzip chunks,
+// compresses them concurrently on a pool of threads and writes them in order,
+// followed by the chunk table. The compressor settings (items, chunk size)
+// come from the LASzip VLR in `header`, so the result reads like any file
+// written by liblas/LASzip. `os` must be positioned at the start of point
+// data and be seekable.
+struct LazChunkSink : RecordSink {
+  LazChunkSink(std::ostream& os, const liblas::Header& header, int threads);
+  ~LazChunkSink();
+
+  void write(const char* records, size_t count, size_t recordLength) override;
+  void close() override;
+
+  // Points per chunk, taken from the LASzip VLR.
+  size_t chunkSize() const { return chunkPoints; }
+
+private:
+  struct Chunk {
+    std::vector<char> records;
+    size_t            count;
+    std::string       compressed;
+    bool              done;
+  };
+
+  void worker();
+  void writeFinished(bool wait);
+  void submit();
+
+  std::ostream&                     os;
+  std::shared_ptr<LASzip>           zip;
+  std::vector<size_t>               itemOffsets;
+  size_t                            recordLength;
+  size_t                            chunkPoints;
+  size_t                            maxInFlight;
+  std::streamoff                    tablePointerPos;
+  std::shared_ptr<Chunk>            filling;
+  std::deque<std::shared_ptr<Chunk>> inFlight; // submission order
+  std::deque<std::shared_ptr<Chunk>> pending;  // waiting for a worker
+  std::vector<uint32_t>             chunkBytes;
+  std::vector<std::thread>          pool;
+  std::mutex                        m;
+  std::condition_variable           workAvailable, chunkDone;
+  bool                              stopping;
+  bool                              closed;
+  std::string                       error;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "PointCollector.hpp"
+
+// Runs processInput over every file in `filenames`, several files at a time.
+// Without an output on `pc` (scan pass) each worker accumulates bounds, counts
+// and Z histogram into its own collector and they are merged into `pc`. With
+// an output (write pass) workers parse files into bounded per-file batch queues
+// that the calling thread feeds to `pc` in input order, so the output is
+// identical to processing the files one after another. `srsWKT` receives the
+// spatial reference of the last input that has one. On failure returns false
+// and names the first input that could not be read in `failedInput`.
+bool processInputs(const std::vector<std::string>& filenames, PointCollector& pc,
+                   std::string& srsWKT, std::string& failedInput);
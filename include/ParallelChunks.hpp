@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include "PointCollector.hpp"
+
+// Returns the number of worker threads to use for `requested` (0 = all cores).
+int resolveThreadCount(int requested);
+
+// Runs fn(chunkIndex, workerIndex) once for every chunk on `threads` workers.
+// The calling thread acts as worker 0.
+void parallelFor(size_t chunkCount, int threads, const std::function<void(size_t, int)>& fn);
+
+// Fills one PointBatch per chunk on `threads` workers and hands each batch to
+// `consume` on the calling thread, either in chunk order (`ordered`) or as soon
+// as it is ready. At most 2 * threads batches are in flight at any time.
+void parallelBatches(size_t chunkCount, int threads, bool ordered,
+                     const std::function<void(size_t, PointBatch&)>& produce,
+                     const std::function<void(size_t, PointBatch&)>& consume);
@@ -1,27 +1,131 @@
 #pragma once
 
+#include <atomic>
 #include <cfloat>
+#include <functional>
 #include <iostream>
 #include <vector>
 #include <liblas/liblas.hpp>
 #include "ogrsf_frmts.h"
+#include "ColumnSchema.hpp"
+#include "UringReader.hpp"
+#include "ZHistogram.hpp"
+
+struct LasPointEncoder;
+struct PointPipeline;
+
+// A run of parsed points handed between threads, stored as interleaved x, y, z.
+// Points read with a --columns schema carry their attributes alongside; once
+// a batch holds any, points added without get zeroed ones, so `attributes` is
+// either empty or one per point.
+struct PointBatch {
+  std::vector<double>          xyz;
+  std::vector<PointAttributes> attributes;
+
+  void addPoint(double x, double y, double z) {
+    xyz.push_back(x);
+    xyz.push_back(y);
+    xyz.push_back(z);
+    if (!attributes.empty()) {
+      attributes.push_back(PointAttributes());
+    }
+  }
+  void addPoint(double x, double y, double z, const PointAttributes& a) {
+    if (attributes.size() < size()) {
+      attributes.resize(size());
+    }
+    xyz.push_back(x);
+    xyz.push_back(y);
+    xyz.push_back(z);
+    attributes.push_back(a);
+  }
+  // Appends `n` points; `attrs` may be null.
+  void append(const double* points, const PointAttributes* attrs, size_t n);
+
+  size_t size() const { return xyz.size() / 3; }
+  bool   empty() const { return xyz.empty(); }
+  void   clear() {
+    xyz.clear();
+    attributes.clear();
+  }
+  void swap(PointBatch& other) {
+    xyz.swap(other.xyz);
+    attributes.swap(other.attributes);
+  }
+  // Per-point attributes, or null when the batch has none.
+  const PointAttributes* attributesData() const { return attributes.empty() ? nullptr : &attributes[0]; }
+};
 
 struct PointCollector {
   double               minX, minY, minZ;
   double               maxX, maxY, maxZ;
-  long                 count;
+  uint64_t             count;
   bool                 colorize;
-  std::vector<double>* zValues;
+  ZHistogram*          zHistogram;
   liblas::Header*      header;
   liblas::Writer*      writer;
+  LasPointEncoder*     encoder;  // native record encoder, used instead of `writer`
+  PointPipeline*       pipeline; // when set, points are encoded on the pipeline's thread
   double               colorMinZ, zFactor;
-  long                 totalPoints;
+  uint64_t             totalPoints;
   liblas::Point*       reusablePoint;
   bool                 quiet;
+  std::atomic<long>*   progress; // when set, mirrors `count` for a ProgressReporter
+  int                  threads; // parser worker threads, 0 = all cores
+  bool                 ordered; // keep input order when parsing in parallel
+  const ColumnSchema*  columns; // field layout of XYZ text input, null = "x y z"
+  InputEngine          inputEngine; // how uncompressed XYZ files are read
+  bool                 directIO;    // uring engine: bypass the page cache (O_DIRECT)
+
+  // Single-pass mode: points are buffered until `deferLimit` of them have been
+  // seen (or flush() is called), then `openWriter` is invoked once so it can
+  // derive the header offset from the bounds of that first chunk.
+  std::function<void(PointCollector&)> openWriter;
+  PointBatch                           deferred;
+  size_t                               deferLimit;
+  // Forwarding mode: runs of `deferLimit` points are handed to `batchSink`
+  // instead of being written (per-file producers of the multi-file write pass).
+  std::function<void(PointBatch&)>     batchSink;
+
+  // Batch kernels, instantiated per configuration from policy templates (see
+  // PointCollector.cpp) so their per-point loops carry no configuration
+  // checks: `accumulate` folds bounds, count and the Z histogram, `emit`
+  // forwards points to the output (or the deferred batch), and `encode`
+  // colorizes and writes them (the pipeline's encode stage). `attrs` holds one
+  // PointAttributes per point, or is null.
+  typedef void (*BatchKernel)(PointCollector& pc, const double* xyz, const PointAttributes* attrs, size_t n);
+  BatchKernel accumulate;
+  BatchKernel emit;
+  BatchKernel encode;
 
   PointCollector();
   ~PointCollector();
 
+  // Selects the batch kernels for the current output, color and point format
+  // settings. LasOutput::attach calls it; call it again after changing those
+  // settings, before points are added. addBatch() runs it if it was never
+  // called, but the encode stage of a pipeline requires it up front.
+  void specialize();
+
   void addPoint(double x, double y, double z);
+  void addPoint(double x, double y, double z, const PointAttributes& a);
+  void addBatch(const PointBatch& batch);
+  // Colorizes and writes points without touching bounds or count (encode stage).
+  void writeBatch(const PointBatch& batch);
   void processGeometry(OGRGeometry* g);
+  void flush();
+
+  // Folds the bounds, count and Z histogram of a per-thread collector into this one.
+  void merge(const PointCollector& other);
+
+  // True when points are written out rather than only counted.
+  bool isWriting() const { return hasOutput() || static_cast<bool>(openWriter) || static_cast<bool>(batchSink); }
+  bool hasOutput() const { return encoder != nullptr || (writer != nullptr && header != nullptr); }
+
+private:
+  friend struct CollectorKernels;
+
+  void collect(double x, double y, double z, const PointAttributes* a);
+  void emitPoint(double x, double y, double z, const PointAttributes* a);
+  void writePoint(double x, double y, double z, const PointAttributes* a);
 };
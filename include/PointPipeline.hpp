@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "LasEncoder.hpp"
+#include "PointCollector.hpp"
+#include "SpscQueue.hpp"
+
+// Points per batch travelling between pipeline stages
+const size_t kPipelineBatchPoints = 65536;
+
+// Encode stage of the write pass. The parse side (the thread calling
+// PointCollector::addPoint) stages points into batches that are handed over a
+// bounded SPSC ring to a dedicated thread, which colorizes and quantizes them
+// through PointCollector::writeBatch. Emptied batches travel back on a second
+// ring so their memory is reused.
+struct PointPipeline {
+  PointCollector&          pc;
+  PointBatch               staging;
+  SpscQueue<PointBatch>    full;
+  SpscQueue<PointBatch>    empty;
+  std::thread              encoder;
+  std::atomic<bool>        failed;
+  std::exception_ptr       error;
+  bool                     finished;
+
+  // `maxBytes` bounds the memory held by batches in both rings.
+  PointPipeline(PointCollector& pc, size_t maxBytes);
+  ~PointPipeline();
+
+  // Memory of the batches both rings can hold at once.
+  size_t slotBytes() const { return (full.capacity() + empty.capacity()) * batchBytes(); }
+
+  void add(double x, double y, double z) {
+    staging.addPoint(x, y, z);
+    if (staging.size() >= kPipelineBatchPoints) {
+      submit();
+    }
+  }
+  void add(double x, double y, double z, const PointAttributes& a) {
+    staging.addPoint(x, y, z, a);
+    if (staging.size() >= kPipelineBatchPoints) {
+      submit();
+    }
+  }
+
+  // Hands the staged points to the encode stage.
+  void submit();
+
+  // Drains the pipeline and joins the encode thread; rethrows its error.
+  void finish();
+
+  static size_t batchBytes() { return kPipelineBatchPoints * 3 * sizeof(double); }
+
+private:
+  void run();
+};
+
+// Write stage: a RecordSink that copies record runs into pooled buffers and
+// writes them to `downstream` on its own thread, so encoding and output I/O
+// overlap. close() drains the queue and then closes `downstream`.
+struct AsyncSink : RecordSink {
+  RecordSink&                   downstream;
+  size_t                        recordLength;
+  size_t                        bufferBytes;
+  SpscQueue<std::vector<char>>  full;
+  SpscQueue<std::vector<char>>  empty;
+  std::thread                   writer;
+  std::atomic<bool>             failed;
+  std::exception_ptr            error;
+  bool                          closed;
+
+  // `maxBytes` bounds the memory held by buffers in both rings, assuming
+  // buffers of roughly `bufferBytes` each.
+  AsyncSink(RecordSink& downstream, size_t maxBytes, size_t bufferBytes);
+  ~AsyncSink();
+
+  // Memory of the buffers both rings can hold at once.
+  size_t slotBytes() const { return (full.capacity() + empty.capacity()) * bufferBytes; }
+
+  void write(const char* records, size_t count, size_t recordLength) override;
+  void close() override;
+
+private:
+  void run();
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Resource usage of one phase of a conversion. CPU time and page faults cover
+// every thread of the process.
+struct PhaseStats {
+  std::string name;
+  double      wallSeconds;
+  double      cpuSeconds;
+  uint64_t    points;
+  uint64_t    inputBytes;
+  uint64_t    outputBytes;
+  long        minorFaults;
+  long        majorFaults;
+};
+
+// CPU cycles, instructions and cache misses of the whole run.
+struct RunCounters {
+  uint64_t cycles, instructions, cacheMisses;
+};
+
+// Wall time, CPU time and page faults per phase, plus the peak RSS of the run
+// and, where available, its CPU cycles, instructions and cache misses. The
+// hardware counters are only available on Linux, where perf_event_open is
+// permitted (see perf_event_paranoid). They are opened with inheritance, and
+// an inherited count only reaches the parent when its thread exits, so stage
+// threads would land in whichever phase joins them; they are therefore only
+// reported for the whole run. A disabled profiler records nothing.
+struct Profiler {
+  explicit Profiler(bool enabled);
+  ~Profiler();
+
+  bool enabled() const { return on; }
+
+  void begin(const std::string& phase);
+  void end(uint64_t points, uint64_t inputBytes, uint64_t outputBytes);
+
+  const std::vector<PhaseStats>& phases() const { return done; }
+  double                         peakRssMB() const;
+
+  // Counts so far; false when the hardware counters are unavailable.
+  bool runCounters(RunCounters& counters) const;
+
+  void printTable(std::ostream& out) const;
+  bool writeJson(const std::string& path) const;
+
+private:
+  struct Sample {
+    std::chrono::steady_clock::time_point wall;
+    double                                cpuSeconds;
+    long                                  minorFaults, majorFaults;
+  };
+
+  void sample(Sample& s) const;
+
+  bool                    on;
+  int                     counterFds[3]; // -1 when unavailable
+  bool                    hasCounters;
+  std::string             current;
+  Sample                  start;
+  std::vector<PhaseStats> done;
+};
+
+// Prints "<label>: n / total (p%)" a few times per second from a background
+// thread, sampling a counter the producer updates with relaxed stores, so the
+// hot path carries no formatting or modulo checks.
+struct ProgressReporter {
+  ProgressReporter(const std::string& label, long total, const std::atomic<long>& counter,
+                   std::chrono::milliseconds interval = std::chrono::milliseconds(250));
+  ~ProgressReporter();
+
+  // Prints the final count and joins the reporter thread.
+  void stop();
+
+private:
+  void print(long value) const;
+  void run();
+
+  std::string               label;
+  long                      total;
+  const std::atomic<long>&  counter;
+  std::chrono::milliseconds interval;
+  std::mutex                mutex;
+  std::condition_variable   wake;
+  bool                      stopping;
+  std::thread               thread;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include "gdal_priv.h"
+#include "PointCollector.hpp"
+
+// Converts band 1 of `dataset` into one point per valid pixel centre. The
+// raster is read in its native block layout (GetBlockSize/ReadBlock), so every
+// compressed tile is decoded exactly once, and blocks are decoded on
+// pc.threads workers that each open their own handle on `filename`. Points are
+// emitted block by block in row-major block order (or as blocks finish when
+// !pc.ordered). Rasters whose blocks are too large to hold, such as single
+// strip images, are read in windows of whole rows instead.
+void processRaster(const std::string& filename, GDALDataset* dataset, PointCollector& pc);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "LasEncoder.hpp"
+
+// Space-filling curve used to order output points.
+enum SortOrder {
+  kSortNone    = 0,
+  kSortMorton  = 1,
+  kSortHilbert = 2
+};
+
+// Parses "none", "morton" or "hilbert".
+bool parseSortOrder(const std::string& name, SortOrder& order);
+
+// Curve position of the quantized X/Y of a packed LAS record. Coordinates are
+// mapped order-preservingly to unsigned 32-bit and interleaved into 64 bits,
+// so no bounds are needed up front and single-pass output can be sorted too.
+uint64_t mortonKey(uint32_t x, uint32_t y);
+uint64_t hilbertKey(uint32_t x, uint32_t y);
+uint64_t curveKey(SortOrder order, const char* record);
+
+// RecordSink that reorders records along a space-filling curve before they
+// reach `downstream`: an external merge sort. Records accumulate up to
+// `memoryBytes`, are sorted by curve key and spilled as runs to temporary files
+// named `tempPrefix`.sort<N>.tmp, which close() k-way merges into `downstream`
+// (and then closes it). Inputs that fit in memory never touch the disk. Equal
+// keys keep their input order.
+struct SortingSink : RecordSink {
+  SortingSink(RecordSink& downstream, SortOrder order, size_t memoryBytes, const std::string& tempPrefix);
+  ~SortingSink();
+
+  void write(const char* records, size_t count, size_t recordLength) override;
+  void close() override;
+
+  // Number of runs spilled to disk.
+  size_t runCount() const { return runs.size(); }
+
+private:
+  struct Entry {
+    uint64_t key;
+    uint32_t index;
+    bool operator<(const Entry& o) const { return key < o.key || (key == o.key && index < o.index); }
+  };
+
+  // Sorts the buffered records into `out` and empties the buffer.
+  void writeSorted(RecordSink& out);
+  void spill();
+  void merge();
+  void removeRuns();
+
+  RecordSink&              downstream;
+  SortOrder                order;
+  size_t                   memoryBytes;
+  std::string              tempPrefix;
+  size_t                   recordLength;
+  size_t                   runRecords; // records per in-memory run
+  std::vector<char>        buffer;
+  std::vector<Entry>       entries;
+  std::vector<std::string> runs;
+  bool                     closed;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free single-producer/single-consumer ring buffer. push() blocks
+// while the ring is full, which is what provides back-pressure between
+// pipeline stages; pop() blocks until an item arrives or the queue is closed
+// and drained. Waiting spins briefly, then yields, then sleeps.
+template <class T>
+class SpscQueue {
+public:
+  explicit SpscQueue(size_t capacity) : head(0), tail(0), closed(false) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  bool tryPush(T& value) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) > mask) {
+      return false;
+    }
+    slots[t & mask] = std::move(value);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& value) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(slots[h & mask]);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  void push(T& value) {
+    for (unsigned spins = 0; !tryPush(value); ++spins) {
+      backoff(spins);
+    }
+  }
+
+  // Like push(), but gives up and returns false once `cancel` is set.
+  bool push(T& value, const std::atomic<bool>& cancel) {
+    for (unsigned spins = 0; !tryPush(value); ++spins) {
+      if (cancel.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      backoff(spins);
+    }
+    return true;
+  }
+
+  // Returns false once the queue is closed and empty.
+  bool pop(T& value) {
+    for (unsigned spins = 0;; ++spins) {
+      if (tryPop(value)) {
+        return true;
+      }
+      if (closed.load(std::memory_order_acquire)) {
+        return tryPop(value);
+      }
+      backoff(spins);
+    }
+  }
+
+  // Producer side: no more items will be pushed.
+  void close() {
+    closed.store(true, std::memory_order_release);
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+private:
+  static void backoff(unsigned spins) {
+    if (spins < 64) {
+      return;
+    }
+    if (spins < 256) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  std::vector<T> slots;
+  size_t         mask;
+  // Padding keeps producer and consumer indices on separate cache lines
+  char                pad0[64];
+  std::atomic<size_t> head;
+  char                pad1[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail;
+  char                pad2[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<bool> closed;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Vectorized tokenizer for whitespace separated text, in the spirit of
+// simdjson's structural index: 64-byte blocks are classified into newline and
+// separator (space, tab, CR) bitmasks from which the offset of every field
+// start and every newline is extracted with a count-trailing-zeros loop. The
+// parser then jumps straight from one field to the next.
+enum ScannerLevel {
+  kScannerScalar = 0,
+  kScannerSSE42  = 1,
+  kScannerAVX2   = 2
+};
+
+// Best implementation supported by the running CPU.
+ScannerLevel detectScannerLevel();
+const char*  scannerLevelName(ScannerLevel level);
+
+// Appends to `indices` the offset (relative to `begin`) of every byte in
+// [begin, end) that is either a newline or the first byte of a field. The
+// range must be shorter than 4 GiB.
+void scanStructure(const char* begin, const char* end, std::vector<uint32_t>& indices, ScannerLevel level);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <liblas/liblas.hpp>
+#include "BucketSpool.hpp"
+#include "LasEncoder.hpp"
+
+// RecordSink that splits the point stream into a grid of square tiles of
+// `tileSize` map units, aligned to multiples of the tile size. Every tile is a
+// separate file named after `filename` with the tile's column and row appended
+// (out.las -> out_<col>_<row>.las). Tiles share the scale and offset of
+// `header`, so records are routed without re-encoding, and get their own point
+// count and bounds back-patched on close.
+//
+// Records are appended to the tile files through a BucketSpool, keeping both
+// memory and file descriptors bounded however many tiles there are. LAS tiles
+// are written in place; LAZ tiles collect raw records in a temporary file and
+// are compressed on close, on `threads` workers.
+struct TileSink : RecordSink {
+  TileSink(const liblas::Header& header, const std::string& filename, double tileSize, int threads);
+
+  void write(const char* records, size_t count, size_t recordLength) override;
+  void close() override;
+
+  size_t tileCount() const { return tiles.size(); }
+
+  // Path of the tile at (`column`, `row`) for output `filename`.
+  static std::string tilePath(const std::string& filename, int64_t column, int64_t row);
+
+private:
+  struct Tile {
+    std::string path;  // final file
+    std::string spool; // file records are appended to
+    uint64_t    count;
+    int32_t     minRaw[3], maxRaw[3];
+  };
+
+  void finishTile(Tile& tile);
+
+  liblas::Header                     header;
+  std::string                        filename;
+  double                             tileSize;
+  int                                threads;
+  bool                               compressed;
+  size_t                             recordLength;
+  std::unordered_map<uint64_t, Tile> tiles;
+  BucketSpool                        spool;
+  bool                               closed;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// How processXYZ reads uncompressed files.
+enum InputEngine {
+  kInputEngineMmap  = 0, // memory mapped (mio); the parser's page faults read the file
+  kInputEngineUring = 1  // deep-queued io_uring reads into a ring of buffers
+};
+
+// Parses "mmap" or "uring"; returns false for anything else.
+bool parseInputEngine(const std::string& name, InputEngine& engine);
+// Whether this build and the running kernel support io_uring.
+bool uringAvailable();
+
+// Reads a file as consecutive blocks of `blockBytes`, keeping up to `depth`
+// reads in flight from a background thread: io_uring where available, plain
+// pread otherwise. Parser threads acquire blocks in any order and release them
+// once parsed; block i + depth reuses the buffer of block i. With `directIO`
+// the file is opened with O_DIRECT (buffers are page aligned) if the file
+// system allows it.
+struct UringReader {
+  UringReader(const std::string& filename, size_t blockBytes, size_t depth, bool directIO);
+  ~UringReader();
+
+  bool     isOpen() const;
+  uint64_t size() const;
+  size_t   blockCount() const;
+  bool     usingUring() const;
+  bool     usingDirectIO() const;
+
+  // Waits until block `block` is read and returns its bytes. Throws
+  // std::runtime_error on read errors.
+  const char* acquire(size_t block, size_t& length);
+  // Hands the buffer of an acquired block back for reading ahead.
+  void release(size_t block);
+
+  struct Impl;
+
+private:
+  std::unique_ptr<Impl> impl;
+};
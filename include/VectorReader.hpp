@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ogrsf_frmts.h"
+#include "PointCollector.hpp"
+
+// Adds every vertex of all features in `layer` to `pc`. On GDAL 3.6 and newer
+// the layer is read through OGRLayer::GetArrowStream: attribute fields are
+// ignored and the WKB geometry column of each record batch is decoded in a
+// tight loop, avoiding an OGRFeature and OGRGeometry allocation per feature.
+// Older GDAL, or layers that cannot provide a stream, fall back to the
+// GetNextFeature() loop.
+void processLayer(OGRLayer* layer, PointCollector& pc);
+
+// Adds the vertices of one ISO or extended WKB geometry the same way as
+// PointCollector::processGeometry (points, line strings, polygon rings and
+// their multi/collection forms; Z defaults to 0). Returns the number of bytes
+// consumed, or 0 when the geometry is truncated or of an unsupported type.
+size_t addWkbGeometry(const uint8_t* wkb, size_t size, PointCollector& pc);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <liblas/liblas.hpp>
+#include "BucketSpool.hpp"
+#include "LasEncoder.hpp"
+
+// Which point a voxel keeps.
+enum VoxelMode {
+  kVoxelFirst   = 0, // the first one seen
+  kVoxelCenter  = 1, // the one closest to the voxel center
+  kVoxelAverage = 2  // the first one, moved to the mean position of all
+};
+
+// Parses "first", "center" or "average".
+bool parseVoxelMode(const std::string& name, VoxelMode& mode);
+
+// RecordSink that thins the point stream to one point per cubic voxel of
+// `voxelSize` map units, aligned to multiples of the size, before it reaches
+// `downstream`. Voxels are kept in an open-addressing hash of their integer
+// coordinates, and the surviving records are written on close, in the order
+// their voxels were first seen.
+//
+// Once the table outgrows `memoryBytes` its voxels, and every later record,
+// are spread over XY-partitioned buckets spooled to `tempPrefix`.voxel-*.tmp
+// files. A voxel lies in exactly one bucket, so close() thins the buckets one
+// at a time, splitting any that are still too large into quarters.
+struct VoxelFilterSink : RecordSink {
+  VoxelFilterSink(RecordSink& downstream, const liblas::Header& header, double voxelSize, VoxelMode mode,
+                  size_t memoryBytes, const std::string& tempPrefix);
+  ~VoxelFilterSink();
+
+  void write(const char* records, size_t count, size_t recordLength) override;
+  void close() override;
+
+  // Points written downstream and their bounds (X, Y, Z); valid after close().
+  uint64_t keptCount() const { return kept; }
+  void     keptBounds(double minXYZ[3], double maxXYZ[3]) const;
+
+  // Spooled buckets, 0 when everything fit in memory.
+  size_t bucketCount() const { return buckets ? buckets->keys().size() : 0; }
+
+private:
+  struct Slot {
+    int32_t  key[3];
+    uint32_t entry; // kEmptySlot when free
+  };
+
+  void   voxelOf(const char* record, int32_t key[3]) const;
+  double centerDistance(const int32_t key[3], const char* record) const;
+  size_t lookup(const int32_t key[3], bool& inserted);
+  void   grow();
+  size_t tableBytes() const;
+
+  // Adds a record, or a spooled entry carrying its aggregate, to the table.
+  void addEntry(const char* entry);
+  void spillTable();
+  void spillEntry(const char* entry, int shift, BucketSpool& spool);
+  void emitTable();
+  void clearTable();
+  void thinBucket(const std::string& path, uint64_t bytes, int shift);
+  std::string bucketPath(int shift, uint64_t key) const;
+
+  RecordSink&                  downstream;
+  double                       voxelSize;
+  VoxelMode                    mode;
+  size_t                       memoryBytes;
+  std::string                  tempPrefix;
+  double                       scale[3], offset[3];
+  size_t                       recordLength;
+  size_t                       entryLength; // spooled: record, then the aggregate when averaging
+  std::vector<Slot>            slots;
+  size_t                       entries;
+  std::vector<char>            records;     // per entry, in first-seen order
+  std::vector<double>          distances;   // kVoxelCenter
+  std::vector<int64_t>         sums;        // kVoxelAverage: raw X, Y, Z per entry
+  std::vector<uint32_t>        counts;      // kVoxelAverage
+  std::unique_ptr<BucketSpool> buckets;
+  int                          shift;       // bucket side is 2^shift voxels
+  std::vector<char>            entry;       // scratch spooled entry
+  uint64_t                     kept;
+  int32_t                      minRaw[3], maxRaw[3];
+  bool                         closed;
+};
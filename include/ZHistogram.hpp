@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Fixed-memory streaming quantile estimator used for --color.
+//
+// Values are counted in equal-width bins on a global grid whose width is a
+// power of two. When a value falls outside the covered span the window is
+// either re-centred or, if the data no longer fits, the width doubles and
+// neighbouring bins are folded together. The bin width therefore stays within
+// `relativeError` of the observed range, which bounds the quantile error, and
+// two histograms can be merged exactly regardless of the order values arrived.
+struct ZHistogram {
+  double                relativeError;
+  int                   exponent; // bin width is 2^exponent
+  int64_t               base;     // grid index of bins[0]
+  std::vector<uint64_t> bins;
+  uint64_t              total;
+  double                minZ, maxZ;
+
+  explicit ZHistogram(double relativeError = 0.001);
+
+  // Counts `n` occurrences of z (NaN is ignored).
+  void   add(double z, uint64_t n = 1);
+  void   merge(const ZHistogram& other);
+  double quantile(double q) const;
+  double binWidth() const;
+
+private:
+  int64_t key(double z) const;
+  void    coarsen();
+  void    rebase(int64_t newBase);
+  void    cover(double lo, double hi);
+};
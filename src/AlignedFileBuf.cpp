@@ -0,0 +1,301 @@
+#include "AlignedFileBuf.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+  // O_DIRECT transfers must be aligned to the device's logical block size,
+  // which a page covers
+  const size_t kAlignment = 4096;
+  // One buffer filling while the other is written
+  const size_t kBuffers = 2;
+
+  size_t alignUp(size_t n) {
+    return (n + kAlignment - 1) & ~(kAlignment - 1);
+  }
+} // namespace
+
+AlignedFileBuf::AlignedFileBuf()
+    : fd(-1), bufferedFd(-1), direct(false), capacity(0), full(kBuffers), empty(kBuffers), failed(false),
+      patching(false), patchPos(0) {
+  current.data   = nullptr;
+  current.size   = 0;
+  current.offset = 0;
+}
+
+AlignedFileBuf::~AlignedFileBuf() {
+  close();
+}
+
+bool AlignedFileBuf::open(const std::string& filename, size_t bufferBytes, bool directIO) {
+#if defined(__unix__) || defined(__APPLE__)
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_CLOEXEC)
+  flags |= O_CLOEXEC;
+#endif
+#if defined(O_DIRECT)
+  if (directIO) {
+    fd     = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+    direct = fd >= 0;
+  }
+#else
+  (void)directIO;
+#endif
+  if (fd < 0) {
+    fd = ::open(filename.c_str(), flags, 0644);
+  }
+  if (fd < 0) {
+    return false;
+  }
+  bufferedFd = direct ? ::open(filename.c_str(), flags & ~(O_CREAT | O_TRUNC)) : fd;
+  if (bufferedFd < 0) {
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  capacity = alignUp(std::max<size_t>(bufferBytes, 1));
+  for (size_t i = 0; i < kBuffers; ++i) {
+    void* data = nullptr;
+    if (posix_memalign(&data, kAlignment, capacity) != 0) {
+      throw std::bad_alloc();
+    }
+    allocations.push_back(static_cast<char*>(data));
+    Block block = {static_cast<char*>(data), 0, 0};
+    idle.push_back(block);
+  }
+  current = idle.back();
+  idle.pop_back();
+  setp(current.data, current.data + capacity);
+  writer = std::thread(&AlignedFileBuf::run, this);
+  return true;
+#else
+  (void)filename;
+  (void)bufferBytes;
+  (void)directIO;
+  return false;
+#endif
+}
+
+bool AlignedFileBuf::close() {
+  if (fd < 0) {
+    return true;
+  }
+#if defined(__unix__) || defined(__APPLE__)
+  if (patching) {
+    leavePatchMode();
+  }
+  uint64_t size = appendPos();
+  current.size  = pptr() - pbase();
+  if (current.size > 0) {
+    if (direct) {
+      // O_DIRECT writes whole pages; the padding is truncated away below
+      size_t padded = alignUp(current.size);
+      std::memset(current.data + current.size, 0, padded - current.size);
+      current.size = padded;
+    }
+    full.push(current);
+  }
+  full.close();
+  writer.join();
+  setp(nullptr, nullptr);
+  if (direct && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    failed = true;
+  }
+  if (::close(fd) != 0) {
+    failed = true;
+  }
+  if (bufferedFd != fd) {
+    ::close(bufferedFd);
+  }
+  fd = bufferedFd = -1;
+#endif
+  for (char* data : allocations) {
+    std::free(data);
+  }
+  allocations.clear();
+  idle.clear();
+  return !failed;
+}
+
+uint64_t AlignedFileBuf::appendPos() const {
+  return current.offset + (patching ? current.size : static_cast<size_t>(pptr() - pbase()));
+}
+
+void AlignedFileBuf::submit() {
+  current.size = pptr() - pbase();
+  if (current.size == 0) {
+    return;
+  }
+  uint64_t next = current.offset + current.size;
+  full.push(current);
+  if (!idle.empty()) {
+    current = idle.back();
+    idle.pop_back();
+  } else {
+    empty.pop(current); // the writer hands every buffer back
+  }
+  current.offset = next;
+  setp(current.data, current.data + capacity);
+}
+
+void AlignedFileBuf::drain() {
+  while (idle.size() + 1 < kBuffers) {
+    Block block;
+    empty.pop(block);
+    idle.push_back(block);
+  }
+}
+
+void AlignedFileBuf::enterPatchMode(uint64_t pos) {
+  if (!patching) {
+    current.size = pptr() - pbase();
+    setp(nullptr, nullptr); // every write goes through xsputn/overflow
+    patching = true;
+  }
+  patchPos = pos;
+}
+
+void AlignedFileBuf::leavePatchMode() {
+  patching = false;
+  setp(current.data, current.data + capacity);
+  advancePut(current.size);
+}
+
+void AlignedFileBuf::advancePut(size_t n) {
+  while (n > 0) {
+    int step = static_cast<int>(std::min<size_t>(n, INT_MAX));
+    pbump(step);
+    n -= static_cast<size_t>(step);
+  }
+}
+
+AlignedFileBuf::int_type AlignedFileBuf::overflow(int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof())) {
+    return traits_type::not_eof(c);
+  }
+  char ch = traits_type::to_char_type(c);
+  return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
+
+std::streamsize AlignedFileBuf::xsputn(const char* s, std::streamsize n) {
+  if (fd < 0 || failed) {
+    return 0;
+  }
+  if (patching) {
+    return patch(s, static_cast<size_t>(n)) ? n : 0;
+  }
+  std::streamsize done = 0;
+  while (done < n) {
+    if (pptr() == epptr()) {
+      submit();
+    }
+    size_t room = epptr() - pptr();
+    size_t k    = std::min(room, static_cast<size_t>(n - done));
+    std::memcpy(pptr(), s + done, k);
+    advancePut(k);
+    done += k;
+  }
+  return done;
+}
+
+AlignedFileBuf::pos_type AlignedFileBuf::seekoff(off_type off, std::ios_base::seekdir dir,
+                                                 std::ios_base::openmode which) {
+  uint64_t base = appendPos();
+  if (dir == std::ios_base::beg) {
+    base = 0;
+  } else if (dir == std::ios_base::cur && patching) {
+    base = patchPos;
+  }
+  return seekpos(pos_type(static_cast<off_type>(base) + off), which);
+}
+
+AlignedFileBuf::pos_type AlignedFileBuf::seekpos(pos_type pos, std::ios_base::openmode which) {
+  off_type target = pos;
+  if (fd < 0 || !(which & std::ios_base::out) || target < 0 || static_cast<uint64_t>(target) > appendPos()) {
+    return pos_type(off_type(-1));
+  }
+  if (static_cast<uint64_t>(target) == appendPos()) {
+    if (patching) {
+      leavePatchMode();
+    }
+  } else {
+    enterPatchMode(static_cast<uint64_t>(target));
+  }
+  return pos;
+}
+
+bool AlignedFileBuf::patch(const char* s, size_t n) {
+  while (n > 0) {
+    if (patchPos == appendPos()) {
+      // Caught up with the end: the rest is appended as usual
+      leavePatchMode();
+      return xsputn(s, static_cast<std::streamsize>(n)) == static_cast<std::streamsize>(n);
+    }
+    size_t k;
+    if (patchPos >= current.offset) {
+      // Still in the buffer being filled
+      size_t at = static_cast<size_t>(patchPos - current.offset);
+      k         = std::min(n, current.size - at);
+      std::memcpy(current.data + at, s, k);
+    } else {
+      // Already handed to the writer: wait for it, then write in place
+      drain();
+      k = static_cast<size_t>(std::min<uint64_t>(n, current.offset - patchPos));
+      if (!writeAt(bufferedFd, s, k, patchPos)) {
+        failed = true;
+        return false;
+      }
+    }
+    s += k;
+    n -= k;
+    patchPos += k;
+  }
+  return true;
+}
+
+bool AlignedFileBuf::writeAt(int file, const char* s, size_t n, uint64_t offset) {
+#if defined(__unix__) || defined(__APPLE__)
+  while (n > 0) {
+    ssize_t written = pwrite(file, s, n, static_cast<off_t>(offset));
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    s += written;
+    n -= static_cast<size_t>(written);
+    offset += static_cast<uint64_t>(written);
+  }
+  return true;
+#else
+  (void)file;
+  (void)s;
+  (void)n;
+  (void)offset;
+  return false;
+#endif
+}
+
+void AlignedFileBuf::run() {
+  Block block;
+  while (full.pop(block)) {
+    if (!failed.load(std::memory_order_relaxed)) {
+      // Some file systems accept O_DIRECT at open but refuse the writes
+      bool ok = writeAt(fd, block.data, block.size, block.offset) ||
+                (direct && writeAt(bufferedFd, block.data, block.size, block.offset));
+      if (!ok) {
+        failed.store(true, std::memory_order_release);
+      }
+    }
+    empty.push(block);
+  }
+}
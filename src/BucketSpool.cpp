@@ -0,0 +1,127 @@
+#include "BucketSpool.hpp"
+#include <cstdio>
+#include <stdexcept>
+
+BucketSpool::BucketSpool(const PathFn& pathFor, const CreateFn& onCreate, size_t bucketBufferBytes,
+                         size_t totalBufferBytes, size_t maxOpenFiles)
+    : pathFor(pathFor), onCreate(onCreate), bucketBufferBytes(bucketBufferBytes), totalBufferBytes(totalBufferBytes),
+      maxOpenFiles(maxOpenFiles > 0 ? maxOpenFiles : 1), buffered(0) {}
+
+BucketSpool::~BucketSpool() {
+  for (Bucket* bucket : lru) {
+    bucket->file.reset();
+  }
+}
+
+void BucketSpool::append(uint64_t key, const char* data, size_t bytes) {
+  Bucket& bucket = buckets[key];
+  if (bucket.path.empty()) {
+    bucket.key     = key;
+    bucket.path    = pathFor(key);
+    bucket.bytes   = 0;
+    bucket.created = false;
+  }
+  bucket.buffer.insert(bucket.buffer.end(), data, data + bytes);
+  bucket.bytes += bytes;
+  buffered += bytes;
+  if (bucket.buffer.size() >= bucketBufferBytes) {
+    flush(bucket);
+  }
+  if (buffered >= totalBufferBytes) {
+    flushAll();
+  }
+}
+
+void BucketSpool::closeFile(Bucket& bucket) {
+  bucket.file->close();
+  bool failed = bucket.file->fail();
+  bucket.file.reset();
+  if (failed) {
+    throw std::runtime_error("Failed to write spool file: " + bucket.path);
+  }
+}
+
+std::ofstream& BucketSpool::open(Bucket& bucket) {
+  if (bucket.file) {
+    lru.splice(lru.begin(), lru, bucket.lruPos);
+    return *bucket.file;
+  }
+  if (lru.size() >= maxOpenFiles) {
+    Bucket* victim = lru.back();
+    lru.pop_back();
+    closeFile(*victim);
+  }
+
+  std::ios::openmode mode = std::ios::out | std::ios::binary | (bucket.created ? std::ios::app : std::ios::trunc);
+  bucket.file.reset(new std::ofstream(bucket.path, mode));
+  if (!bucket.file->is_open()) {
+    bucket.file.reset();
+    throw std::runtime_error("Cannot open spool file: " + bucket.path);
+  }
+  if (!bucket.created && onCreate) {
+    onCreate(*bucket.file, bucket.key);
+  }
+  bucket.created = true;
+  lru.push_front(&bucket);
+  bucket.lruPos = lru.begin();
+  return *bucket.file;
+}
+
+void BucketSpool::flush(Bucket& bucket) {
+  if (bucket.buffer.empty()) {
+    return;
+  }
+  std::ofstream& os = open(bucket);
+  os.write(&bucket.buffer[0], static_cast<std::streamsize>(bucket.buffer.size()));
+  if (!os.good()) {
+    throw std::runtime_error("Failed to write spool file: " + bucket.path);
+  }
+  buffered -= bucket.buffer.size();
+  bucket.buffer.clear();
+}
+
+void BucketSpool::flushAll() {
+  for (auto& entry : buckets) {
+    flush(entry.second);
+    std::vector<char>().swap(entry.second.buffer);
+  }
+}
+
+void BucketSpool::finish() {
+  flushAll();
+  while (!lru.empty()) {
+    Bucket* bucket = lru.front();
+    lru.pop_front();
+    closeFile(*bucket);
+  }
+}
+
+void BucketSpool::remove() {
+  for (auto& entry : buckets) {
+    entry.second.file.reset();
+    std::remove(entry.second.path.c_str());
+  }
+  lru.clear();
+}
+
+std::vector<uint64_t> BucketSpool::keys() const {
+  std::vector<uint64_t> all;
+  all.reserve(buckets.size());
+  for (const auto& entry : buckets) {
+    all.push_back(entry.first);
+  }
+  return all;
+}
+
+const std::string& BucketSpool::path(uint64_t key) const {
+  auto it = buckets.find(key);
+  if (it == buckets.end()) {
+    throw std::out_of_range("Unknown spool bucket");
+  }
+  return it->second.path;
+}
+
+uint64_t BucketSpool::bytes(uint64_t key) const {
+  auto it = buckets.find(key);
+  return it == buckets.end() ? 0 : it->second.bytes;
+}
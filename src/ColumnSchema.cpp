@@ -0,0 +1,111 @@
+#include "ColumnSchema.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+  bool fieldNamed(const std::string& name, ColumnField& field) {
+    struct Name {
+      const char* name;
+      ColumnField field;
+    };
+    static const Name names[] = {
+        {"x", kColumnX},           {"y", kColumnY},          {"z", kColumnZ},
+        {"i", kColumnIntensity},   {"intensity", kColumnIntensity},
+        {"r", kColumnRed},         {"red", kColumnRed},
+        {"g", kColumnGreen},       {"green", kColumnGreen},
+        {"b", kColumnBlue},        {"blue", kColumnBlue},
+        {"c", kColumnClassification}, {"class", kColumnClassification},
+        {"n", kColumnReturnNumber},   {"return", kColumnReturnNumber},
+        {"m", kColumnReturnCount},    {"returns", kColumnReturnCount},
+        {"t", kColumnTime},        {"time", kColumnTime},
+        {"skip", kColumnSkip},     {"_", kColumnSkip}};
+    for (const Name& n : names) {
+      if (name == n.name) {
+        field = n.field;
+        return true;
+      }
+    }
+    return false;
+  }
+} // namespace
+
+ColumnSchema::ColumnSchema() {
+  fields.push_back(kColumnX);
+  fields.push_back(kColumnY);
+  fields.push_back(kColumnZ);
+}
+
+bool ColumnSchema::parse(const std::string& spec, ColumnSchema& schema, std::string& error) {
+  std::vector<ColumnField> fields;
+  size_t                   start = 0;
+  while (start <= spec.size()) {
+    size_t      comma = spec.find(',', start);
+    std::string name  = spec.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+    name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    ColumnField field;
+    if (!fieldNamed(name, field)) {
+      error = "unknown column '" + name + "'";
+      return false;
+    }
+    if (field != kColumnSkip && std::find(fields.begin(), fields.end(), field) != fields.end()) {
+      error = "column '" + name + "' appears twice";
+      return false;
+    }
+    fields.push_back(field);
+    if (comma == std::string::npos) {
+      break;
+    }
+    start = comma + 1;
+  }
+
+  ColumnSchema parsed;
+  parsed.fields = fields;
+  if (!parsed.has(kColumnX) || !parsed.has(kColumnY) || !parsed.has(kColumnZ)) {
+    error = "x, y and z are required";
+    return false;
+  }
+  int channels = parsed.has(kColumnRed) + parsed.has(kColumnGreen) + parsed.has(kColumnBlue);
+  if (channels != 0 && channels != 3) {
+    error = "r, g and b go together";
+    return false;
+  }
+  while (parsed.fields.back() == kColumnSkip) {
+    parsed.fields.pop_back();
+  }
+  schema = parsed;
+  return true;
+}
+
+bool ColumnSchema::has(ColumnField field) const {
+  return std::find(fields.begin(), fields.end(), field) != fields.end();
+}
+
+std::string ColumnSchema::code() const {
+  std::string code;
+  for (ColumnField field : fields) {
+    code += columnCode(field);
+  }
+  return code;
+}
+
+bool ColumnSchema::isDefault() const {
+  return fields.size() == 3 && fields[0] == kColumnX && fields[1] == kColumnY && fields[2] == kColumnZ;
+}
+
+bool ColumnSchema::hasAttributes() const {
+  for (ColumnField field : fields) {
+    if (field > kColumnZ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int ColumnSchema::pointFormat(bool colorize) const {
+  bool rgb = colorize || hasColor();
+  if (hasTime()) {
+    return rgb ? 3 : 1;
+  }
+  return rgb ? 2 : 0;
+}
@@ -0,0 +1,327 @@
+#include "CompressedInput.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <zlib.h>
+#if defined(XYZ2LAS_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+#if defined(XYZ2LAS_HAVE_BZIP2)
+#include <bzlib.h>
+#endif
+
+namespace {
+  // zlib and bzip2 count input in 32-bit units; larger inputs are fed in slices
+  const size_t kSliceBytes = 1u << 30;
+
+  bool isGzipMember(const unsigned char* p, size_t left) {
+    return left >= 3 && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8;
+  }
+
+  // Total size of the BGZF block at `p` (from its "BC" extra subfield), or 0
+  // if it is not one.
+  size_t bgzfBlockSize(const unsigned char* p, size_t left) {
+    if (left < 18 || !isGzipMember(p, left) || !(p[3] & 4)) {
+      return 0;
+    }
+    size_t extraEnd = 12 + (p[10] | (p[11] << 8));
+    if (extraEnd > left) {
+      return 0;
+    }
+    for (size_t off = 12; off + 4 <= extraEnd;) {
+      size_t length = p[off + 2] | (p[off + 3] << 8);
+      if (p[off] == 'B' && p[off + 1] == 'C' && length == 2 && off + 6 <= extraEnd) {
+        size_t blockSize = (p[off + 4] | (p[off + 5] << 8)) + 1;
+        return blockSize <= left ? blockSize : 0;
+      }
+      off += 4 + length;
+    }
+    return 0;
+  }
+
+  std::runtime_error corrupt(Compression compression, const std::string& detail) {
+    return std::runtime_error(std::string("Corrupt ") + compressionName(compression) + " input: " + detail);
+  }
+} // namespace
+
+Compression detectCompression(const char* data, size_t size) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  if (isGzipMember(p, size)) {
+    return kCompressionGzip;
+  }
+  if (size >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+    return kCompressionZstd;
+  }
+  if (size >= 4 && p[0] == 'B' && p[1] == 'Z' && p[2] == 'h' && p[3] >= '1' && p[3] <= '9') {
+    return kCompressionBzip2;
+  }
+  return kCompressionNone;
+}
+
+const char* compressionName(Compression compression) {
+  switch (compression) {
+  case kCompressionGzip:
+    return "gzip";
+  case kCompressionZstd:
+    return "zstd";
+  case kCompressionBzip2:
+    return "bzip2";
+  default:
+    return "uncompressed";
+  }
+}
+
+bool compressionAvailable(Compression compression) {
+  switch (compression) {
+  case kCompressionZstd:
+#if defined(XYZ2LAS_HAVE_ZSTD)
+    return true;
+#else
+    return false;
+#endif
+  case kCompressionBzip2:
+#if defined(XYZ2LAS_HAVE_BZIP2)
+    return true;
+#else
+    return false;
+#endif
+  default:
+    return true;
+  }
+}
+
+std::vector<CompressedRange> independentMembers(const char* data, size_t size, Compression compression) {
+  std::vector<CompressedRange> members;
+  const char*                  end = data + size;
+  if (compression == kCompressionGzip) {
+    for (const char* p = data; p < end;) {
+      size_t blockSize = bgzfBlockSize(reinterpret_cast<const unsigned char*>(p), end - p);
+      if (blockSize == 0) {
+        members.clear(); // plain gzip: members can only be found by decoding
+        break;
+      }
+      CompressedRange member = {p, p + blockSize};
+      members.push_back(member);
+      p += blockSize;
+    }
+  }
+#if defined(XYZ2LAS_HAVE_ZSTD)
+  if (compression == kCompressionZstd) {
+    for (const char* p = data; p < end;) {
+      size_t frameSize = ZSTD_findFrameCompressedSize(p, end - p);
+      if (ZSTD_isError(frameSize)) {
+        throw corrupt(compression, ZSTD_getErrorName(frameSize));
+      }
+      CompressedRange member = {p, p + frameSize};
+      members.push_back(member);
+      p += frameSize;
+    }
+  }
+#endif
+  if (members.empty()) {
+    CompressedRange whole = {data, end};
+    members.push_back(whole);
+  }
+  return members;
+}
+
+struct Decompressor::Codec {
+  const char* data;
+  size_t      size;
+
+  Codec(const char* data, size_t size) : data(data), size(size) {}
+  virtual ~Codec() {}
+  virtual size_t read(char* out, size_t capacity) = 0;
+  virtual size_t consumed() const = 0;
+};
+
+namespace {
+  struct GzipCodec : Decompressor::Codec {
+    z_stream stream;
+    size_t   fed; // input bytes handed to zlib so far
+    bool     done;
+
+    GzipCodec(const char* data, size_t size) : Codec(data, size), fed(0), done(false) {
+      std::memset(&stream, 0, sizeof(stream));
+      if (inflateInit2(&stream, 15 + 16) != Z_OK) { // gzip wrapper only
+        throw std::runtime_error("Cannot initialize the gzip decoder");
+      }
+    }
+    ~GzipCodec() { inflateEnd(&stream); }
+
+    size_t consumed() const override { return fed - stream.avail_in; }
+
+    size_t read(char* out, size_t capacity) override {
+      size_t produced = 0;
+      while (!done && produced < capacity) {
+        if (stream.avail_in == 0) {
+          size_t slice    = std::min(kSliceBytes, size - fed);
+          stream.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(data + fed));
+          stream.avail_in = static_cast<uInt>(slice);
+          fed += slice;
+        }
+        size_t room      = std::min(kSliceBytes, capacity - produced);
+        stream.next_out  = reinterpret_cast<Bytef*>(out + produced);
+        stream.avail_out = static_cast<uInt>(room);
+        int ret          = inflate(&stream, Z_NO_FLUSH);
+        produced += room - stream.avail_out;
+        if (ret == Z_STREAM_END) {
+          // Another member may follow; anything else (e.g. padding) ends the input
+          size_t at = consumed();
+          if (isGzipMember(reinterpret_cast<const unsigned char*>(data + at), size - at)) {
+            inflateReset(&stream);
+          } else {
+            done = true;
+          }
+        } else if (ret == Z_BUF_ERROR && consumed() == size) {
+          throw corrupt(kCompressionGzip, "unexpected end of file");
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+          throw corrupt(kCompressionGzip, stream.msg ? stream.msg : "inflate failed");
+        }
+      }
+      return produced;
+    }
+  };
+
+#if defined(XYZ2LAS_HAVE_ZSTD)
+  struct ZstdCodec : Decompressor::Codec {
+    ZSTD_DStream*  stream;
+    ZSTD_inBuffer  in;
+    size_t         pending; // last ZSTD_decompressStream hint; 0 at a frame end
+
+    ZstdCodec(const char* data, size_t size) : Codec(data, size), stream(ZSTD_createDStream()), pending(0) {
+      if (!stream || ZSTD_isError(ZSTD_initDStream(stream))) {
+        throw std::runtime_error("Cannot initialize the zstd decoder");
+      }
+      in.src  = data;
+      in.size = size;
+      in.pos  = 0;
+    }
+    ~ZstdCodec() { ZSTD_freeDStream(stream); }
+
+    size_t consumed() const override { return in.pos; }
+
+    size_t read(char* out, size_t capacity) override {
+      ZSTD_outBuffer output = {out, capacity, 0};
+      while (output.pos < output.size) {
+        size_t inBefore  = in.pos;
+        size_t outBefore = output.pos;
+        size_t ret       = ZSTD_decompressStream(stream, &output, &in);
+        if (ZSTD_isError(ret)) {
+          throw corrupt(kCompressionZstd, ZSTD_getErrorName(ret));
+        }
+        if (in.pos == inBefore && output.pos == outBefore) {
+          break; // input exhausted and nothing buffered
+        }
+        pending = ret;
+      }
+      if (output.pos == 0 && pending != 0) {
+        throw corrupt(kCompressionZstd, "unexpected end of file");
+      }
+      return output.pos;
+    }
+  };
+#endif
+
+#if defined(XYZ2LAS_HAVE_BZIP2)
+  struct Bzip2Codec : Decompressor::Codec {
+    bz_stream stream;
+    size_t    fed;
+    bool      done;
+
+    Bzip2Codec(const char* data, size_t size) : Codec(data, size), fed(0), done(false) {
+      std::memset(&stream, 0, sizeof(stream));
+      if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+        throw std::runtime_error("Cannot initialize the bzip2 decoder");
+      }
+    }
+    ~Bzip2Codec() { BZ2_bzDecompressEnd(&stream); }
+
+    size_t consumed() const override { return fed - stream.avail_in; }
+
+    size_t read(char* out, size_t capacity) override {
+      size_t produced = 0;
+      while (!done && produced < capacity) {
+        if (stream.avail_in == 0) {
+          size_t slice    = std::min(kSliceBytes, size - fed);
+          stream.next_in  = const_cast<char*>(data + fed);
+          stream.avail_in = static_cast<unsigned int>(slice);
+          fed += slice;
+        }
+        size_t room      = std::min(kSliceBytes, capacity - produced);
+        stream.next_out  = out + produced;
+        stream.avail_out = static_cast<unsigned int>(room);
+        int ret          = BZ2_bzDecompress(&stream);
+        produced += room - stream.avail_out;
+        if (ret == BZ_STREAM_END) {
+          // Parallel bzip2 tools write concatenated streams
+          size_t at = consumed();
+          if (size - at >= 4 && detectCompression(data + at, size - at) == kCompressionBzip2) {
+            BZ2_bzDecompressEnd(&stream);
+            std::memset(&stream, 0, sizeof(stream));
+            BZ2_bzDecompressInit(&stream, 0, 0);
+            stream.next_in  = const_cast<char*>(data + at);
+            stream.avail_in = static_cast<unsigned int>(std::min(kSliceBytes, size - at));
+            fed             = at + stream.avail_in;
+          } else {
+            done = true;
+          }
+        } else if (ret != BZ_OK) {
+          throw corrupt(kCompressionBzip2, "decode error " + std::to_string(ret));
+        } else if (room == stream.avail_out && consumed() == size) {
+          throw corrupt(kCompressionBzip2, "unexpected end of file");
+        }
+      }
+      return produced;
+    }
+  };
+#endif
+} // namespace
+
+Decompressor::Decompressor(const char* data, size_t size, Compression compression) {
+  switch (compression) {
+  case kCompressionGzip:
+    codec.reset(new GzipCodec(data, size));
+    break;
+#if defined(XYZ2LAS_HAVE_ZSTD)
+  case kCompressionZstd:
+    codec.reset(new ZstdCodec(data, size));
+    break;
+#endif
+#if defined(XYZ2LAS_HAVE_BZIP2)
+  case kCompressionBzip2:
+    codec.reset(new Bzip2Codec(data, size));
+    break;
+#endif
+  default:
+    throw std::runtime_error(std::string("This build cannot read ") + compressionName(compression) + " input");
+  }
+}
+
+Decompressor::~Decompressor() {}
+
+size_t Decompressor::read(char* out, size_t capacity) {
+  return codec->read(out, capacity);
+}
+
+size_t Decompressor::consumed() const {
+  return codec->consumed();
+}
+
+void decompressAll(const char* data, size_t size, Compression compression, std::vector<char>& out) {
+  Decompressor in(data, size, compression);
+  out.resize(std::max<size_t>(size * 4, 64 * 1024));
+  size_t filled = 0;
+  for (;;) {
+    if (filled == out.size()) {
+      out.resize(out.size() * 2);
+    }
+    size_t n = in.read(&out[filled], out.size() - filled);
+    if (n == 0) {
+      break;
+    }
+    filled += n;
+  }
+  out.resize(filled);
+}
@@ -0,0 +1,287 @@
+#include "DedupeSink.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+namespace {
+  const size_t kInitialSlots  = 1 << 16;
+  const size_t kEmitRecords   = 65536;
+  const size_t kReadBytes     = 4 << 20;
+  const size_t kKeyBytes      = 3 * sizeof(int32_t);
+  // Hash bits selecting a partition when the set first spills; each split adds two
+  const int    kPartitionBits = 6;
+
+  void rawKey(const char* record, int32_t key[3]) {
+    std::memcpy(key, record, kKeyBytes);
+  }
+
+  uint64_t hashKey(const int32_t key[3]) {
+    uint64_t h = static_cast<uint32_t>(key[0]) * 0x9E3779B97F4A7C15ull;
+    h ^= static_cast<uint32_t>(key[1]) * 0xC2B2AE3D27D4EB4Full;
+    h ^= static_cast<uint32_t>(key[2]) * 0x165667B19E3779F9ull;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ (h >> 29);
+  }
+
+  uint64_t partitionOf(const int32_t key[3], int depth) {
+    return hashKey(key) >> (64 - kPartitionBits - 2 * depth);
+  }
+
+  // Calls `fn` on each `unit`-byte entry of the file at `path`, then deletes it.
+  template <class Fn>
+  void consumeFile(const std::string& path, size_t unit, Fn fn) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+      throw std::runtime_error("Cannot read dedupe partition: " + path);
+    }
+    std::vector<char> block(std::max<size_t>(1, kReadBytes / unit) * unit);
+    for (;;) {
+      in.read(&block[0], static_cast<std::streamsize>(block.size()));
+      size_t n = static_cast<size_t>(in.gcount()) / unit;
+      if (n == 0) {
+        break;
+      }
+      for (size_t i = 0; i < n; ++i) {
+        fn(&block[i * unit]);
+      }
+    }
+    in.close();
+    std::remove(path.c_str());
+  }
+} // namespace
+
+DedupeSink::DedupeSink(RecordSink& downstream, const liblas::Header& header, size_t memoryBytes,
+                       const std::string& tempPrefix)
+    : downstream(downstream), memoryBytes(memoryBytes), tempPrefix(tempPrefix), recordLength(0), entries(0),
+      pending(0), kept(0), duplicates(0), closed(false) {
+  scale[0]  = header.GetScaleX();
+  scale[1]  = header.GetScaleY();
+  scale[2]  = header.GetScaleZ();
+  offset[0] = header.GetOffsetX();
+  offset[1] = header.GetOffsetY();
+  offset[2] = header.GetOffsetZ();
+  for (int axis = 0; axis < 3; ++axis) {
+    minRaw[axis] = INT32_MAX;
+    maxRaw[axis] = INT32_MIN;
+  }
+  clearTable();
+}
+
+DedupeSink::~DedupeSink() {
+  if (seenKeys) {
+    seenKeys->remove();
+  }
+  if (partitions) {
+    partitions->remove();
+  }
+}
+
+void DedupeSink::keptBounds(double minXYZ[3], double maxXYZ[3]) const {
+  for (int axis = 0; axis < 3; ++axis) {
+    minXYZ[axis] = minRaw[axis] * scale[axis] + offset[axis];
+    maxXYZ[axis] = maxRaw[axis] * scale[axis] + offset[axis];
+  }
+}
+
+void DedupeSink::clearTable() {
+  Slot empty = {{0, 0, 0}, 0};
+  std::vector<Slot>(kInitialSlots, empty).swap(slots);
+  entries = 0;
+}
+
+void DedupeSink::grow() {
+  std::vector<Slot> old(slots.size() * 2);
+  old.swap(slots);
+  for (Slot& s : slots) {
+    s.tag = 0;
+  }
+  size_t mask = slots.size() - 1;
+  for (const Slot& s : old) {
+    if (s.tag == 0) {
+      continue;
+    }
+    size_t i = hashKey(s.key) & mask;
+    while (slots[i].tag != 0) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = s;
+  }
+}
+
+// Adds `key` to the set; false when it was already there.
+bool DedupeSink::insert(const int32_t key[3]) {
+  if ((entries + 1) * 2 > slots.size()) {
+    grow();
+  }
+  uint64_t h    = hashKey(key);
+  uint32_t tag  = static_cast<uint32_t>(h >> 32) | 1;
+  size_t   mask = slots.size() - 1;
+  for (size_t i = h & mask;; i = (i + 1) & mask) {
+    Slot& s = slots[i];
+    if (s.tag == 0) {
+      std::memcpy(s.key, key, kKeyBytes);
+      s.tag = tag;
+      entries++;
+      return true;
+    }
+    if (s.tag == tag && s.key[0] == key[0] && s.key[1] == key[1] && s.key[2] == key[2]) {
+      return false;
+    }
+  }
+}
+
+// Queues a kept record for downstream.
+void DedupeSink::pass(const char* record) {
+  int32_t key[3];
+  rawKey(record, key);
+  for (int axis = 0; axis < 3; ++axis) {
+    minRaw[axis] = std::min(minRaw[axis], key[axis]);
+    maxRaw[axis] = std::max(maxRaw[axis], key[axis]);
+  }
+  std::memcpy(&staging[pending * recordLength], record, recordLength);
+  kept++;
+  if (++pending == kEmitRecords) {
+    flush();
+  }
+}
+
+void DedupeSink::flush() {
+  if (pending > 0) {
+    downstream.write(&staging[0], pending, recordLength);
+    pending = 0;
+  }
+}
+
+void DedupeSink::write(const char* data, size_t count, size_t length) {
+  if (recordLength == 0) {
+    recordLength = length;
+    staging.resize(kEmitRecords * length);
+  } else if (length != recordLength) {
+    throw std::runtime_error("Record length changed while removing duplicates");
+  }
+
+  for (size_t i = 0; i < count; ++i, data += length) {
+    int32_t key[3];
+    rawKey(data, key);
+    if (partitions) {
+      partitions->append(partitionOf(key, 0), data, length);
+      continue;
+    }
+    if (!insert(key)) {
+      duplicates++;
+      continue;
+    }
+    pass(data);
+    if (tableBytes() > memoryBytes) {
+      spillTable();
+    }
+  }
+  flush();
+}
+
+std::string DedupeSink::partitionPath(const char* kind, int depth, uint64_t partition) const {
+  return tempPrefix + ".dedupe-" + kind + std::to_string(depth) + "-" + std::to_string(partition) + ".tmp";
+}
+
+// Moves the keys written so far into hash partitions; every later record goes
+// straight to its partition.
+void DedupeSink::spillTable() {
+  seenKeys.reset(new BucketSpool([this](uint64_t p) { return partitionPath("keys-", 0, p); }));
+  partitions.reset(new BucketSpool([this](uint64_t p) { return partitionPath("", 0, p); }));
+  for (const Slot& s : slots) {
+    if (s.tag != 0) {
+      seenKeys->append(partitionOf(s.key, 0), reinterpret_cast<const char*>(s.key), kKeyBytes);
+    }
+  }
+  clearTable();
+}
+
+// Writes the records of one partition whose keys are new, or splits it into
+// four on the next hash bits first when its keys would not fit.
+void DedupeSink::checkPartition(int depth, uint64_t partition, uint64_t keyBytes, uint64_t recordBytes) {
+  std::string keysPath    = partitionPath("keys-", depth, partition);
+  std::string recordsPath = partitionPath("", depth, partition);
+  uint64_t    keys        = keyBytes / kKeyBytes + recordBytes / recordLength;
+
+  if (keys * 2 * sizeof(Slot) > memoryBytes && kPartitionBits + 2 * (depth + 1) <= 64) {
+    int         finer = depth + 1;
+    BucketSpool keyQuarters([this, finer](uint64_t p) { return partitionPath("keys-", finer, p); });
+    BucketSpool quarters([this, finer](uint64_t p) { return partitionPath("", finer, p); });
+    try {
+      int32_t key[3];
+      if (keyBytes > 0) {
+        consumeFile(keysPath, kKeyBytes, [&](const char* e) {
+          rawKey(e, key);
+          keyQuarters.append(partitionOf(key, finer), e, kKeyBytes);
+        });
+      }
+      if (recordBytes > 0) {
+        consumeFile(recordsPath, recordLength, [&](const char* e) {
+          rawKey(e, key);
+          quarters.append(partitionOf(key, finer), e, recordLength);
+        });
+      }
+      checkPartitions(finer, keyQuarters, quarters);
+    } catch (...) {
+      keyQuarters.remove();
+      quarters.remove();
+      throw;
+    }
+    return;
+  }
+
+  int32_t key[3];
+  if (keyBytes > 0) {
+    consumeFile(keysPath, kKeyBytes, [&](const char* e) {
+      rawKey(e, key);
+      insert(key);
+    });
+  }
+  consumeFile(recordsPath, recordLength, [&](const char* e) {
+    rawKey(e, key);
+    if (insert(key)) {
+      pass(e);
+    } else {
+      duplicates++;
+    }
+  });
+  flush();
+  clearTable();
+}
+
+// Checks every partition of `recordSpool` holding records; `keySpool` holds
+// the keys already written, by the same partitioning.
+void DedupeSink::checkPartitions(int depth, BucketSpool& keySpool, BucketSpool& recordSpool) {
+  keySpool.finish();
+  recordSpool.finish();
+  std::vector<uint64_t> parts = recordSpool.keys();
+  std::sort(parts.begin(), parts.end());
+  std::vector<uint64_t> withKeys = keySpool.keys();
+  std::set<uint64_t>    keyed(withKeys.begin(), withKeys.end());
+  // Partitions without records have nothing left to write
+  for (uint64_t p : keyed) {
+    if (!std::binary_search(parts.begin(), parts.end(), p)) {
+      std::remove(keySpool.path(p).c_str());
+    }
+  }
+  for (uint64_t p : parts) {
+    checkPartition(depth, p, keyed.count(p) ? keySpool.bytes(p) : 0, recordSpool.bytes(p));
+  }
+}
+
+void DedupeSink::close() {
+  if (closed) {
+    return;
+  }
+  closed = true;
+
+  if (partitions) {
+    checkPartitions(0, *seenKeys, *partitions);
+  }
+  downstream.close();
+}
@@ -0,0 +1,73 @@
+#include "HeaderPatcher.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+namespace {
+  // Byte offsets into the public header block
+  const std::streamoff kVersionMinorOffset = 25;
+  const std::streamoff kPointFormatOffset  = 104;
+  const std::streamoff kPointCountOffset   = 107;
+  const std::streamoff kBoundsOffset       = 179;
+  // LAS 1.4 only
+  const std::streamoff kExtendedCountOffset = 247;
+
+  void writeLE(std::fstream& fs, uint64_t v, int bytes) {
+    char buf[8];
+    for (int i = 0; i < bytes; ++i) {
+      buf[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+    }
+    fs.write(buf, bytes);
+  }
+
+  void writeDouble(std::fstream& fs, double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    writeLE(fs, bits, 8);
+  }
+} // namespace
+
+bool patchLasHeader(const std::string& filename, const PointCollector& pc) {
+  double minXYZ[3] = {pc.minX, pc.minY, pc.minZ};
+  double maxXYZ[3] = {pc.maxX, pc.maxY, pc.maxZ};
+  return patchLasHeader(filename, pc.count, minXYZ, maxXYZ);
+}
+
+bool patchLasHeader(const std::string& filename, uint64_t count, const double minXYZ[3], const double maxXYZ[3]) {
+  std::fstream fs(filename, std::ios::in | std::ios::out | std::ios::binary);
+  if (!fs.is_open()) {
+    return false;
+  }
+  char minor = 0, format = 0;
+  fs.seekg(kVersionMinorOffset, std::ios::beg);
+  fs.get(minor);
+  fs.seekg(kPointFormatOffset, std::ios::beg);
+  fs.get(format);
+  if (!fs.good()) {
+    return false;
+  }
+  bool extended = minor >= 4;
+
+  // LAS 1.4 counts are 64-bit; the legacy 32-bit field is also filled where
+  // readers of older versions can still use it (formats 0-5, under 2^32
+  // points) and must be zero otherwise
+  if (count > UINT32_MAX && !extended) {
+    return false;
+  }
+  bool legacy = count <= UINT32_MAX && (static_cast<unsigned char>(format) & 0x3F) < 6;
+  fs.seekp(kPointCountOffset, std::ios::beg);
+  writeLE(fs, legacy ? count : 0, 4);
+  if (extended) {
+    fs.seekp(kExtendedCountOffset, std::ios::beg);
+    writeLE(fs, count, 8);
+  }
+
+  // Max X, Min X, Max Y, Min Y, Max Z, Min Z
+  fs.seekp(kBoundsOffset, std::ios::beg);
+  for (int axis = 0; axis < 3; ++axis) {
+    writeDouble(fs, maxXYZ[axis]);
+    writeDouble(fs, minXYZ[axis]);
+  }
+
+  return fs.good();
+}
@@ -1,12 +1,38 @@
 #include "InputProcessor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include <cstring>
 #include <cmath>
 #include "fast_float/fast_float.h"
 #include <mio/mmap.hpp>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#elif defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
 #include "gdal_priv.h"
 #include "cpl_error.h"
+#include "CompressedInput.hpp"
+#include "ParallelChunks.hpp"
+#include "RasterReader.hpp"
+#include "SpscQueue.hpp"
+#include "VectorReader.hpp"
+#include "StructuralScanner.hpp"
+#include "UringReader.hpp"
 
 bool processGDAL(const std::string& filename, PointCollector& pc, std::string& srsWKT) {
   // Suppress GDAL errors while probing to avoid noise for unsupported text formats
@@ -33,63 +59,10 @@ bool processGDAL(const std::string& filename, PointCollector& pc, std::string& s
   }
 
   if (poDS->GetRasterCount() > 0) {
-    GDALRasterBand* poBand = poDS->GetRasterBand(1);
-    int             nXSize = poBand->GetXSize();
-    int             nYSize = poBand->GetYSize();
-    double          adfGT[6];
-    bool            hasGeo     = poDS->GetGeoTransform(adfGT) == CE_None;
-    int             bHasNoData = 0;
-    double          noData     = poBand->GetNoDataValue(&bHasNoData);
-    
-    int             bHasScale = 0, bHasOffset = 0;
-    double          bandScale  = poBand->GetScale(&bHasScale);
-    double          bandOffset = poBand->GetOffset(&bHasOffset);
-    if (!bHasScale) bandScale = 1.0;
-    if (!bHasOffset) bandOffset = 0.0;
-
-    std::vector<float> row(nXSize);
-    for (int y = 0; y < nYSize; ++y) {
-      if (!pc.quiet && pc.totalPoints == 0 && y % 100 == 0) {
-        int percent = static_cast<int>((y * 100.0) / nYSize);
-        std::cout << "\rScanning file: " << percent << "%   " << std::flush;
-      }
-      if (poBand->RasterIO(GF_Read, 0, y, nXSize, 1, &row[0], nXSize, 1, GDT_Float32, 0, 0) != CE_None) {
-        continue;
-      }
-      for (int x = 0; x < nXSize; ++x) {
-        double z = row[x];
-        if (std::isnan(z)) {
-          continue;
-        }
-        if (bHasNoData && (z == noData || (std::isnan(noData) && std::isnan(z)))) {
-          continue;
-        }
-        z = z * bandScale + bandOffset;
-        double wx = static_cast<double>(x), wy = static_cast<double>(y);
-        if (hasGeo) {
-          wx = adfGT[0] + (x + 0.5) * adfGT[1] + (y + 0.5) * adfGT[2];
-          wy = adfGT[3] + (x + 0.5) * adfGT[4] + (y + 0.5) * adfGT[5];
-        }
-        pc.addPoint(wx, wy, z);
-      }
-    }
-    if (!pc.quiet && pc.totalPoints == 0) std::cout << "\rScanning file: 100%   " << std::flush;
+    processRaster(filename, poDS, pc);
   } else {
     for (int i = 0; i < poDS->GetLayerCount(); ++i) {
-      OGRLayer* poLayer = poDS->GetLayer(i);
-      poLayer->ResetReading();
-      GIntBig totalFeatures = poLayer->GetFeatureCount();
-      GIntBig currentFeature = 0;
-      OGRFeature* poFeature;
-      while ((poFeature = poLayer->GetNextFeature()) != nullptr) {
-        currentFeature++;
-        if (!pc.quiet && pc.totalPoints == 0 && currentFeature % 10000 == 0 && totalFeatures > 0) {
-          int percent = static_cast<int>((currentFeature * 100.0) / totalFeatures);
-          std::cout << "\rScanning file: " << percent << "%   " << std::flush;
-        }
-        pc.processGeometry(poFeature->GetGeometryRef());
-        OGRFeature::DestroyFeature(poFeature);
-      }
+      processLayer(poDS->GetLayer(i), pc);
       if (!pc.quiet && pc.totalPoints == 0) std::cout << "\rScanning file: 100%   " << std::flush;
     }
   }
@@ -98,58 +71,865 @@ bool processGDAL(const std::string& filename, PointCollector& pc, std::string& s
   return true;
 }
 
-bool processXYZ(const std::string& filename, PointCollector& pc) {
-  std::error_code error;
-  mio::mmap_source mmap;
-  mmap.map(filename, error);
-  if (error) {
-    return false;
-  }
+namespace {
+  // Target size of the newline-aligned byte ranges handed to parser threads
+  const size_t kChunkBytes    = 16 * 1024 * 1024;
+  const size_t kMinChunkBytes = 1024 * 1024;
 
-  const char* ptr = mmap.data();
-  const char* end = ptr + mmap.size();
-  long last_count = pc.count;
+  struct ByteRange {
+    const char* begin;
+    const char* end;
+  };
 
-  while (ptr < end) {
-    const char* next_newline = (const char*)std::memchr(ptr, '\n', end - ptr);
-    const char* endOfLine = next_newline ? next_newline : end;
+  inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
 
-    const char* linePtr = ptr;
+  // Parses one "X Y Z" line in [linePtr, endOfLine) into `sink`.
+  template <class Sink>
+  inline void parseXYZLine(const char* linePtr, const char* endOfLine, Sink& sink) {
     // Skip whitespace
-    while (linePtr < endOfLine && (*linePtr == ' ' || *linePtr == '\t' || *linePtr == '\r')) {
+    while (linePtr < endOfLine && isBlank(*linePtr)) {
       linePtr++;
     }
 
     if (linePtr < endOfLine && *linePtr != '#' && *linePtr != '/') {
       double x, y, z;
-      auto answer = fast_float::from_chars(linePtr, endOfLine, x);
+      auto   answer = fast_float::from_chars(linePtr, endOfLine, x);
       if (answer.ec == std::errc()) {
         linePtr = answer.ptr;
-        while (linePtr < endOfLine && (*linePtr == ' ' || *linePtr == '\t' || *linePtr == '\r')) linePtr++;
-        
+        while (linePtr < endOfLine && isBlank(*linePtr)) linePtr++;
+
         answer = fast_float::from_chars(linePtr, endOfLine, y);
         if (answer.ec == std::errc()) {
           linePtr = answer.ptr;
-          while (linePtr < endOfLine && (*linePtr == ' ' || *linePtr == '\t' || *linePtr == '\r')) linePtr++;
-          
+          while (linePtr < endOfLine && isBlank(*linePtr)) linePtr++;
+
           answer = fast_float::from_chars(linePtr, endOfLine, z);
           if (answer.ec == std::errc()) {
-            pc.addPoint(x, y, z);
+            sink.addPoint(x, y, z);
+          }
+        }
+      }
+    }
+  }
+
+  // Parses every "X Y Z" line of [ptr, end) into `sink`, which is either a
+  // PointCollector or a PointBatch.
+  template <class Sink>
+  void parseXYZRangeScalar(const char* ptr, const char* end, Sink& sink) {
+    while (ptr < end) {
+      const char* next_newline = (const char*)std::memchr(ptr, '\n', end - ptr);
+      const char* endOfLine    = next_newline ? next_newline : end;
+      parseXYZLine(ptr, endOfLine, sink);
+      ptr = endOfLine + 1;
+    }
+  }
+
+  // Bytes tokenized per structural scan; bounds the size of the index buffer
+  const size_t kScanWindowBytes = 64 * 1024;
+
+  inline bool isSeparator(const char* p, const char* end) {
+    return p == end || *p == '\n' || isBlank(*p);
+  }
+
+  // Same grammar as parseXYZRangeScalar, driven by the structural index so the
+  // parser jumps directly between field starts. Lines where a number is not
+  // followed by a separator (e.g. "1.0,2.0") take the scalar line parser.
+  template <class Sink>
+  void parseXYZRangeIndexed(const char* ptr, const char* end, Sink& sink, ScannerLevel level) {
+    std::vector<uint32_t> indices;
+    indices.reserve(kScanWindowBytes / 4);
+
+    while (ptr < end) {
+      // End the window just past its last newline so no line is split
+      const char* wend = end;
+      if (static_cast<size_t>(end - ptr) > kScanWindowBytes) {
+        wend = ptr + kScanWindowBytes;
+        while (wend > ptr && wend[-1] != '\n') {
+          wend--;
+        }
+        if (wend == ptr) {
+          const char* nl = (const char*)std::memchr(ptr + kScanWindowBytes, '\n', end - ptr - kScanWindowBytes);
+          wend           = nl ? nl + 1 : end;
+        }
+      }
+
+      indices.clear();
+      scanStructure(ptr, wend, indices, level);
+
+      size_t       k = 0;
+      const size_t n = indices.size();
+      while (k < n) {
+        const char* field = ptr + indices[k];
+        if (*field == '\n') {
+          k++;
+          continue;
+        }
+
+        const char* lineStart = field;
+        bool        valid     = *field != '#' && *field != '/';
+        bool        fallback  = false;
+        double      xyz[3];
+        for (int f = 0; valid && f < 3; ++f) {
+          if (k >= n || ptr[indices[k]] == '\n') {
+            valid = false; // fewer than three fields
+            break;
+          }
+          field       = ptr + indices[k];
+          auto answer = fast_float::from_chars(field, wend, xyz[f]);
+          if (answer.ec != std::errc()) {
+            valid = false;
+          } else if (f < 2 && !isSeparator(answer.ptr, wend)) {
+            fallback = true;
+            valid    = false;
+          }
+          k++;
+        }
+
+        // Advance to the newline ending this line
+        while (k < n && ptr[indices[k]] != '\n') {
+          k++;
+        }
+        const char* endOfLine = (k < n) ? ptr + indices[k] : wend;
+
+        if (valid) {
+          sink.addPoint(xyz[0], xyz[1], xyz[2]);
+        } else if (fallback) {
+          parseXYZLine(lineStart, endOfLine, sink);
+        }
+        k++;
+      }
+
+      ptr = wend;
+    }
+  }
+
+  template <class Sink>
+  void parseXYZRange(const char* ptr, const char* end, Sink& sink) {
+    static const ScannerLevel level = detectScannerLevel();
+    if (level == kScannerScalar) {
+      parseXYZRangeScalar(ptr, end, sink);
+    } else {
+      parseXYZRangeIndexed(ptr, end, sink, level);
+    }
+  }
+
+  // Integer field of a --columns line. Digits are accumulated directly;
+  // values written with a fraction or exponent (or too many digits) take
+  // fast_float and are rounded. Returns the end of the number, or nullptr if
+  // the field does not start with one.
+  inline const char* parseInteger(const char* p, const char* end, long long& value) {
+    const char* start    = p;
+    bool        negative = p < end && *p == '-';
+    p += negative ? 1 : 0;
+    const char* digits = p;
+    long long   v      = 0;
+    while (p < end && static_cast<unsigned>(*p - '0') < 10 && p - digits < 18) {
+      v = v * 10 + (*p - '0');
+      p++;
+    }
+    if (p == digits || (p < end && (*p == '.' || *p == 'e' || *p == 'E' || static_cast<unsigned>(*p - '0') < 10))) {
+      double d;
+      auto   answer = fast_float::from_chars(start, end, d);
+      if (answer.ec != std::errc()) {
+        return nullptr;
+      }
+      d     = std::min(std::max(d, -1e18), 1e18);
+      value = static_cast<long long>(d >= 0.0 ? std::floor(d + 0.5) : std::ceil(d - 0.5));
+      return answer.ptr;
+    }
+    value = negative ? -v : v;
+    return p;
+  }
+
+  template <class T>
+  inline T clampField(long long v, long long hi) {
+    return static_cast<T>(v < 0 ? 0 : (v > hi ? hi : v));
+  }
+
+  // One field of a --columns line into `xyz` or `a`. Coordinates and time are
+  // parsed as doubles, the other fields through parseInteger, and skipped
+  // fields are stepped over. Returns the end of the field, or nullptr if it
+  // does not parse. kField is a ColumnField fixed at compile time, so only
+  // the branch for that field remains.
+  template <int kField>
+  inline const char* parseColumnField(const char* p, const char* end, double xyz[3], PointAttributes& a) {
+    if (kField == kColumnSkip) {
+      while (p < end && !isBlank(*p)) {
+        p++;
+      }
+      return p;
+    }
+    if (kField <= kColumnZ || kField == kColumnTime) {
+      double v;
+      auto   answer = fast_float::from_chars(p, end, v);
+      if (answer.ec != std::errc()) {
+        return nullptr;
+      }
+      if (kField == kColumnTime) {
+        a.time = v;
+      } else {
+        xyz[kField - kColumnX] = v;
+      }
+      return answer.ptr;
+    }
+
+    long long v;
+    p = parseInteger(p, end, v);
+    if (!p) {
+      return nullptr;
+    }
+    if (kField == kColumnIntensity) {
+      a.intensity = clampField<uint16_t>(v, 65535);
+    } else if (kField >= kColumnRed && kField <= kColumnBlue) {
+      a.rgb[kField - kColumnRed] = clampField<uint16_t>(v, 65535);
+    } else if (kField == kColumnClassification) {
+      a.classification = clampField<uint8_t>(v, 31);
+    } else if (kField == kColumnReturnNumber) {
+      a.returnNumber = clampField<uint8_t>(v, 7);
+    } else if (kField == kColumnReturnCount) {
+      a.numberOfReturns = clampField<uint8_t>(v, 7);
+    }
+    return p;
+  }
+
+  // Blanks between two fields; nullptr if there are none or the line ends.
+  inline const char* skipSeparator(const char* p, const char* end) {
+    if (p == end || !isBlank(*p)) {
+      return nullptr;
+    }
+    while (p < end && isBlank(*p)) {
+      p++;
+    }
+    return p == end ? nullptr : p;
+  }
+
+  // A field list fixed at compile time. parse() is unrolled into one
+  // parseColumnField per field, with no per-field dispatch left at run time;
+  // code() is the ColumnSchema::code() of the list.
+  template <int... kFields>
+  struct ColumnLayout;
+
+  template <>
+  struct ColumnLayout<> {
+    static std::string    code() { return std::string(); }
+    static constexpr bool has(int) { return false; }
+  };
+
+  template <int kField, int... kRest>
+  struct ColumnLayout<kField, kRest...> {
+    static std::string    code() { return columnCode(kField) + ColumnLayout<kRest...>::code(); }
+    static constexpr bool has(int field) { return field == kField || ColumnLayout<kRest...>::has(field); }
+    static constexpr bool infersReturnCount() {
+      return has(kColumnReturnNumber) && !has(kColumnReturnCount);
+    }
+
+    static const char* parse(const char* p, const char* end, double xyz[3], PointAttributes& a) {
+      p = parseColumnField<kField>(p, end, xyz, a);
+      return p ? parseRest(p, end, xyz, a, std::integral_constant<bool, sizeof...(kRest) == 0>()) : nullptr;
+    }
+
+  private:
+    static const char* parseRest(const char* p, const char*, double*, PointAttributes&, std::true_type) {
+      return p;
+    }
+    static const char* parseRest(const char* p, const char* end, double xyz[3], PointAttributes& a, std::false_type) {
+      p = skipSeparator(p, end);
+      return p ? ColumnLayout<kRest...>::parse(p, end, xyz, a) : nullptr;
+    }
+  };
+
+  // Any other field list, walked field by field at run time.
+  struct RuntimeColumnLayout {
+    const std::vector<ColumnField>& fields;
+    bool                            inferred; // ColumnSchema::infersReturnCount()
+
+    bool infersReturnCount() const { return inferred; }
+
+    const char* parse(const char* p, const char* end, double xyz[3], PointAttributes& a) const {
+      for (size_t f = 0; p && f < fields.size(); ++f) {
+        if (f > 0 && !(p = skipSeparator(p, end))) {
+          break;
+        }
+        switch (fields[f]) {
+        case kColumnSkip:           p = parseColumnField<kColumnSkip>(p, end, xyz, a); break;
+        case kColumnX:              p = parseColumnField<kColumnX>(p, end, xyz, a); break;
+        case kColumnY:              p = parseColumnField<kColumnY>(p, end, xyz, a); break;
+        case kColumnZ:              p = parseColumnField<kColumnZ>(p, end, xyz, a); break;
+        case kColumnIntensity:      p = parseColumnField<kColumnIntensity>(p, end, xyz, a); break;
+        case kColumnRed:            p = parseColumnField<kColumnRed>(p, end, xyz, a); break;
+        case kColumnGreen:          p = parseColumnField<kColumnGreen>(p, end, xyz, a); break;
+        case kColumnBlue:           p = parseColumnField<kColumnBlue>(p, end, xyz, a); break;
+        case kColumnClassification: p = parseColumnField<kColumnClassification>(p, end, xyz, a); break;
+        case kColumnReturnNumber:   p = parseColumnField<kColumnReturnNumber>(p, end, xyz, a); break;
+        case kColumnReturnCount:    p = parseColumnField<kColumnReturnCount>(p, end, xyz, a); break;
+        case kColumnTime:           p = parseColumnField<kColumnTime>(p, end, xyz, a); break;
+        }
+      }
+      return p;
+    }
+  };
+
+  // Parses one line laid out by `layout` into `sink`. Fields past the last
+  // named one are never looked at. Lines with too few fields or a field that
+  // does not parse are dropped. kAttributes is false for layouts that only
+  // move X, Y and Z. Layouts with a return number but no number of returns
+  // fill the latter in here, so the encoders only copy what they are given.
+  template <bool kAttributes, class Layout, class Sink>
+  inline void parseColumnsLine(const char* p, const char* end, const Layout& layout, Sink& sink) {
+    while (p < end && isBlank(*p)) {
+      p++;
+    }
+    if (p == end || *p == '#' || *p == '/') {
+      return;
+    }
+
+    double          xyz[3] = {0.0, 0.0, 0.0};
+    PointAttributes a;
+    if (!layout.parse(p, end, xyz, a)) {
+      return;
+    }
+    if (layout.infersReturnCount()) {
+      a.numberOfReturns = a.returnNumber;
+    }
+    if (kAttributes) {
+      sink.addPoint(xyz[0], xyz[1], xyz[2], a);
+    } else {
+      sink.addPoint(xyz[0], xyz[1], xyz[2]);
+    }
+  }
+
+  template <bool kAttributes, class Layout, class Sink>
+  void parseColumnsLines(const char* ptr, const char* end, const Layout& layout, Sink& sink) {
+    while (ptr < end) {
+      const char* next_newline = (const char*)std::memchr(ptr, '\n', end - ptr);
+      const char* endOfLine    = next_newline ? next_newline : end;
+      parseColumnsLine<kAttributes>(ptr, endOfLine, layout, sink);
+      ptr = endOfLine + 1;
+    }
+  }
+
+  template <class Layout, class Sink>
+  void parseCompiledColumns(const char* ptr, const char* end, Sink& sink) {
+    parseColumnsLines<true>(ptr, end, Layout(), sink);
+  }
+
+  // A compiled line parser, keyed by the code of its field list.
+  template <class Sink>
+  struct CompiledColumns {
+    std::string code;
+    void (*parse)(const char* ptr, const char* end, Sink& sink);
+  };
+
+  template <class Layout, class Sink>
+  CompiledColumns<Sink> compiledColumns() {
+    CompiledColumns<Sink> compiled = {Layout::code(), &parseCompiledColumns<Layout, Sink>};
+    return compiled;
+  }
+
+  // Common field lists get a compiled line parser, looked up by the schema's
+  // code once per range; other layouts take the run-time field loop.
+  template <class Sink>
+  void parseColumnsRange(const char* ptr, const char* end, const ColumnSchema& schema, Sink& sink) {
+    const int S = kColumnSkip, X = kColumnX, Y = kColumnY, Z = kColumnZ, I = kColumnIntensity, R = kColumnRed,
+              G = kColumnGreen, B = kColumnBlue, C = kColumnClassification, N = kColumnReturnNumber,
+              M = kColumnReturnCount, T = kColumnTime;
+    static const CompiledColumns<Sink> compiled[] = {
+        compiledColumns<ColumnLayout<X, Y, Z, I>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, C>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, I, C>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, I, C, N>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, I, C, N, M>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, R, G, B>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, I, R, G, B>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, R, G, B, I>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, I, R, G, B, C>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, I, R, G, B, S, C>, Sink>(),
+        compiledColumns<ColumnLayout<X, Y, Z, T>, Sink>(),
+        compiledColumns<ColumnLayout<T, X, Y, Z, I>, Sink>()};
+
+    const std::string code = schema.code();
+    for (const CompiledColumns<Sink>& c : compiled) {
+      if (c.code == code) {
+        c.parse(ptr, end, sink);
+        return;
+      }
+    }
+    RuntimeColumnLayout layout = {schema.fields, schema.infersReturnCount()};
+    if (schema.hasAttributes()) {
+      parseColumnsLines<true>(ptr, end, layout, sink);
+    } else {
+      parseColumnsLines<false>(ptr, end, layout, sink);
+    }
+  }
+
+  // Plain "X Y Z" input takes the structural scanner, anything else the
+  // --columns parser.
+  template <class Sink>
+  void parseRange(const char* ptr, const char* end, const ColumnSchema* columns, Sink& sink) {
+    if (columns && !columns->isDefault()) {
+      parseColumnsRange(ptr, end, *columns, sink);
+    } else {
+      parseXYZRange(ptr, end, sink);
+    }
+  }
+
+  // How far the read stage may run ahead of the parsers
+  const size_t kReadAheadBytes = 256 * 1024 * 1024;
+
+  // Read stage: faults the mapping in ahead of the parser threads so page-cache
+  // misses overlap with parsing instead of stalling it.
+  struct ReadAhead {
+    std::atomic<bool> stop;
+    std::thread       thread;
+
+    ReadAhead(const std::vector<ByteRange>& chunks, const char* data, const std::atomic<size_t>& doneBytes) : stop(false) {
+      thread = std::thread([this, &chunks, data, &doneBytes] {
+        for (size_t i = 0; i < chunks.size() && !stop; ++i) {
+          while (!stop && static_cast<size_t>(chunks[i].begin - data) > doneBytes.load() + kReadAheadBytes) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+          touch(chunks[i]);
+        }
+      });
+    }
+
+    ~ReadAhead() {
+      stop = true;
+      thread.join();
+    }
+
+    void touch(const ByteRange& r) {
+#if defined(__unix__) || defined(__APPLE__)
+      const uintptr_t page  = 4096;
+      uintptr_t       start = reinterpret_cast<uintptr_t>(r.begin) & ~(page - 1);
+      madvise(reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(r.end) - start, MADV_WILLNEED);
+#endif
+      volatile char sink = 0;
+      for (const char* p = r.begin; p < r.end && !stop; p += 4096) {
+        sink = *p;
+      }
+      (void)sink;
+    }
+  };
+
+  // Streamed input (compressed files, pipes): text travels in blocks cut just
+  // past their last newline, a bounded number at a time, so memory stays flat
+  const size_t kTextBlockBytes    = 4 * 1024 * 1024;
+  const size_t kTextBlocksInFlight = 8;
+  // Compressed bytes per task when BGZF blocks or zstd frames decode in parallel
+  const size_t kMemberTaskBytes   = 4 * 1024 * 1024;
+  // Uring engine: read size per block (one parse task each) and blocks in
+  // flight, deep enough to keep an NVMe queue busy
+  const size_t kUringBlockBytes   = 1024 * 1024;
+  const size_t kUringDepth        = 64;
+
+  struct TextBlock {
+    std::vector<char> text;
+    size_t            inputBytes; // source bytes consumed once this block was cut
+  };
+
+  // Where streamed text comes from.
+  struct TextSource {
+    virtual ~TextSource() {}
+    // Fills up to `capacity` bytes of `out`; returns how many, 0 at the end.
+    virtual size_t read(char* out, size_t capacity) = 0;
+    // Source bytes consumed so far, for progress.
+    virtual size_t consumed() const = 0;
+  };
+
+  struct DecompressedSource : TextSource {
+    Decompressor in;
+
+    DecompressedSource(const char* data, size_t size, Compression compression) : in(data, size, compression) {}
+    size_t read(char* out, size_t capacity) override { return in.read(out, capacity); }
+    size_t consumed() const override { return in.consumed(); }
+  };
+
+  // Standard input, pipes and FIFOs, read unbuffered in whole blocks.
+  struct StreamSource : TextSource {
+    std::FILE* file;
+    size_t     total;
+
+    explicit StreamSource(std::FILE* file) : file(file), total(0) {
+#if defined(_WIN32)
+      _setmode(_fileno(file), _O_BINARY);
+#endif
+      std::setvbuf(file, nullptr, _IONBF, 0);
+    }
+    size_t read(char* out, size_t capacity) override {
+      size_t n = std::fread(out, 1, capacity, file);
+      if (n == 0 && std::ferror(file)) {
+        throw std::runtime_error("Read error on input stream");
+      }
+      total += n;
+      return n;
+    }
+    size_t consumed() const override { return total; }
+  };
+
+  // A reader thread fills text blocks from `source`, carrying each partial
+  // last line over to the next block, while the calling thread parses the
+  // previous ones.
+  void streamText(TextSource& source, PointCollector& pc, const std::function<void(size_t)>& reportProgress) {
+    SpscQueue<TextBlock> full(kTextBlocksInFlight);
+    SpscQueue<TextBlock> empty(kTextBlocksInFlight);
+    std::atomic<bool>    cancel(false);
+    std::exception_ptr   decodeError;
+
+    std::thread decoder([&] {
+      try {
+        TextSource&       in = source;
+        std::vector<char> carry; // partial line at the end of the previous block
+        bool              done = false;
+        while (!done) {
+          TextBlock block;
+          empty.tryPop(block);
+          block.text.resize(carry.size() + kTextBlockBytes);
+          std::copy(carry.begin(), carry.end(), block.text.begin());
+          size_t filled = carry.size();
+          while (filled < block.text.size()) {
+            size_t n = in.read(&block.text[filled], block.text.size() - filled);
+            if (n == 0) {
+              done = true;
+              break;
+            }
+            filled += n;
+          }
+
+          size_t cut = filled;
+          if (!done) {
+            while (cut > 0 && block.text[cut - 1] != '\n') {
+              cut--;
+            }
+          }
+          carry.assign(block.text.begin() + cut, block.text.begin() + filled);
+          block.text.resize(cut);
+          block.inputBytes = in.consumed();
+          // A block without a newline grows into the next one
+          if (!block.text.empty() && !full.push(block, cancel)) {
+            break;
           }
         }
+      } catch (...) {
+        decodeError = std::current_exception();
+      }
+      full.close();
+    });
+
+    try {
+      PointBatch batch;
+      TextBlock  block;
+      while (full.pop(block)) {
+        batch.clear();
+        parseRange(&block.text[0], &block.text[0] + block.text.size(), pc.columns, batch);
+        pc.addBatch(batch);
+        reportProgress(block.inputBytes);
+        empty.tryPush(block);
+      }
+    } catch (...) {
+      cancel = true;
+      decoder.join();
+      throw;
+    }
+    decoder.join();
+    if (decodeError) {
+      std::rethrow_exception(decodeError);
+    }
+  }
+
+  // Lines cut by the edges of a task's text, stitched together in task order.
+  struct TaskEdges {
+    std::string head; // up to and including the first newline (all of it without one)
+    std::string tail; // after the last newline
+    bool        hasNewline;
+  };
+
+  // Text split into tasks at arbitrary points: each task parses the whole
+  // lines inside its text on a worker and keeps the cut ones, which are
+  // reassembled as the batches are consumed in task order.
+  struct EdgeStitcher {
+    std::vector<TaskEdges> edges;
+    std::string            carry;
+    PointBatch             stitched;
+
+    explicit EdgeStitcher(size_t tasks) : edges(tasks) {}
+
+    void parseInterior(size_t task, const char* begin, const char* end, const ColumnSchema* columns,
+                       PointBatch& batch) {
+      const char* first = begin ? (const char*)std::memchr(begin, '\n', end - begin) : nullptr;
+      TaskEdges&  e     = edges[task];
+      e.hasNewline      = first != nullptr;
+      if (!first) {
+        e.head.assign(begin, end);
+        return;
+      }
+      const char* last = end;
+      while (last[-1] != '\n') {
+        last--;
+      }
+      e.head.assign(begin, first + 1);
+      e.tail.assign(last, end);
+      parseRange(first + 1, last, columns, batch);
+    }
+
+    // Adds the line completed by `task`'s head, then the task's own points.
+    void consume(size_t task, const PointBatch& batch, PointCollector& pc) {
+      TaskEdges& e = edges[task];
+      carry += e.head;
+      if (e.hasNewline) {
+        stitched.clear();
+        parseRange(carry.data(), carry.data() + carry.size(), pc.columns, stitched);
+        pc.addBatch(stitched);
+        carry.swap(e.tail);
+      }
+      e = TaskEdges();
+      pc.addBatch(batch);
+    }
+
+    // Adds the unterminated last line, if any.
+    void finish(PointCollector& pc) {
+      stitched.clear();
+      parseRange(carry.data(), carry.data() + carry.size(), pc.columns, stitched);
+      pc.addBatch(stitched);
+    }
+  };
+
+  // BGZF and multi-frame zstd: groups of members decode and parse on all
+  // threads; the lines spanning two groups are reassembled as the batches are
+  // consumed in order.
+  void decodeMembersInParallel(const char* data, const std::vector<CompressedRange>& members,
+                               Compression compression, int threads, PointCollector& pc,
+                               const std::function<void(size_t)>& reportProgress) {
+    std::vector<CompressedRange> tasks;
+    for (const CompressedRange& member : members) {
+      if (tasks.empty() || static_cast<size_t>(tasks.back().end - tasks.back().begin) >= kMemberTaskBytes) {
+        tasks.push_back(member);
+      } else {
+        tasks.back().end = member.end;
       }
     }
 
-    if (!pc.quiet && pc.totalPoints == 0 && pc.count - last_count >= 100000) {
-      int percent = static_cast<int>((ptr - mmap.data()) * 100.0 / mmap.size());
+    EdgeStitcher stitcher(tasks.size());
+    parallelBatches(
+        tasks.size(), threads, true,
+        [&](size_t i, PointBatch& batch) {
+          std::vector<char> text;
+          decompressAll(tasks[i].begin, tasks[i].end - tasks[i].begin, compression, text);
+          const char* begin = text.empty() ? nullptr : &text[0];
+          stitcher.parseInterior(i, begin, begin + text.size(), pc.columns, batch);
+        },
+        [&](size_t i, PointBatch& batch) {
+          stitcher.consume(i, batch, pc);
+          reportProgress(tasks[i].end - data);
+        });
+    stitcher.finish(pc);
+  }
+
+  // Uncompressed files on the uring engine: blocks arrive from deep-queued
+  // reads and parse on all threads, with lines across block edges stitched
+  // back together in order. A block's buffer is recycled as soon as it is
+  // parsed, so the read-ahead is bounded by the ring.
+  void readBlocksInParallel(UringReader& reader, int threads, PointCollector& pc,
+                            const std::function<void(size_t)>& reportProgress) {
+    EdgeStitcher stitcher(reader.blockCount());
+    parallelBatches(
+        reader.blockCount(), threads, true,
+        [&](size_t i, PointBatch& batch) {
+          size_t      length = 0;
+          const char* begin  = reader.acquire(i, length);
+          try {
+            stitcher.parseInterior(i, begin, begin + length, pc.columns, batch);
+          } catch (...) {
+            reader.release(i);
+            throw;
+          }
+          reader.release(i);
+        },
+        [&](size_t i, PointBatch& batch) {
+          stitcher.consume(i, batch, pc);
+          reportProgress(std::min<uint64_t>((i + 1) * kUringBlockBytes, reader.size()));
+        });
+    stitcher.finish(pc);
+  }
+
+  // Splits [data, data + size) into ranges of roughly `chunkBytes` that each
+  // end just past a newline, so no line straddles two ranges.
+  std::vector<ByteRange> splitLines(const char* data, size_t size, size_t chunkBytes) {
+    std::vector<ByteRange> ranges;
+    const char*            ptr = data;
+    const char*            end = data + size;
+    while (ptr < end) {
+      const char* target = (static_cast<size_t>(end - ptr) > chunkBytes) ? ptr + chunkBytes : end;
+      if (target < end) {
+        const char* nl = (const char*)std::memchr(target, '\n', end - target);
+        target         = nl ? nl + 1 : end;
+      }
+      ByteRange r = {ptr, target};
+      ranges.push_back(r);
+      ptr = target;
+    }
+    return ranges;
+  }
+
+  // Sniffs the magic bytes of a file without mapping it.
+  bool isCompressedFile(const std::string& filename) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    char          magic[4] = {0, 0, 0, 0};
+    in.read(magic, sizeof(magic));
+    return detectCompression(magic, static_cast<size_t>(in.gcount())) != kCompressionNone;
+  }
+
+  // Parses text from a pipe; progress counts megabytes, the total is unknown.
+  bool processStream(std::FILE* file, PointCollector& pc) {
+    bool         scanning = !pc.quiet && pc.totalPoints == 0;
+    StreamSource source(file);
+    streamText(source, pc, [&](size_t inputBytes) {
+      if (scanning) {
+        std::cout << "\rReading stream: " << inputBytes / (1024 * 1024) << " MB   " << std::flush;
+      }
+    });
+    if (scanning) {
+      std::cout << "\rReading stream: " << source.consumed() / (1024 * 1024) << " MB   " << std::flush;
+    }
+    return true;
+  }
+} // namespace
+
+bool isStream(const std::string& filename) {
+  if (filename == kStdinName) {
+    return true;
+  }
+#if defined(__unix__) || defined(__APPLE__)
+  struct stat st;
+  return stat(filename.c_str(), &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode));
+#else
+  return false;
+#endif
+}
+
+bool processXYZ(const std::string& filename, PointCollector& pc) {
+  if (filename == kStdinName) {
+    return processStream(stdin, pc);
+  }
+  if (isStream(filename)) {
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(std::fopen(filename.c_str(), "rb"), std::fclose);
+    return file && processStream(file.get(), pc);
+  }
+
+  if (pc.inputEngine == kInputEngineUring && !isCompressedFile(filename)) {
+    UringReader reader(filename, kUringBlockBytes, kUringDepth, pc.directIO);
+    if (reader.isOpen()) {
+      bool scanning = !pc.quiet && pc.totalPoints == 0;
+      readBlocksInParallel(reader, resolveThreadCount(pc.threads), pc, [&](uint64_t bytes) {
+        if (scanning) {
+          std::cout << "\rScanning file: " << static_cast<int>(bytes * 100.0 / reader.size()) << "%   " << std::flush;
+        }
+      });
+      if (scanning) {
+        std::cout << "\rScanning file: 100%   " << std::flush;
+      }
+      return true;
+    }
+  }
+
+  std::error_code error;
+  mio::mmap_source mmap;
+  mmap.map(filename, error);
+  if (error) {
+    return false;
+  }
+
+  const char* data     = mmap.data();
+  size_t      size     = mmap.size();
+  bool        scanning = !pc.quiet && pc.totalPoints == 0;
+  int         threads  = resolveThreadCount(pc.threads);
+
+  Compression compression = detectCompression(data, size);
+  if (compression != kCompressionNone) {
+    auto reportProgress = [&](size_t inputBytes) {
+      if (scanning) {
+        std::cout << "\rScanning file: " << static_cast<int>(inputBytes * 100.0 / size) << "%   " << std::flush;
+      }
+    };
+    std::vector<CompressedRange> members = independentMembers(data, size, compression);
+    if (threads > 1 && members.size() > 1) {
+      decodeMembersInParallel(data, members, compression, threads, pc, reportProgress);
+    } else {
+      // Serial streams (plain gzip, single zstd frames, bzip2)
+      DecompressedSource source(data, size, compression);
+      streamText(source, pc, reportProgress);
+    }
+    if (scanning) {
+      std::cout << "\rScanning file: 100%   " << std::flush;
+    }
+    return true;
+  }
+
+  // Serial parsing batches small chunks, so each batch stays cache-sized
+  size_t chunkBytes = kMinChunkBytes;
+  if (threads > 1) {
+    chunkBytes = std::max(kMinChunkBytes, std::min(kChunkBytes, size / (threads * 4) + 1));
+  }
+  std::vector<ByteRange> chunks = splitLines(data, size, chunkBytes);
+
+  std::atomic<size_t> doneBytes(0);
+  auto                reportProgress = [&](size_t bytes) {
+    if (scanning) {
+      int percent = static_cast<int>(bytes * 100.0 / size);
       std::cout << "\rScanning file: " << percent << "%   " << std::flush;
-      last_count = pc.count;
     }
+  };
 
-    ptr = endOfLine + 1;
+  std::unique_ptr<ReadAhead> readAhead;
+  if (threads > 1) {
+    readAhead.reset(new ReadAhead(chunks, data, doneBytes));
   }
 
-  if (!pc.quiet && pc.totalPoints == 0) {
+  if (threads <= 1) {
+    // Parse a chunk at a time and hand it to the collector's batch kernels
+    PointBatch batch;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      batch.clear();
+      parseRange(chunks[i].begin, chunks[i].end, pc.columns, batch);
+      pc.addBatch(batch);
+      reportProgress(chunks[i].end - data);
+    }
+  } else if (!pc.isWriting()) {
+    // Bounds pass: every worker accumulates into its own collector, merged at the end
+    std::vector<PointCollector> locals(threads);
+    std::vector<ZHistogram>     localZ(threads, ZHistogram(pc.zHistogram ? pc.zHistogram->relativeError : 0.001));
+    for (int t = 0; t < threads; ++t) {
+      locals[t].quiet      = true;
+      locals[t].colorize   = pc.colorize;
+      locals[t].zHistogram = pc.zHistogram ? &localZ[t] : nullptr;
+      locals[t].columns    = pc.columns;
+    }
+    parallelFor(chunks.size(), threads, [&](size_t i, int worker) {
+      parseRange(chunks[i].begin, chunks[i].end, pc.columns, locals[worker]);
+      size_t done = doneBytes += chunks[i].end - chunks[i].begin;
+      if (worker == 0) {
+        reportProgress(done);
+      }
+    });
+    for (int t = 0; t < threads; ++t) {
+      pc.merge(locals[t]);
+    }
+  } else {
+    // Write pass: workers parse into batches, the calling thread feeds the writer
+    parallelBatches(
+        chunks.size(), threads, pc.ordered,
+        [&](size_t i, PointBatch& batch) {
+          parseRange(chunks[i].begin, chunks[i].end, pc.columns, batch);
+        },
+        [&](size_t i, PointBatch& batch) {
+          pc.addBatch(batch);
+          reportProgress(doneBytes += chunks[i].end - chunks[i].begin);
+        });
+  }
+
+  if (scanning) {
     std::cout << "\rScanning file: 100%   " << std::flush;
   }
 
@@ -157,6 +937,10 @@ bool processXYZ(const std::string& filename, PointCollector& pc) {
 }
 
 bool processInput(const std::string& filename, PointCollector& pc, std::string& srsWKT) {
+  // Probing a stream with GDAL would consume the text it reads
+  if (isStream(filename)) {
+    return processXYZ(filename, pc);
+  }
   if (processGDAL(filename, pc, srsWKT)) {
     return true;
   }
@@ -0,0 +1,218 @@
+#include "LasEncoder.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+
+void StreamSink::write(const char* records, size_t count, size_t recordLength) {
+  os.write(records, static_cast<std::streamsize>(count * recordLength));
+  if (!os.good()) {
+    throw std::runtime_error("Failed to write point records");
+  }
+}
+
+WriterSink::WriterSink(liblas::Writer& writer, const liblas::Header& header)
+    : writer(writer), point(&writer.GetHeader()) {
+  formatId    = static_cast<int>(header.GetDataFormatId());
+  hasColor    = formatId == 2 || formatId == 3;
+  colorOffset = formatId == 3 ? 28 : 20;
+}
+
+void WriterSink::write(const char* records, size_t count, size_t recordLength) {
+  for (size_t i = 0; i < count; ++i, records += recordLength) {
+    int32_t xyz[3];
+    std::memcpy(xyz, records, sizeof(xyz));
+    point.SetRawX(xyz[0]);
+    point.SetRawY(xyz[1]);
+    point.SetRawZ(xyz[2]);
+    PointAttributes a;
+    std::memcpy(&a.intensity, records + 12, sizeof(uint16_t));
+    a.returnNumber    = static_cast<uint8_t>(records[14] & 7);
+    a.numberOfReturns = static_cast<uint8_t>((records[14] >> 3) & 7);
+    a.classification  = static_cast<uint8_t>(records[15]);
+    if (formatId == 1 || formatId == 3) {
+      std::memcpy(&a.time, records + 20, sizeof(double));
+    }
+    if (hasColor) {
+      std::memcpy(a.rgb, records + colorOffset, sizeof(a.rgb));
+    }
+    setPointAttributes(point, a, formatId, hasColor);
+    if (!writer.WritePoint(point)) {
+      throw std::runtime_error("Failed to write point");
+    }
+  }
+}
+
+void setPointAttributes(liblas::Point& point, const PointAttributes& a, int formatId, bool withColor) {
+  point.SetIntensity(a.intensity);
+  point.SetReturnNumber(a.returnNumber);
+  point.SetNumberOfReturns(a.numberOfReturns);
+  point.SetClassification(a.classification);
+  if (formatId == 1 || formatId == 3) {
+    point.SetTime(a.time);
+  }
+  if (withColor && (formatId == 2 || formatId == 3)) {
+    point.SetColor(liblas::Color(a.rgb[0], a.rgb[1], a.rgb[2]));
+  }
+}
+
+size_t LasPointEncoder::recordLengthFor(int formatId) {
+  switch (formatId) {
+  case 0:
+    return 20;
+  case 1:
+    return 28;
+  case 2:
+    return 26;
+  case 3:
+    return 34;
+  case 6:
+    return 30;
+  case 7:
+    return 36;
+  default:
+    return 0;
+  }
+}
+
+int extendedPointFormat(int legacyFormat) {
+  return legacyFormat == 2 || legacyFormat == 3 ? 7 : 6;
+}
+
+LasPointEncoder::LasPointEncoder(const liblas::Header& header, RecordSink& sink, size_t batchPoints, int formatId)
+    : sink(sink),
+      scaleX(header.GetScaleX()), scaleY(header.GetScaleY()), scaleZ(header.GetScaleZ()),
+      offsetX(header.GetOffsetX()), offsetY(header.GetOffsetY()), offsetZ(header.GetOffsetZ()),
+      formatId(formatId >= 0 ? formatId : static_cast<int>(header.GetDataFormatId())),
+      recordLength(recordLengthFor(this->formatId)),
+      hasColor(this->formatId == 2 || this->formatId == 3 || this->formatId == 7),
+      hasTime(this->formatId == 1 || this->formatId == 3 || this->formatId >= 6),
+      colorOffset(this->formatId == 7 ? 30 : this->formatId == 3 ? 28 : 20),
+      // Formats 6 and up widen return numbers to 4 bits and move the
+      // classification behind a byte of flags
+      classOffset(this->formatId >= 6 ? 16 : 15),
+      timeOffset(this->formatId >= 6 ? 22 : 20),
+      returnMask(this->formatId >= 6 ? 15 : 7),
+      returnsShift(this->formatId >= 6 ? 4 : 3),
+      classMask(this->formatId >= 6 ? 255 : 31),
+      batchPoints(batchPoints > 0 ? batchPoints : 1),
+      pending(0), written(0), maxPoints(UINT64_MAX) {
+  if (recordLength == 0) {
+    throw std::runtime_error("Unsupported LAS point format for the native encoder");
+  }
+  buffer.assign(this->batchPoints * recordLength, 0);
+}
+
+void LasPointEncoder::flush() {
+  if (pending == 0) {
+    return;
+  }
+  if (pending > maxPoints - written) {
+    throw std::runtime_error("The output holds at most " + std::to_string(maxPoints) +
+                             " points; write LAS 1.4 with --las-version 1.4");
+  }
+  sink.write(&buffer[0], pending, recordLength);
+  written += pending;
+  pending = 0;
+}
+
+liblas::Header writeLasHeader(std::ostream& os, const liblas::Header& header) {
+  // Let liblas lay out the header and VLRs in memory. Whatever it rewrites on
+  // destruction (the point count) is patched by the caller once points are in.
+  std::ostringstream rendered(std::ios::out | std::ios::binary);
+  liblas::Header     completed;
+  {
+    liblas::Writer writer(rendered, header);
+    completed = writer.GetHeader();
+  }
+  uint32_t    dataOffset = completed.GetDataOffset();
+  std::string bytes = rendered.str();
+  if (bytes.size() < dataOffset) {
+    bytes.resize(dataOffset, '\0');
+  }
+  os.write(bytes.data(), dataOffset);
+  if (!os.good()) {
+    throw std::runtime_error("Failed to write LAS header");
+  }
+  return completed;
+}
+
+namespace {
+  // LAS 1.4 public header block and VLR header sizes
+  const size_t kLas14HeaderSize = 375;
+  const size_t kVlrHeaderSize   = 54;
+
+  template <typename T> void putAt(std::string& bytes, size_t offset, T value) {
+    std::memcpy(&bytes[offset], &value, sizeof(T));
+  }
+
+  void putText(std::string& bytes, size_t offset, size_t width, const std::string& text) {
+    std::memcpy(&bytes[offset], text.data(), std::min(width, text.size()));
+  }
+
+  void appendVlr(std::string& bytes, const std::string& userId, uint16_t recordId, const std::string& description,
+                 const char* data, size_t size) {
+    size_t at = bytes.size();
+    bytes.resize(at + kVlrHeaderSize + size, '\0');
+    putText(bytes, at + 2, 16, userId);
+    putAt<uint16_t>(bytes, at + 18, recordId);
+    putAt<uint16_t>(bytes, at + 20, static_cast<uint16_t>(size));
+    putText(bytes, at + 22, 32, description);
+    if (size > 0) {
+      std::memcpy(&bytes[at + kVlrHeaderSize], data, size);
+    }
+  }
+} // namespace
+
+uint32_t writeLas14Header(std::ostream& os, const liblas::Header& header, int formatId) {
+  std::string bytes(kLas14HeaderSize, '\0');
+  std::memcpy(&bytes[0], "LASF", 4);
+  putAt<uint16_t>(bytes, 6, 1 << 4); // global encoding: the CRS is WKT
+  bytes[24] = 1;
+  bytes[25] = 4;
+  putText(bytes, 26, 32, "OTHER");
+  putText(bytes, 58, 32, "xyz2las");
+  std::time_t now = std::time(nullptr);
+  std::tm*    utc = std::gmtime(&now);
+  if (utc) {
+    putAt<uint16_t>(bytes, 90, static_cast<uint16_t>(utc->tm_yday + 1));
+    putAt<uint16_t>(bytes, 92, static_cast<uint16_t>(utc->tm_year + 1900));
+  }
+  putAt<uint16_t>(bytes, 94, static_cast<uint16_t>(kLas14HeaderSize));
+  bytes[104] = static_cast<char>(formatId);
+  putAt<uint16_t>(bytes, 105, static_cast<uint16_t>(LasPointEncoder::recordLengthFor(formatId)));
+  const double scale[3]  = {header.GetScaleX(), header.GetScaleY(), header.GetScaleZ()};
+  const double offset[3] = {header.GetOffsetX(), header.GetOffsetY(), header.GetOffsetZ()};
+  const double bounds[6] = {header.GetMaxX(), header.GetMinX(), header.GetMaxY(),
+                            header.GetMinY(), header.GetMaxZ(), header.GetMinZ()};
+  std::memcpy(&bytes[131], scale, sizeof(scale));
+  std::memcpy(&bytes[155], offset, sizeof(offset));
+  std::memcpy(&bytes[179], bounds, sizeof(bounds));
+
+  // GeoTIFF keys are only allowed with formats 0-5, so the CRS is carried as
+  // WKT alone; other VLRs pass through
+  uint32_t vlrCount = 0;
+  for (const liblas::VariableRecord& vlr : header.GetVLRs()) {
+    std::string userId = vlr.GetUserId(false);
+    if (userId == "LASF_Projection" || userId == "laszip encoded") {
+      continue;
+    }
+    const std::vector<uint8_t>& data = vlr.GetData();
+    appendVlr(bytes, userId, vlr.GetRecordId(), "", reinterpret_cast<const char*>(data.data()), data.size());
+    ++vlrCount;
+  }
+  std::string wkt = header.GetSRS().GetWKT(liblas::SpatialReference::eCompoundOK);
+  if (!wkt.empty()) {
+    appendVlr(bytes, "LASF_Projection", 2112, "OGC WKT", wkt.c_str(), wkt.size() + 1);
+    ++vlrCount;
+  }
+  putAt<uint32_t>(bytes, 96, static_cast<uint32_t>(bytes.size()));
+  putAt<uint32_t>(bytes, 100, vlrCount);
+
+  os.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  if (!os.good()) {
+    throw std::runtime_error("Failed to write LAS header");
+  }
+  return static_cast<uint32_t>(bytes.size());
+}
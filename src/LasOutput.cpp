@@ -0,0 +1,160 @@
+#include "LasOutput.hpp"
+#include "HeaderPatcher.hpp"
+#include "LazChunkSink.hpp"
+#include "ParallelChunks.hpp"
+#include <stdexcept>
+
+bool LasOutput::open(const std::string& filename, const liblas::Header& header, const OutputOptions& options) {
+  this->filename = filename;
+  this->header   = header;
+  this->options  = options;
+  int    threads     = resolveThreadCount(options.threads);
+  size_t batchPoints = kPipelineBatchPoints;
+  int    formatId    = static_cast<int>(this->header.GetDataFormatId());
+  if (options.las14) {
+    if (options.tileSize > 0.0 || this->header.Compressed()) {
+      throw std::runtime_error("LAS 1.4 output is only written as a single uncompressed file");
+    }
+    formatId = extendedPointFormat(formatId);
+  }
+
+  if (options.tileSize > 0.0) {
+    // Tile files are created as points reach them
+    tiles = new TileSink(this->header, filename, options.tileSize, threads);
+    sink.reset(tiles);
+  } else {
+    if (options.bufferBytes > 0 && fileBuf.open(filename, options.bufferBytes, options.directIO)) {
+      out.rdbuf(&fileBuf);
+    } else {
+      ofs.open(filename, std::ios::out | std::ios::binary);
+      if (!ofs.is_open()) {
+        return false;
+      }
+      out.rdbuf(ofs.rdbuf());
+    }
+    if (options.las14) {
+      writeLas14Header(out, this->header, formatId);
+      sink.reset(new StreamSink(out));
+    } else if (this->header.Compressed() && (threads <= 1 || !parallelLazAvailable())) {
+      writer.reset(new liblas::Writer(out, this->header));
+      if (options.sort == kSortNone && !options.lax && options.voxelSize <= 0.0 && !options.dedupe) {
+        return true;
+      }
+      // Sorted, indexed, thinned or deduplicated records are replayed through the writer
+      sink.reset(new WriterSink(*writer, this->header));
+    } else {
+      liblas::Header rendered = writeLasHeader(out, this->header);
+      if (this->header.Compressed()) {
+        LazChunkSink* laz = new LazChunkSink(out, rendered, threads);
+        sink.reset(laz);
+        // One encoder batch per LASzip chunk
+        batchPoints = laz->chunkSize();
+      } else {
+        sink.reset(new StreamSink(out));
+      }
+    }
+  }
+
+  RecordSink* target = sink.get();
+  if (options.lax) {
+    // The header count is the one before thinning or deduplication; the
+    // quadtree is sized for the points actually written, so both spool them
+    bool boundsKnown = this->header.GetPointRecordsCount() > 0 && options.voxelSize <= 0.0 && !options.dedupe;
+    laxIndex.reset(new LaxIndexSink(*target, this->header, LaxIndexSink::laxPathFor(filename), boundsKnown));
+    target = laxIndex.get();
+  }
+  if (options.inflightBytes > 0) {
+    size_t recordBytes = batchPoints * LasPointEncoder::recordLengthFor(formatId);
+    asyncSink.reset(new AsyncSink(*target, options.inflightBytes / 2, recordBytes));
+    target = asyncSink.get();
+  }
+  if (options.sort != kSortNone) {
+    sorter.reset(new SortingSink(*target, options.sort, options.spillMemoryBytes, filename));
+    target = sorter.get();
+  }
+  if (options.voxelSize > 0.0) {
+    voxel.reset(new VoxelFilterSink(*target, this->header, options.voxelSize, options.voxelMode,
+                                    options.spillMemoryBytes, filename));
+    target = voxel.get();
+  }
+  if (options.dedupe) {
+    dedupe.reset(new DedupeSink(*target, this->header, options.spillMemoryBytes, filename));
+    target = dedupe.get();
+  }
+  encoder.reset(new LasPointEncoder(this->header, *target, batchPoints, formatId));
+  // A LAS 1.2 file counts points in 32 bits: fail when a single pass crosses
+  // that rather than on close. Thinning may still get under it, so filtered
+  // output is left to the check on close.
+  if (!options.las14 && options.tileSize <= 0.0 && !voxel && !dedupe) {
+    encoder->maxPoints = UINT32_MAX;
+  }
+  return true;
+}
+
+RecordSink* LasOutput::head() {
+  if (dedupe) {
+    return dedupe.get();
+  }
+  if (voxel) {
+    return voxel.get();
+  }
+  if (sorter) {
+    return sorter.get();
+  }
+  if (asyncSink) {
+    return asyncSink.get();
+  }
+  if (laxIndex) {
+    return laxIndex.get();
+  }
+  return sink.get();
+}
+
+void LasOutput::attach(PointCollector& pc) {
+  pc.header  = &header;
+  pc.writer  = writer.get();
+  pc.encoder = encoder.get();
+  if (options.inflightBytes > 0) {
+    pipeline.reset(new PointPipeline(pc, options.inflightBytes / 2));
+    pc.pipeline = pipeline.get();
+  }
+  // Kernels for this output, selected here before any batch can reach the
+  // pipeline thread, which only reads them
+  pc.specialize();
+}
+
+bool LasOutput::close(const PointCollector& pc) {
+  if (pipeline) {
+    pipeline->finish();
+  }
+  if (encoder) {
+    encoder->flush();
+    head()->close(); // each stage closes the next
+  }
+  if (tiles) {
+    return true; // each tile was finalized by the sink
+  }
+  // Destroying the writer finalizes the point stream (and the LASzip chunk table)
+  writer.reset();
+  bool written = !out.fail();
+  if (fileBuf.isOpen()) {
+    written = fileBuf.close() && written;
+  } else {
+    ofs.close();
+    written = !ofs.fail() && written;
+  }
+  if (!written) {
+    return false;
+  }
+  if (voxel) {
+    double minXYZ[3], maxXYZ[3];
+    voxel->keptBounds(minXYZ, maxXYZ);
+    return patchLasHeader(filename, voxel->keptCount(), minXYZ, maxXYZ);
+  }
+  if (dedupe) {
+    double minXYZ[3], maxXYZ[3];
+    dedupe->keptBounds(minXYZ, maxXYZ);
+    return patchLasHeader(filename, dedupe->keptCount(), minXYZ, maxXYZ);
+  }
+  return patchLasHeader(filename, pc);
+}
@@ -0,0 +1,357 @@
+#include "LaxIndex.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+  // Leaves hold about this many points before coarsening
+  const double   kLeafPoints = 1000.0;
+  const uint32_t kMaxLevels  = 16;
+  const size_t   kReadPoints = 1 << 16;
+
+  // Rounds up to 1, 2 or 5 times a power of ten.
+  double niceSize(double size) {
+    double decade = std::pow(10.0, std::floor(std::log10(size)));
+    for (double step : {1.0, 2.0, 5.0, 10.0}) {
+      if (step * decade >= size) {
+        return step * decade;
+      }
+    }
+    return 10.0 * decade;
+  }
+
+  float cellSizeFor(double width, double height, uint64_t points) {
+    double extent = std::max(width, height);
+    if (!(extent > 0.0)) {
+      return 1.0f;
+    }
+    double area = std::max(width, extent / kLeafPoints) * std::max(height, extent / kLeafPoints);
+    double size = std::sqrt(area * kLeafPoints / std::max<uint64_t>(points, 1));
+    size        = std::max(size, extent / (1 << (kMaxLevels - 1)));
+    return static_cast<float>(niceSize(size));
+  }
+
+  template <class T>
+  void put(std::ofstream& os, T v) {
+    os.write(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  int32_t rawAt(const char* record, int axis) {
+    int32_t v;
+    std::memcpy(&v, record + 4 * axis, sizeof(v));
+    return v;
+  }
+} // namespace
+
+void LaxQuadtree::setup(double boundsMinX, double boundsMaxX, double boundsMinY, double boundsMaxY, float cellSize) {
+  // Same arithmetic as LASquadtree::setup()
+  minX = cellSize * static_cast<int32_t>(boundsMinX / cellSize) - (boundsMinX >= 0 ? 0 : cellSize);
+  maxX = cellSize * static_cast<int32_t>(boundsMaxX / cellSize) + (boundsMaxX >= 0 ? cellSize : 0);
+  minY = cellSize * static_cast<int32_t>(boundsMinY / cellSize) - (boundsMinY >= 0 ? 0 : cellSize);
+  maxY = cellSize * static_cast<int32_t>(boundsMaxY / cellSize) + (boundsMaxY >= 0 ? cellSize : 0);
+
+  uint32_t cellsX = static_cast<uint32_t>((maxX - minX) / cellSize + 0.5f);
+  uint32_t cellsY = static_cast<uint32_t>((maxY - minY) / cellSize + 0.5f);
+  uint32_t c      = std::max(cellsX, cellsY) - 1;
+  levels          = 0;
+  while (c) {
+    c >>= 1;
+    levels++;
+  }
+
+  // Grow the box to the full grid of the deepest level
+  c = (1u << levels) - cellsX;
+  minX -= (c - c / 2) * cellSize;
+  maxX += (c / 2) * cellSize;
+  c = (1u << levels) - cellsY;
+  minY -= (c - c / 2) * cellSize;
+  maxY += (c / 2) * cellSize;
+}
+
+uint32_t LaxQuadtree::cellIndex(double x, double y) const {
+  float    cellMinX = minX, cellMaxX = maxX, cellMinY = minY, cellMaxY = maxY;
+  uint32_t index    = 0;
+  for (uint32_t level = levels; level > 0; --level) {
+    // Rounded to float like LASlib, so boundary points land in the same cell
+    volatile float midX = (cellMinX + cellMaxX) / 2;
+    volatile float midY = (cellMinY + cellMaxY) / 2;
+    index <<= 2;
+    if (x < midX) {
+      cellMaxX = midX;
+    } else {
+      cellMinX = midX;
+      index |= 1;
+    }
+    if (y < midY) {
+      cellMaxY = midY;
+    } else {
+      cellMinY = midY;
+      index |= 2;
+    }
+  }
+  return levelOffset(levels) + index;
+}
+
+uint32_t LaxQuadtree::levelOf(uint32_t cell) {
+  uint32_t level = 0;
+  while (levelOffset(level + 1) <= cell) {
+    level++;
+  }
+  return level;
+}
+
+LaxIndex::LaxIndex(uint32_t threshold) : threshold(threshold), last(nullptr), lastCell(0) {}
+
+void LaxIndex::add(uint32_t point, uint32_t cell) {
+  if (!last || lastCell != cell) {
+    last     = &cells[cell];
+    lastCell = cell;
+  }
+  last->full++;
+  if (last->intervals.empty() || point - last->intervals.back().second > threshold) {
+    last->intervals.push_back(std::make_pair(point, point));
+  } else {
+    last->intervals.back().second = point;
+  }
+}
+
+void LaxIndex::complete(uint32_t minimumPoints, int maximumIntervals) {
+  last = nullptr;
+
+  // Coarsen level by level: four siblings, all present, that together hold
+  // fewer than minimumPoints become their parent. As in LASlib only cells
+  // created in one round are candidates in the next.
+  std::vector<uint32_t> round;
+  for (const auto& entry : cells) {
+    round.push_back(entry.first);
+  }
+  while (minimumPoints > 0 && !round.empty()) {
+    std::map<uint32_t, std::vector<uint32_t>> families;
+    for (uint32_t cell : round) {
+      uint32_t level = LaxQuadtree::levelOf(cell);
+      if (level > 0) {
+        uint32_t local = cell - LaxQuadtree::levelOffset(level);
+        families[LaxQuadtree::levelOffset(level - 1) + (local >> 2)].push_back(cell);
+      }
+    }
+    round.clear();
+    for (const auto& family : families) {
+      uint64_t full = 0;
+      for (uint32_t child : family.second) {
+        full += cells[child].full;
+      }
+      if (family.second.size() != 4 || full >= minimumPoints) {
+        continue;
+      }
+      Cell merged;
+      merged.full = static_cast<uint32_t>(full);
+      for (uint32_t child : family.second) {
+        const Cell& c = cells[child];
+        merged.intervals.insert(merged.intervals.end(), c.intervals.begin(), c.intervals.end());
+        cells.erase(child);
+      }
+      std::sort(merged.intervals.begin(), merged.intervals.end());
+      std::vector<std::pair<uint32_t, uint32_t>> joined;
+      for (const auto& interval : merged.intervals) {
+        if (!joined.empty() && interval.first <= joined.back().second + 1) {
+          joined.back().second = std::max(joined.back().second, interval.second);
+        } else {
+          joined.push_back(interval);
+        }
+      }
+      merged.intervals.swap(joined);
+      cells[family.first] = merged;
+      round.push_back(family.first);
+    }
+  }
+
+  // Then close the smallest gaps between intervals of a cell until the
+  // interval budget is met; readers filter the few extra points out.
+  size_t budget = maximumIntervals < 0 ? static_cast<size_t>(-maximumIntervals) * cells.size()
+                                       : static_cast<size_t>(maximumIntervals);
+  struct Gap {
+    uint32_t size, cell, after;
+    bool operator<(const Gap& o) const {
+      return size < o.size || (size == o.size && (cell < o.cell || (cell == o.cell && after < o.after)));
+    }
+  };
+  std::vector<Gap> gaps;
+  size_t           total = 0;
+  for (const auto& entry : cells) {
+    const auto& intervals = entry.second.intervals;
+    total += intervals.size();
+    for (size_t i = 1; i < intervals.size(); ++i) {
+      Gap g = {intervals[i].first - intervals[i - 1].second, entry.first, static_cast<uint32_t>(i - 1)};
+      gaps.push_back(g);
+    }
+  }
+  if (budget == 0 || total <= budget) {
+    return;
+  }
+  size_t closing = std::min(total - budget, gaps.size());
+  std::nth_element(gaps.begin(), gaps.begin() + closing, gaps.end());
+  gaps.resize(closing);
+  std::sort(gaps.begin(), gaps.end(), [](const Gap& a, const Gap& b) {
+    return a.cell < b.cell || (a.cell == b.cell && a.after > b.after);
+  });
+  // Per cell from the last gap back, so earlier positions stay valid
+  for (const Gap& g : gaps) {
+    auto& intervals = cells[g.cell].intervals;
+    intervals[g.after].second = intervals[g.after + 1].second;
+    intervals.erase(intervals.begin() + g.after + 1);
+  }
+}
+
+bool LaxIndex::write(const std::string& path, const LaxQuadtree& tree) const {
+  std::ofstream os(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!os.is_open()) {
+    return false;
+  }
+  os.write("LASX", 4);
+  put<uint32_t>(os, 0); // version
+
+  os.write("LASS", 4);
+  put<uint32_t>(os, 0); // LAS_SPATIAL_QUAD_TREE
+  os.write("LASQ", 4);
+  put<uint32_t>(os, 0); // version
+  put<uint32_t>(os, tree.levels);
+  put<uint32_t>(os, 0); // level index
+  put<uint32_t>(os, 0); // implicit levels
+  put<float>(os, tree.minX);
+  put<float>(os, tree.maxX);
+  put<float>(os, tree.minY);
+  put<float>(os, tree.maxY);
+
+  os.write("LASV", 4);
+  put<uint32_t>(os, 0); // version
+  put<uint32_t>(os, static_cast<uint32_t>(cells.size()));
+  for (const auto& entry : cells) {
+    put<int32_t>(os, static_cast<int32_t>(entry.first));
+    put<uint32_t>(os, static_cast<uint32_t>(entry.second.intervals.size()));
+    put<uint32_t>(os, entry.second.full);
+    for (const auto& interval : entry.second.intervals) {
+      put<uint32_t>(os, interval.first);
+      put<uint32_t>(os, interval.second);
+    }
+  }
+  os.close();
+  return !os.fail();
+}
+
+LaxIndexSink::LaxIndexSink(RecordSink& downstream, const liblas::Header& header, const std::string& laxPath,
+                           bool boundsKnown)
+    : downstream(downstream), laxPath(laxPath), points(0), closed(false) {
+  scale[0]  = header.GetScaleX();
+  scale[1]  = header.GetScaleY();
+  offset[0] = header.GetOffsetX();
+  offset[1] = header.GetOffsetY();
+  for (int axis = 0; axis < 2; ++axis) {
+    minRaw[axis] = INT32_MAX;
+    maxRaw[axis] = INT32_MIN;
+  }
+  if (boundsKnown) {
+    double width  = header.GetMaxX() - header.GetMinX();
+    double height = header.GetMaxY() - header.GetMinY();
+    tree.setup(header.GetMinX(), header.GetMaxX(), header.GetMinY(), header.GetMaxY(),
+               cellSizeFor(width, height, header.GetPointRecordsCount()));
+  } else {
+    spoolPath = laxPath + ".tmp";
+    spool.open(spoolPath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!spool.is_open()) {
+      throw std::runtime_error("Cannot create spatial index spool: " + spoolPath);
+    }
+  }
+}
+
+LaxIndexSink::~LaxIndexSink() {
+  if (!spoolPath.empty()) {
+    spool.close();
+    std::remove(spoolPath.c_str());
+  }
+}
+
+std::string LaxIndexSink::laxPathFor(const std::string& filename) {
+  size_t dot   = filename.find_last_of('.');
+  size_t slash = filename.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return filename + ".lax";
+  }
+  return filename.substr(0, dot) + ".lax";
+}
+
+void LaxIndexSink::write(const char* records, size_t count, size_t recordLength) {
+  // LASindex numbers points with 32 bits
+  if (count > UINT32_MAX - points) {
+    throw std::runtime_error("A spatial index (--lax) covers at most 4294967295 points");
+  }
+  if (spool.is_open()) {
+    for (size_t i = 0; i < count; ++i) {
+      const char* r = records + i * recordLength;
+      spool.write(r, 8); // X, Y
+      for (int axis = 0; axis < 2; ++axis) {
+        int32_t v = rawAt(r, axis);
+        minRaw[axis] = std::min(minRaw[axis], v);
+        maxRaw[axis] = std::max(maxRaw[axis], v);
+      }
+    }
+    if (!spool.good()) {
+      throw std::runtime_error("Failed to write spatial index spool: " + spoolPath);
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      const char* r = records + i * recordLength;
+      index.add(points + static_cast<uint32_t>(i), tree.cellIndex(rawAt(r, 0) * scale[0] + offset[0],
+                                                                  rawAt(r, 1) * scale[1] + offset[1]));
+    }
+  }
+  points += static_cast<uint32_t>(count);
+  downstream.write(records, count, recordLength);
+}
+
+void LaxIndexSink::close() {
+  if (closed) {
+    return;
+  }
+  closed = true;
+  downstream.close();
+
+  if (spool.is_open()) {
+    spool.close();
+    if (spool.fail()) {
+      throw std::runtime_error("Failed to write spatial index spool: " + spoolPath);
+    }
+    if (points > 0) {
+      double minX = minRaw[0] * scale[0] + offset[0], maxX = maxRaw[0] * scale[0] + offset[0];
+      double minY = minRaw[1] * scale[1] + offset[1], maxY = maxRaw[1] * scale[1] + offset[1];
+      tree.setup(minX, maxX, minY, maxY, cellSizeFor(maxX - minX, maxY - minY, points));
+    }
+    std::ifstream     in(spoolPath, std::ios::in | std::ios::binary);
+    std::vector<char> block(kReadPoints * 8);
+    uint32_t          point = 0;
+    for (;;) {
+      in.read(&block[0], static_cast<std::streamsize>(block.size()));
+      size_t n = static_cast<size_t>(in.gcount()) / 8;
+      if (n == 0) {
+        break;
+      }
+      for (size_t i = 0; i < n; ++i, ++point) {
+        const char* r = &block[i * 8];
+        index.add(point, tree.cellIndex(rawAt(r, 0) * scale[0] + offset[0], rawAt(r, 1) * scale[1] + offset[1]));
+      }
+    }
+    in.close();
+    std::remove(spoolPath.c_str());
+    spoolPath.clear();
+    if (point != points) {
+      throw std::runtime_error("Cannot read spatial index spool");
+    }
+  }
+
+  index.complete();
+  if (!index.write(laxPath, tree)) {
+    throw std::runtime_error("Cannot write spatial index: " + laxPath);
+  }
+}
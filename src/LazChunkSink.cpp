@@ -0,0 +1,269 @@
+#include "LazChunkSink.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef XYZ2LAS_HAVE_LASZIP_INTERNALS
+#include "laszip.hpp"
+#include "laszipper.hpp"
+#include "arithmeticencoder.hpp"
+#include "bytestreamout_ostream.hpp"
+#include "integercompressor.hpp"
+#endif
+
+namespace {
+  void putLE64(std::ostream& os, int64_t v) {
+    char buf[8];
+    for (int i = 0; i < 8; ++i) {
+      buf[i] = static_cast<char>((static_cast<uint64_t>(v) >> (8 * i)) & 0xFF);
+    }
+    os.write(buf, 8);
+  }
+
+  int64_t getLE64(const std::string& bytes, size_t pos) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) {
+      v = (v << 8) | static_cast<unsigned char>(bytes[pos + i]);
+    }
+    return static_cast<int64_t>(v);
+  }
+
+  // Padding plus the table pointer in front of a chunk compressed on its own
+  const size_t kChunkStart = 16;
+} // namespace
+
+#ifdef XYZ2LAS_HAVE_LASZIP_INTERNALS
+
+bool parallelLazAvailable() {
+  return true;
+}
+
+LazChunkSink::LazChunkSink(std::ostream& os, const liblas::Header& header, int threads)
+    : os(os), zip(new LASzip()), recordLength(header.GetDataRecordLength()), chunkPoints(0),
+      maxInFlight(static_cast<size_t>(threads > 0 ? threads : 1) * 2), tablePointerPos(0),
+      stopping(false), closed(false) {
+  bool configured = false;
+  for (const liblas::VariableRecord& vlr : header.GetVLRs()) {
+    if (vlr.GetUserId(false) == "laszip encoded" && vlr.GetRecordId() == 22204) {
+      const std::vector<uint8_t>& data = vlr.GetData();
+      configured = !data.empty() && zip->unpack(&data[0], static_cast<int>(data.size()));
+      break;
+    }
+  }
+  if (!configured || zip->chunk_size == 0 || zip->chunk_size == UINT32_MAX) {
+    throw std::runtime_error("Output header has no usable LASzip VLR");
+  }
+  chunkPoints = zip->chunk_size;
+
+  size_t offset = 0;
+  for (unsigned short i = 0; i < zip->num_items; ++i) {
+    itemOffsets.push_back(offset);
+    offset += zip->items[i].size;
+  }
+  if (offset != recordLength) {
+    throw std::runtime_error("LASzip items do not match the point record length");
+  }
+
+  // Placeholder for the chunk table position, patched in close()
+  tablePointerPos = os.tellp();
+  putLE64(os, -1);
+
+  for (int t = 0; t < (threads > 0 ? threads : 1); ++t) {
+    pool.push_back(std::thread(&LazChunkSink::worker, this));
+  }
+}
+
+LazChunkSink::~LazChunkSink() {
+  {
+    std::lock_guard<std::mutex> lock(m);
+    stopping = true;
+    workAvailable.notify_all();
+  }
+  for (auto& th : pool) {
+    th.join();
+  }
+}
+
+void LazChunkSink::worker() {
+  std::vector<const unsigned char*> items(itemOffsets.size());
+  for (;;) {
+    std::shared_ptr<Chunk> chunk;
+    {
+      std::unique_lock<std::mutex> lock(m);
+      workAvailable.wait(lock, [&] { return stopping || !pending.empty(); });
+      if (pending.empty()) {
+        return;
+      }
+      chunk = pending.front();
+      pending.pop_front();
+    }
+
+    // Compress the chunk as a one-chunk LAZ stream and keep just the chunk
+    // bytes, between the leading table pointer and the trailing table.
+    // LASzip only treats a stream as seekable (and records where the table
+    // went) when it is not at offset 0, so the stream starts with padding.
+    std::string        failure;
+    std::ostringstream out(std::ios::out | std::ios::binary);
+    LASzipper          zipper;
+    putLE64(out, 0);
+    if (!zipper.open(out, zip.get())) {
+      failure = "Cannot initialize LASzip compressor";
+    } else {
+      const unsigned char* base = reinterpret_cast<const unsigned char*>(chunk->records.data());
+      for (size_t i = 0; i < chunk->count && failure.empty(); ++i, base += recordLength) {
+        for (size_t j = 0; j < itemOffsets.size(); ++j) {
+          items[j] = base + itemOffsets[j];
+        }
+        if (!zipper.write(&items[0])) {
+          failure = "LASzip failed to compress a point";
+        }
+      }
+      if (!zipper.close() && failure.empty()) {
+        failure = "LASzip failed to finish a chunk";
+      }
+    }
+
+    // The table LASzip appended must be the version 0, one chunk table the
+    // pointer names; anything else means the layout is not the expected one.
+    std::string bytes = out.str();
+    int64_t     table = bytes.size() >= kChunkStart ? getLE64(bytes, 8) : -1;
+    if (failure.empty() && (table < static_cast<int64_t>(kChunkStart) ||
+                            table + 8 > static_cast<int64_t>(bytes.size()) ||
+                            getLE64(bytes, static_cast<size_t>(table)) != (static_cast<int64_t>(1) << 32))) {
+      failure = "Unexpected LASzip chunk layout";
+    }
+
+    std::lock_guard<std::mutex> lock(m);
+    if (failure.empty()) {
+      chunk->compressed = bytes.substr(kChunkStart, static_cast<size_t>(table) - kChunkStart);
+    } else if (error.empty()) {
+      error = failure;
+    }
+    chunk->records.clear();
+    chunk->records.shrink_to_fit();
+    chunk->done = true;
+    chunkDone.notify_all();
+  }
+}
+
+void LazChunkSink::write(const char* records, size_t count, size_t length) {
+  if (length != recordLength) {
+    throw std::runtime_error("Record length does not match the LAZ header");
+  }
+  while (count > 0) {
+    if (!filling) {
+      filling.reset(new Chunk());
+      filling->count = 0;
+      filling->done  = false;
+      filling->records.reserve(chunkPoints * recordLength);
+    }
+    size_t take = std::min(count, chunkPoints - filling->count);
+    filling->records.insert(filling->records.end(), records, records + take * recordLength);
+    filling->count += take;
+    records += take * recordLength;
+    count -= take;
+    if (filling->count == chunkPoints) {
+      submit();
+    }
+  }
+}
+
+void LazChunkSink::submit() {
+  if (!filling || filling->count == 0) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(m);
+    // Back-pressure: keep at most maxInFlight chunks buffered
+    chunkDone.wait(lock, [&] { return inFlight.size() < maxInFlight || inFlight.front()->done || !error.empty(); });
+  }
+  writeFinished(false);
+
+  std::lock_guard<std::mutex> lock(m);
+  inFlight.push_back(filling);
+  pending.push_back(filling);
+  filling.reset();
+  workAvailable.notify_one();
+}
+
+// Writes completed chunks from the front of the queue, in order.
+void LazChunkSink::writeFinished(bool wait) {
+  for (;;) {
+    std::shared_ptr<Chunk> chunk;
+    {
+      std::unique_lock<std::mutex> lock(m);
+      if (wait) {
+        chunkDone.wait(lock, [&] { return inFlight.empty() || inFlight.front()->done || !error.empty(); });
+      }
+      if (!error.empty()) {
+        throw std::runtime_error(error);
+      }
+      if (inFlight.empty() || !inFlight.front()->done) {
+        return;
+      }
+      chunk = inFlight.front();
+      inFlight.pop_front();
+    }
+    os.write(chunk->compressed.data(), static_cast<std::streamsize>(chunk->compressed.size()));
+    if (!os.good()) {
+      throw std::runtime_error("Failed to write LAZ chunk");
+    }
+    chunkBytes.push_back(static_cast<uint32_t>(chunk->compressed.size()));
+  }
+}
+
+void LazChunkSink::close() {
+  if (closed) {
+    return;
+  }
+  closed = true;
+  submit();
+  writeFinished(true);
+
+  // Same layout LASwritePoint::write_chunk_table() produces for fixed-size chunks
+  std::streamoff tablePos = os.tellp();
+  os.seekp(tablePointerPos);
+  putLE64(os, static_cast<int64_t>(tablePos));
+  os.seekp(tablePos);
+
+  U32 version = 0;
+  U32 number  = static_cast<U32>(chunkBytes.size());
+  os.write(reinterpret_cast<const char*>(&version), 4);
+  os.write(reinterpret_cast<const char*>(&number), 4);
+  if (number > 0) {
+    ByteStreamOutOstreamLE stream(os);
+    ArithmeticEncoder      enc;
+    enc.init(&stream);
+    IntegerCompressor ic(&enc, 32, 2);
+    ic.initCompressor();
+    for (U32 i = 0; i < number; ++i) {
+      ic.compress(i ? static_cast<I32>(chunkBytes[i - 1]) : 0, static_cast<I32>(chunkBytes[i]), 1);
+    }
+    enc.done();
+  }
+  if (!os.good()) {
+    throw std::runtime_error("Failed to write LAZ chunk table");
+  }
+}
+
+#else
+
+bool parallelLazAvailable() {
+  return false;
+}
+
+LazChunkSink::LazChunkSink(std::ostream& os, const liblas::Header&, int)
+    : os(os), recordLength(0), chunkPoints(0), maxInFlight(0), tablePointerPos(0), stopping(false), closed(true) {
+  throw std::runtime_error("Parallel LAZ compression is not available in this build");
+}
+
+LazChunkSink::~LazChunkSink() {}
+
+void LazChunkSink::worker() {}
+void LazChunkSink::write(const char*, size_t, size_t) {}
+void LazChunkSink::submit() {}
+void LazChunkSink::writeFinished(bool) {}
+void LazChunkSink::close() {}
+
+#endif
@@ -0,0 +1,209 @@
+#include "MultiInput.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include "InputProcessor.hpp"
+#include "ParallelChunks.hpp"
+#include "SpscQueue.hpp"
+
+namespace {
+  // Points per batch handed from a file worker to the writer, and batches
+  // queued per file before its worker blocks
+  const size_t kFileBatchPoints = 65536;
+  const size_t kFileQueueDepth  = 4;
+
+  bool processSequentially(const std::vector<std::string>& filenames, PointCollector& pc,
+                           std::string& srsWKT, std::string& failedInput) {
+    for (const auto& filename : filenames) {
+      std::cout << "Processing " << filename << std::endl;
+      if (!processInput(filename, pc, srsWKT)) {
+        failedInput = filename;
+        return false;
+      }
+      std::cout << std::endl;
+    }
+    return true;
+  }
+
+  // The spatial reference of the last input carrying one, as a sequential run would leave it.
+  void pickSrs(const std::vector<std::string>& fileSrs, std::string& srsWKT) {
+    for (size_t i = fileSrs.size(); i-- > 0;) {
+      if (!fileSrs[i].empty()) {
+        srsWKT = fileSrs[i];
+        return;
+      }
+    }
+  }
+
+  bool scanConcurrently(const std::vector<std::string>& filenames, PointCollector& pc, int workers,
+                        int innerThreads, std::string& srsWKT, std::string& failedInput) {
+    std::vector<PointCollector> locals(workers);
+    std::vector<ZHistogram>     localZ(workers, ZHistogram(pc.zHistogram ? pc.zHistogram->relativeError : 0.001));
+    for (int t = 0; t < workers; ++t) {
+      locals[t].quiet       = true;
+      locals[t].colorize    = pc.colorize;
+      locals[t].zHistogram  = pc.zHistogram ? &localZ[t] : nullptr;
+      locals[t].threads     = innerThreads;
+      locals[t].columns     = pc.columns;
+      locals[t].inputEngine = pc.inputEngine;
+      locals[t].directIO    = pc.directIO;
+    }
+
+    std::vector<std::string> fileSrs(filenames.size());
+    std::vector<char>        ok(filenames.size(), 1);
+    std::atomic<size_t>      done(0);
+    std::atomic<bool>        failed(false);
+    parallelFor(filenames.size(), workers, [&](size_t i, int worker) {
+      if (failed) {
+        return;
+      }
+      if (!processInput(filenames[i], locals[worker], fileSrs[i])) {
+        ok[i]  = 0;
+        failed = true;
+      }
+      size_t finished = ++done;
+      if (!pc.quiet && worker == 0) {
+        std::cout << "\rScanned files: " << finished << " / " << filenames.size() << "   " << std::flush;
+      }
+    });
+    if (!pc.quiet) {
+      std::cout << "\rScanned files: " << filenames.size() << " / " << filenames.size() << "   " << std::endl;
+    }
+
+    for (size_t i = 0; i < filenames.size(); ++i) {
+      if (!ok[i]) {
+        failedInput = filenames[i];
+        return false;
+      }
+    }
+    for (int t = 0; t < workers; ++t) {
+      pc.merge(locals[t]);
+    }
+    pickSrs(fileSrs, srsWKT);
+    return true;
+  }
+
+  // Parse side of one input in the write pass.
+  struct FileStream {
+    SpscQueue<PointBatch> queue;
+    std::string           srsWKT;
+    bool                  ok;
+    std::exception_ptr    error;
+
+    FileStream() : queue(kFileQueueDepth), ok(true) {}
+  };
+
+  bool writeConcurrently(const std::vector<std::string>& filenames, PointCollector& pc, int workers,
+                         int innerThreads, std::string& srsWKT, std::string& failedInput) {
+    std::vector<std::unique_ptr<FileStream>> files;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+      files.push_back(std::unique_ptr<FileStream>(new FileStream()));
+    }
+
+    // Files are claimed in input order, so the file the writer waits on always
+    // has a worker and the bounded queues cannot deadlock.
+    std::atomic<size_t> next(0);
+    std::atomic<bool>   cancel(false);
+    auto worker = [&]() {
+      size_t i;
+      while (!cancel && (i = next++) < filenames.size()) {
+        FileStream&    file = *files[i];
+        PointCollector producer;
+        producer.quiet       = true;
+        producer.threads     = innerThreads;
+        producer.ordered     = pc.ordered;
+        producer.columns     = pc.columns;
+        producer.inputEngine = pc.inputEngine;
+        producer.directIO    = pc.directIO;
+        producer.deferLimit  = kFileBatchPoints;
+        producer.batchSink   = [&](PointBatch& batch) {
+          PointBatch full;
+          full.swap(batch);
+          batch.xyz.reserve(kFileBatchPoints * 3);
+          if (!file.queue.push(full, cancel)) {
+            throw std::runtime_error("cancelled");
+          }
+        };
+        try {
+          file.ok = processInput(filenames[i], producer, file.srsWKT);
+          producer.flush();
+        } catch (...) {
+          file.ok = false;
+          if (!cancel) {
+            file.error = std::current_exception();
+          }
+        }
+        file.queue.close();
+      }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < workers; ++t) {
+      pool.push_back(std::thread(worker));
+    }
+
+    bool               ok = true;
+    std::exception_ptr error;
+    try {
+      PointBatch batch;
+      for (size_t i = 0; i < filenames.size() && ok; ++i) {
+        FileStream& file = *files[i];
+        while (file.queue.pop(batch)) {
+          // The producer records the file's SRS before its first batch
+          if (!file.srsWKT.empty()) {
+            srsWKT = file.srsWKT;
+          }
+          pc.addBatch(batch);
+        }
+        if (!file.srsWKT.empty()) {
+          srsWKT = file.srsWKT;
+        }
+        if (file.error) {
+          std::rethrow_exception(file.error);
+        }
+        if (!file.ok) {
+          failedInput = filenames[i];
+          ok          = false;
+        }
+        files[i].reset();
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    cancel = true;
+    for (auto& th : pool) {
+      th.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    if (!pc.quiet) {
+      std::cout << std::endl;
+    }
+    return ok;
+  }
+} // namespace
+
+bool processInputs(const std::vector<std::string>& filenames, PointCollector& pc,
+                   std::string& srsWKT, std::string& failedInput) {
+  int threads = resolveThreadCount(pc.threads);
+  int workers = static_cast<int>(std::min<size_t>(threads, filenames.size()));
+  if (workers <= 1) {
+    return processSequentially(filenames, pc, srsWKT, failedInput);
+  }
+
+  // Whole files are the unit of parallelism; leftover cores parse within a file
+  int innerThreads = std::max(1, threads / workers);
+  if (!pc.quiet) {
+    std::cout << "Processing " << filenames.size() << " inputs on " << workers << " threads" << std::endl;
+  }
+  if (!pc.isWriting()) {
+    return scanConcurrently(filenames, pc, workers, innerThreads, srsWKT, failedInput);
+  }
+  return writeConcurrently(filenames, pc, workers, innerThreads, srsWKT, failedInput);
+}
@@ -0,0 +1,174 @@
+#include "ParallelChunks.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+int resolveThreadCount(int requested) {
+  if (requested > 0) {
+    return requested;
+  }
+  unsigned int hw = std::thread::hardware_concurrency();
+  return hw > 0 ? static_cast<int>(hw) : 1;
+}
+
+void parallelFor(size_t chunkCount, int threads, const std::function<void(size_t, int)>& fn) {
+  if (threads <= 1 || chunkCount <= 1) {
+    for (size_t i = 0; i < chunkCount; ++i) {
+      fn(i, 0);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  std::atomic<bool>   failed(false);
+  std::exception_ptr  error;
+  std::mutex          errorMutex;
+
+  auto worker = [&](int workerIndex) {
+    try {
+      size_t i;
+      while (!failed && (i = next++) < chunkCount) {
+        fn(i, workerIndex);
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(errorMutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      failed = true;
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; ++t) {
+    pool.push_back(std::thread(worker, t));
+  }
+  worker(0);
+  for (auto& th : pool) {
+    th.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void parallelBatches(size_t chunkCount, int threads, bool ordered,
+                     const std::function<void(size_t, PointBatch&)>& produce,
+                     const std::function<void(size_t, PointBatch&)>& consume) {
+  if (threads <= 1 || chunkCount <= 1) {
+    PointBatch batch;
+    for (size_t i = 0; i < chunkCount; ++i) {
+      batch.clear();
+      produce(i, batch);
+      consume(i, batch);
+    }
+    return;
+  }
+
+  const size_t            window = static_cast<size_t>(threads) * 2;
+  std::vector<PointBatch> slots(window);
+  std::vector<size_t>     freeSlots;
+  for (size_t s = 0; s < window; ++s) {
+    freeSlots.push_back(s);
+  }
+  std::vector<long>  slotOf(chunkCount, -1); // ordered: slot holding a finished chunk
+  std::deque<size_t> ready;                  // unordered: finished chunk indices
+  size_t             next     = 0;
+  bool               stop     = false;
+  std::exception_ptr error;
+
+  std::mutex              m;
+  std::condition_variable workAvailable, batchReady;
+
+  auto worker = [&]() {
+    for (;;) {
+      size_t chunk, slot;
+      {
+        std::unique_lock<std::mutex> lock(m);
+        workAvailable.wait(lock, [&] { return stop || next >= chunkCount || !freeSlots.empty(); });
+        if (stop || next >= chunkCount) {
+          return;
+        }
+        chunk = next++;
+        slot  = freeSlots.back();
+        freeSlots.pop_back();
+      }
+      try {
+        slots[slot].clear();
+        produce(chunk, slots[slot]);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(m);
+        if (!error) {
+          error = std::current_exception();
+        }
+        stop = true;
+        workAvailable.notify_all();
+        batchReady.notify_all();
+        return;
+      }
+      std::lock_guard<std::mutex> lock(m);
+      slotOf[chunk] = static_cast<long>(slot);
+      if (!ordered) {
+        ready.push_back(chunk);
+      }
+      batchReady.notify_all();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.push_back(std::thread(worker));
+  }
+
+  try {
+    for (size_t consumed = 0; consumed < chunkCount; ++consumed) {
+      size_t chunk;
+      {
+        std::unique_lock<std::mutex> lock(m);
+        if (ordered) {
+          batchReady.wait(lock, [&] { return stop || slotOf[consumed] >= 0; });
+        } else {
+          batchReady.wait(lock, [&] { return stop || !ready.empty(); });
+        }
+        if (stop) {
+          break;
+        }
+        if (ordered) {
+          chunk = consumed;
+        } else {
+          chunk = ready.front();
+          ready.pop_front();
+        }
+      }
+      size_t slot = static_cast<size_t>(slotOf[chunk]);
+      consume(chunk, slots[slot]);
+
+      std::lock_guard<std::mutex> lock(m);
+      freeSlots.push_back(slot);
+      workAvailable.notify_one();
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(m);
+    if (!error) {
+      error = std::current_exception();
+    }
+    stop = true;
+    workAvailable.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m);
+    stop = true;
+    workAvailable.notify_all();
+  }
+  for (auto& th : pool) {
+    th.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -1,9 +1,148 @@
 #include "PointCollector.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "LasEncoder.hpp"
+#include "PointPipeline.hpp"
+
+// Policy-templated batch kernels. Each configuration question (histogram or
+// not, where points go, color ramp or not, RGB or time fields or not) is a template
+// parameter, answered once by specialize(); the instantiated loops only do
+// the work that configuration needs.
+struct CollectorKernels {
+  // Bounds and count; the min/max loop has no other work and vectorizes.
+  template <bool kHistogram>
+  static void accumulate(PointCollector& pc, const double* xyz, const PointAttributes*, size_t n) {
+    double lo[3] = {pc.minX, pc.minY, pc.minZ};
+    double hi[3] = {pc.maxX, pc.maxY, pc.maxZ};
+    for (size_t i = 0; i < n; ++i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        double v = xyz[i * 3 + axis];
+        lo[axis] = v < lo[axis] ? v : lo[axis];
+        hi[axis] = v > hi[axis] ? v : hi[axis];
+      }
+    }
+    pc.minX = lo[0];
+    pc.minY = lo[1];
+    pc.minZ = lo[2];
+    pc.maxX = hi[0];
+    pc.maxY = hi[1];
+    pc.maxZ = hi[2];
+    pc.count += n;
+    if (kHistogram) {
+      for (size_t i = 0; i < n; ++i) {
+        pc.zHistogram->add(xyz[i * 3 + 2]);
+      }
+    }
+  }
+
+  // Output policies for emit
+  static void scanOnly(PointCollector&, const double*, const PointAttributes*, size_t) {}
+
+  static void toPipeline(PointCollector& pc, const double* xyz, const PointAttributes* attrs, size_t n) {
+    if (attrs) {
+      for (size_t i = 0; i < n; ++i) {
+        pc.pipeline->add(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2], attrs[i]);
+      }
+      return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      pc.pipeline->add(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2]);
+    }
+  }
+
+  // Fills the deferred batch `deferLimit` points at a time. A flush may open
+  // the output (single-pass), in which case the rest goes to the kernels
+  // LasOutput::attach selected.
+  static void toDeferred(PointCollector& pc, const double* xyz, const PointAttributes* attrs, size_t n) {
+    while (n > 0) {
+      size_t room = pc.deferLimit > pc.deferred.size() ? pc.deferLimit - pc.deferred.size() : 1;
+      size_t take = std::min(n, room);
+      pc.deferred.append(xyz, attrs, take);
+      xyz += take * 3;
+      attrs = attrs ? attrs + take : nullptr;
+      n -= take;
+      if (pc.deferred.size() >= pc.deferLimit) {
+        pc.flush();
+        if (pc.hasOutput() && n > 0) {
+          pc.emit(pc, xyz, attrs, n);
+          return;
+        }
+      }
+    }
+  }
+
+  // Encode policies: the native encoder for a known format and color mode,
+  // or liblas point by point
+  template <bool kRgb, bool kRamp>
+  static void toEncoder(PointCollector& pc, const double* xyz, const PointAttributes*, size_t n) {
+    LasPointEncoder& encoder = *pc.encoder;
+    for (size_t i = 0; i < n; ++i) {
+      uint16_t val = 0;
+      if (kRamp) {
+        val = ramp(pc, xyz[i * 3 + 2]);
+      }
+      encoder.put<kRgb>(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2], val, val, val);
+    }
+  }
+
+  // Same for --columns input: every point carries attributes, zeroed for
+  // batches without (e.g. GDAL inputs mixed in), so no stale fields remain in
+  // the encoder's reused record buffer.
+  template <bool kRgb, bool kTime, bool kRamp>
+  static void toEncoderWithAttributes(PointCollector& pc, const double* xyz, const PointAttributes* attrs, size_t n) {
+    static const PointAttributes none;
+    LasPointEncoder&       encoder = *pc.encoder;
+    const PointAttributes* a       = attrs ? attrs : &none;
+    size_t                 step    = attrs ? 1 : 0;
+    for (size_t i = 0; i < n; ++i, a += step) {
+      uint16_t rgb[3] = {a->rgb[0], a->rgb[1], a->rgb[2]};
+      if (kRamp) {
+        rgb[0] = rgb[1] = rgb[2] = ramp(pc, xyz[i * 3 + 2]);
+      }
+      encoder.put<kRgb, kTime>(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2], *a, rgb);
+    }
+  }
+
+  static void toWriter(PointCollector& pc, const double* xyz, const PointAttributes* attrs, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      pc.writePoint(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2], attrs ? &attrs[i] : nullptr);
+    }
+  }
+
+  static uint16_t ramp(const PointCollector& pc, double z) {
+    double normZ = std::min(std::max((z - pc.colorMinZ) * pc.zFactor, 0.0), 1.0);
+    return static_cast<uint16_t>(normZ * 65535.0);
+  }
+
+  template <bool kTime>
+  static PointCollector::BatchKernel attributesEncoderFor(bool rgb, bool colorize) {
+    if (colorize) {
+      return &toEncoderWithAttributes<true, kTime, true>;
+    }
+    return rgb ? &toEncoderWithAttributes<true, kTime, false> : &toEncoderWithAttributes<false, kTime, false>;
+  }
+
+  static PointCollector::BatchKernel encoderFor(const PointCollector& pc) {
+    if (!pc.encoder) {
+      return &toWriter;
+    }
+    bool rgb = pc.encoder->hasColor;
+    if (pc.columns && pc.columns->hasAttributes()) {
+      return pc.encoder->hasTime ? attributesEncoderFor<true>(rgb, pc.colorize && rgb)
+                                 : attributesEncoderFor<false>(rgb, pc.colorize && rgb);
+    }
+    if (pc.colorize) {
+      return rgb ? &toEncoder<true, true> : &toEncoder<false, true>;
+    }
+    return rgb ? &toEncoder<true, false> : &toEncoder<false, false>;
+  }
+};
 
 PointCollector::PointCollector() : minX(DBL_MAX), minY(DBL_MAX), minZ(DBL_MAX),
                      maxX(-DBL_MAX), maxY(-DBL_MAX), maxZ(-DBL_MAX),
-                     count(0), colorize(false), zValues(nullptr),
-                     header(nullptr), writer(nullptr), colorMinZ(0), zFactor(0), totalPoints(0), reusablePoint(nullptr), quiet(false) {}
+                     count(0), colorize(false), zHistogram(nullptr),
+                     header(nullptr), writer(nullptr), encoder(nullptr), pipeline(nullptr), colorMinZ(0), zFactor(0), totalPoints(0), reusablePoint(nullptr), quiet(false), progress(nullptr),
+                     threads(1), ordered(true), columns(nullptr), inputEngine(kInputEngineMmap), directIO(false), deferLimit(65536), accumulate(nullptr), emit(nullptr), encode(nullptr) {}
 
 PointCollector::~PointCollector() {
   if (reusablePoint) {
@@ -11,7 +150,27 @@ PointCollector::~PointCollector() {
   }
 }
 
+void PointBatch::append(const double* points, const PointAttributes* attrs, size_t n) {
+  if (attrs || !attributes.empty()) {
+    attributes.resize(size());
+    if (attrs) {
+      attributes.insert(attributes.end(), attrs, attrs + n);
+    } else {
+      attributes.resize(size() + n);
+    }
+  }
+  xyz.insert(xyz.end(), points, points + n * 3);
+}
+
 void PointCollector::addPoint(double x, double y, double z) {
+  collect(x, y, z, nullptr);
+}
+
+void PointCollector::addPoint(double x, double y, double z, const PointAttributes& a) {
+  collect(x, y, z, &a);
+}
+
+void PointCollector::collect(double x, double y, double z, const PointAttributes* a) {
   if (x < minX) minX = x;
   if (x > maxX) maxX = x;
   if (y < minY) minY = y;
@@ -20,32 +179,157 @@ void PointCollector::addPoint(double x, double y, double z) {
   if (z > maxZ) maxZ = z;
   count++;
 
-  if (!quiet && count % 100000 == 0) {
-    if (totalPoints > 0) {
-      int percent = static_cast<int>((count * 100.0) / totalPoints);
-      std::cout << "\rWriting points: " << count << " / " << totalPoints << " (" << percent << "%)   " << std::flush;
+  if (progress) {
+    progress->store(static_cast<long>(count), std::memory_order_relaxed);
+  }
+
+  if (colorize && zHistogram) {
+    zHistogram->add(z);
+  }
+
+  if (hasOutput()) {
+    emitPoint(x, y, z, a);
+  } else if (openWriter || batchSink) {
+    if (a) {
+      deferred.addPoint(x, y, z, *a);
+    } else {
+      deferred.addPoint(x, y, z);
+    }
+    if (deferred.size() >= deferLimit) {
+      flush();
+    }
+  }
+}
+
+void PointCollector::flush() {
+  if (deferred.empty()) {
+    return;
+  }
+  if (batchSink) {
+    batchSink(deferred);
+    deferred.clear();
+    return;
+  }
+  if (!hasOutput() && openWriter) {
+    openWriter(*this);
+  }
+  if (hasOutput()) {
+    const std::vector<double>& xyz   = deferred.xyz;
+    const PointAttributes*     attrs = deferred.attributesData();
+    for (size_t i = 0; i < xyz.size(); i += 3) {
+      emitPoint(xyz[i], xyz[i + 1], xyz[i + 2], attrs ? &attrs[i / 3] : nullptr);
     }
   }
+  deferred.clear();
+  deferred.xyz.shrink_to_fit();
+  deferred.attributes.shrink_to_fit();
+}
+
+void PointCollector::specialize() {
+  accumulate = colorize && zHistogram ? &CollectorKernels::accumulate<true> : &CollectorKernels::accumulate<false>;
+  encode     = hasOutput() ? CollectorKernels::encoderFor(*this) : nullptr;
+  if (hasOutput()) {
+    emit = pipeline ? &CollectorKernels::toPipeline : encode;
+  } else if (openWriter || batchSink) {
+    emit = &CollectorKernels::toDeferred;
+  } else {
+    emit = &CollectorKernels::scanOnly;
+  }
+}
+
+void PointCollector::addBatch(const PointBatch& batch) {
+  if (batch.empty()) {
+    return;
+  }
+  if (!accumulate) {
+    specialize();
+  }
+  accumulate(*this, &batch.xyz[0], nullptr, batch.size());
+  if (progress) {
+    progress->store(static_cast<long>(count), std::memory_order_relaxed);
+  }
+  emit(*this, &batch.xyz[0], batch.attributesData(), batch.size());
+}
+
+void PointCollector::writeBatch(const PointBatch& batch) {
+  if (batch.empty()) {
+    return;
+  }
+  // Runs on the pipeline thread, which must not select kernels itself
+  if (!encode) {
+    throw std::logic_error("PointCollector::specialize() must run before points reach the pipeline");
+  }
+  encode(*this, &batch.xyz[0], batch.attributesData(), batch.size());
+}
 
-  if (colorize && zValues) {
-    zValues->push_back(z);
+void PointCollector::merge(const PointCollector& other) {
+  if (other.minX < minX) minX = other.minX;
+  if (other.maxX > maxX) maxX = other.maxX;
+  if (other.minY < minY) minY = other.minY;
+  if (other.maxY > maxY) maxY = other.maxY;
+  if (other.minZ < minZ) minZ = other.minZ;
+  if (other.maxZ > maxZ) maxZ = other.maxZ;
+  count += other.count;
+  if (progress) {
+    progress->store(static_cast<long>(count), std::memory_order_relaxed);
   }
 
-  if (writer && header) {
-    if (!reusablePoint) {
-      reusablePoint = new liblas::Point(header);
+  if (colorize && zHistogram && other.zHistogram && other.zHistogram != zHistogram) {
+    zHistogram->merge(*other.zHistogram);
+  }
+}
+
+void PointCollector::emitPoint(double x, double y, double z, const PointAttributes* a) {
+  if (pipeline) {
+    if (a) {
+      pipeline->add(x, y, z, *a);
+    } else {
+      pipeline->add(x, y, z);
     }
-    reusablePoint->SetCoordinates(x, y, z);
-    if (colorize) {
-      double normZ = (z - colorMinZ) * zFactor;
-      if (normZ < 0) normZ = 0;
-      if (normZ > 1) normZ = 1;
-      uint16_t      val = static_cast<uint16_t>(normZ * 65535.0);
-      liblas::Color c(val, val, val);
-      reusablePoint->SetColor(c);
+  } else {
+    writePoint(x, y, z, a);
+  }
+}
+
+void PointCollector::writePoint(double x, double y, double z, const PointAttributes* a) {
+  static const PointAttributes none;
+  if (!a && columns && columns->hasAttributes()) {
+    a = &none; // overwrite the attributes of the previous point
+  }
+
+  uint16_t val = 0;
+  if (colorize) {
+    double normZ = (z - colorMinZ) * zFactor;
+    if (normZ < 0) normZ = 0;
+    if (normZ > 1) normZ = 1;
+    val = static_cast<uint16_t>(normZ * 65535.0);
+  }
+
+  if (encoder) {
+    if (a) {
+      uint16_t rgb[3] = {a->rgb[0], a->rgb[1], a->rgb[2]};
+      if (colorize) {
+        rgb[0] = rgb[1] = rgb[2] = val;
+      }
+      encoder->add(x, y, z, *a, rgb);
+    } else {
+      encoder->add(x, y, z, val, val, val);
     }
-    writer->WritePoint(*reusablePoint);
+    return;
+  }
+
+  if (!reusablePoint) {
+    reusablePoint = new liblas::Point(header);
+  }
+  reusablePoint->SetCoordinates(x, y, z);
+  if (colorize) {
+    liblas::Color c(val, val, val);
+    reusablePoint->SetColor(c);
+  }
+  if (a) {
+    setPointAttributes(*reusablePoint, *a, static_cast<int>(header->GetDataFormatId()), !colorize);
   }
+  writer->WritePoint(*reusablePoint);
 }
 
 void PointCollector::processGeometry(OGRGeometry* g) {
@@ -0,0 +1,131 @@
+#include "PointPipeline.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+  // Slots of each of a stage's two rings (`full` and `empty`) so that both
+  // together stay within `maxBytes`. Rounded down to a power of two, which
+  // SpscQueue keeps as is; never fewer than the queue's minimum of two.
+  size_t slotsFor(size_t maxBytes, size_t itemBytes) {
+    size_t fit   = maxBytes / 2 / std::max<size_t>(1, itemBytes);
+    size_t slots = 2;
+    while (slots * 2 <= fit) {
+      slots <<= 1;
+    }
+    return slots;
+  }
+} // namespace
+
+PointPipeline::PointPipeline(PointCollector& pc, size_t maxBytes)
+    : pc(pc), full(slotsFor(maxBytes, batchBytes())), empty(slotsFor(maxBytes, batchBytes())),
+      failed(false), finished(false) {
+  staging.xyz.reserve(kPipelineBatchPoints * 3);
+  encoder = std::thread(&PointPipeline::run, this);
+}
+
+PointPipeline::~PointPipeline() {
+  if (!finished) {
+    full.close();
+    encoder.join();
+  }
+}
+
+void PointPipeline::submit() {
+  if (staging.empty()) {
+    return;
+  }
+  if (failed.load(std::memory_order_acquire)) {
+    // The encode stage has stopped; surface its error on the parse side
+    std::rethrow_exception(error);
+  }
+  full.push(staging);
+  if (!empty.tryPop(staging)) {
+    staging = PointBatch();
+    staging.xyz.reserve(kPipelineBatchPoints * 3);
+  }
+  staging.clear();
+}
+
+void PointPipeline::finish() {
+  if (finished) {
+    return;
+  }
+  if (!failed.load(std::memory_order_acquire)) {
+    submit();
+  }
+  finished = true;
+  full.close();
+  encoder.join();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void PointPipeline::run() {
+  PointBatch batch;
+  while (full.pop(batch)) {
+    if (!failed.load(std::memory_order_relaxed)) {
+      try {
+        pc.writeBatch(batch);
+      } catch (...) {
+        error = std::current_exception();
+        failed.store(true, std::memory_order_release);
+      }
+    }
+    // Keep draining after a failure so the producer never blocks
+    batch.clear();
+    empty.tryPush(batch);
+  }
+}
+
+AsyncSink::AsyncSink(RecordSink& downstream, size_t maxBytes, size_t bufferBytes)
+    : downstream(downstream), recordLength(0), bufferBytes(bufferBytes), full(slotsFor(maxBytes, bufferBytes)),
+      empty(slotsFor(maxBytes, bufferBytes)), failed(false), closed(false) {
+  writer = std::thread(&AsyncSink::run, this);
+}
+
+AsyncSink::~AsyncSink() {
+  if (!closed) {
+    full.close();
+    writer.join();
+  }
+}
+
+void AsyncSink::write(const char* records, size_t count, size_t length) {
+  if (failed.load(std::memory_order_acquire)) {
+    std::rethrow_exception(error);
+  }
+  recordLength = length;
+  std::vector<char> buffer;
+  empty.tryPop(buffer);
+  buffer.assign(records, records + count * length);
+  full.push(buffer);
+}
+
+void AsyncSink::close() {
+  if (closed) {
+    return;
+  }
+  closed = true;
+  full.close();
+  writer.join();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  downstream.close();
+}
+
+void AsyncSink::run() {
+  std::vector<char> buffer;
+  while (full.pop(buffer)) {
+    if (!failed.load(std::memory_order_relaxed) && !buffer.empty()) {
+      try {
+        downstream.write(&buffer[0], buffer.size() / recordLength, recordLength);
+      } catch (...) {
+        error = std::current_exception();
+        failed.store(true, std::memory_order_release);
+      }
+    }
+    empty.tryPush(buffer);
+  }
+}
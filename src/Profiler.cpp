@@ -0,0 +1,247 @@
+#include "Profiler.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+#if defined(__linux__)
+  int openCounter(uint64_t config) {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.disabled       = 1;
+    attr.inherit        = 1; // threads started later count once they exit
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+#endif
+
+  std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+      }
+      out += c;
+    }
+    return out + "\"";
+  }
+} // namespace
+
+Profiler::Profiler(bool enabled) : on(enabled), hasCounters(false) {
+  for (int& fd : counterFds) {
+    fd = -1;
+  }
+#if defined(__linux__)
+  if (!on) {
+    return;
+  }
+  const uint64_t configs[3] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+  hasCounters = true;
+  for (int i = 0; i < 3; ++i) {
+    counterFds[i] = openCounter(configs[i]);
+    hasCounters   = hasCounters && counterFds[i] >= 0;
+  }
+  for (int fd : counterFds) {
+    if (fd >= 0 && hasCounters) {
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+}
+
+Profiler::~Profiler() {
+#if defined(__unix__) || defined(__APPLE__)
+  for (int fd : counterFds) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+void Profiler::sample(Sample& s) const {
+  s.wall        = std::chrono::steady_clock::now();
+  s.cpuSeconds  = static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+  s.minorFaults = 0;
+  s.majorFaults = 0;
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    s.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec +
+                   usage.ru_stime.tv_usec * 1e-6;
+    s.minorFaults = usage.ru_minflt;
+    s.majorFaults = usage.ru_majflt;
+  }
+#endif
+}
+
+bool Profiler::runCounters(RunCounters& counters) const {
+  uint64_t values[3] = {0, 0, 0};
+  if (!hasCounters) {
+    return false;
+  }
+#if defined(__unix__) || defined(__APPLE__)
+  for (int i = 0; i < 3; ++i) {
+    if (read(counterFds[i], &values[i], sizeof(uint64_t)) != sizeof(uint64_t)) {
+      return false;
+    }
+  }
+#endif
+  counters.cycles       = values[0];
+  counters.instructions = values[1];
+  counters.cacheMisses  = values[2];
+  return true;
+}
+
+void Profiler::begin(const std::string& phase) {
+  if (!on) {
+    return;
+  }
+  current = phase;
+  sample(start);
+}
+
+void Profiler::end(uint64_t points, uint64_t inputBytes, uint64_t outputBytes) {
+  if (!on) {
+    return;
+  }
+  Sample finish;
+  sample(finish);
+  PhaseStats p;
+  p.name         = current;
+  p.wallSeconds  = std::chrono::duration<double>(finish.wall - start.wall).count();
+  p.cpuSeconds   = finish.cpuSeconds - start.cpuSeconds;
+  p.points       = points;
+  p.inputBytes   = inputBytes;
+  p.outputBytes  = outputBytes;
+  p.minorFaults  = finish.minorFaults - start.minorFaults;
+  p.majorFaults  = finish.majorFaults - start.majorFaults;
+  done.push_back(p);
+}
+
+double Profiler::peakRssMB() const {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // KiB
+#endif
+  }
+#endif
+  return 0.0;
+}
+
+void Profiler::printTable(std::ostream& out) const {
+  std::ostringstream t;
+  t << std::fixed << std::setprecision(2);
+  t << std::left << std::setw(12) << "phase" << std::right << std::setw(10) << "wall s" << std::setw(10) << "cpu s"
+    << std::setw(14) << "points" << std::setw(12) << "Mpts/s" << std::setw(10) << "in MB" << std::setw(10) << "out MB"
+    << std::setw(10) << "minflt" << std::setw(8) << "majflt" << "\n";
+  for (const PhaseStats& p : done) {
+    double wall = p.wallSeconds > 0.0 ? p.wallSeconds : 1e-9;
+    t << std::left << std::setw(12) << p.name << std::right << std::setw(10) << p.wallSeconds << std::setw(10)
+      << p.cpuSeconds << std::setw(14) << p.points << std::setw(12) << p.points / wall / 1e6 << std::setw(10)
+      << p.inputBytes / (1024.0 * 1024.0) << std::setw(10) << p.outputBytes / (1024.0 * 1024.0) << std::setw(10)
+      << p.minorFaults << std::setw(8) << p.majorFaults << "\n";
+  }
+  t << "Peak RSS: " << peakRssMB() << " MB";
+  RunCounters run;
+  if (runCounters(run)) {
+    t << "\nWhole run: IPC " << (run.cycles ? static_cast<double>(run.instructions) / run.cycles : 0.0) << ", "
+      << run.cacheMisses << " cache misses";
+  } else {
+    t << " (hardware counters unavailable)";
+  }
+  out << t.str() << std::endl;
+}
+
+bool Profiler::writeJson(const std::string& path) const {
+  std::ofstream out(path);
+  if (!out.is_open()) {
+    return false;
+  }
+  out << std::setprecision(9);
+  out << "{\n  \"peak_rss_mb\": " << peakRssMB() << ",\n  \"run_counters\": ";
+  RunCounters run;
+  if (runCounters(run)) {
+    out << "{\"cycles\": " << run.cycles << ", \"instructions\": " << run.instructions
+        << ", \"cache_misses\": " << run.cacheMisses << "}";
+  } else {
+    out << "null";
+  }
+  out << ",\n  \"phases\": [";
+  for (size_t i = 0; i < done.size(); ++i) {
+    const PhaseStats& p = done[i];
+    out << (i ? ",\n" : "\n") << "    {\"name\": " << jsonString(p.name) << ", \"wall_seconds\": " << p.wallSeconds
+        << ", \"cpu_seconds\": " << p.cpuSeconds << ", \"points\": " << p.points
+        << ", \"input_bytes\": " << p.inputBytes << ", \"output_bytes\": " << p.outputBytes
+        << ", \"minor_faults\": " << p.minorFaults << ", \"major_faults\": " << p.majorFaults << "}";
+  }
+  out << "\n  ]\n}\n";
+  return static_cast<bool>(out);
+}
+
+ProgressReporter::ProgressReporter(const std::string& label, long total, const std::atomic<long>& counter,
+                                   std::chrono::milliseconds interval)
+    : label(label), total(total), counter(counter), interval(interval), stopping(false) {
+  thread = std::thread(&ProgressReporter::run, this);
+}
+
+ProgressReporter::~ProgressReporter() {
+  stop();
+}
+
+void ProgressReporter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+    // The final count ends the progress line
+    print(counter.load(std::memory_order_relaxed));
+    std::cout << std::endl;
+  }
+}
+
+void ProgressReporter::print(long value) const {
+  std::ostringstream line;
+  line << "\r" << label << ": " << value;
+  if (total > 0) {
+    line << " / " << total << " (" << static_cast<int>((value * 100.0) / total) << "%)";
+  }
+  line << "   ";
+  std::cout << line.str() << std::flush;
+}
+
+void ProgressReporter::run() {
+  long                         shown = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+    long value = counter.load(std::memory_order_relaxed);
+    if (value != shown) {
+      print(value);
+      shown = value;
+    }
+  }
+}
@@ -0,0 +1,252 @@
+#include "RasterReader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include "cpl_error.h"
+#include "ParallelChunks.hpp"
+
+namespace {
+  // Blocks larger than this are not read whole; such rasters are read in
+  // windows of about kRowWindowPixels pixels spanning full rows instead
+  const size_t kMaxBlockBytes   = 64 << 20;
+  const size_t kRowWindowPixels = 1 << 22;
+
+  struct RasterLayout {
+    int          xSize, ySize;
+    int          windowX, windowY; // block size, or full-row window size
+    int          windowsPerRow, windowsPerColumn;
+    bool         useBlocks;
+    GDALDataType type;
+    bool         hasGeo;
+    double       geoTransform[6];
+    bool         hasNoData;
+    double       noData;
+    double       bandScale, bandOffset;
+
+    size_t windowCount() const { return static_cast<size_t>(windowsPerRow) * windowsPerColumn; }
+  };
+
+  RasterLayout describeRaster(GDALDataset* dataset) {
+    GDALRasterBand* band = dataset->GetRasterBand(1);
+    RasterLayout    layout;
+    layout.xSize  = band->GetXSize();
+    layout.ySize  = band->GetYSize();
+    layout.type   = band->GetRasterDataType();
+    layout.hasGeo = dataset->GetGeoTransform(layout.geoTransform) == CE_None;
+
+    int hasNoData = 0, hasScale = 0, hasOffset = 0;
+    layout.noData     = band->GetNoDataValue(&hasNoData);
+    layout.hasNoData  = hasNoData != 0;
+    layout.bandScale  = band->GetScale(&hasScale);
+    layout.bandOffset = band->GetOffset(&hasOffset);
+    if (!hasScale) layout.bandScale = 1.0;
+    if (!hasOffset) layout.bandOffset = 0.0;
+
+    int blockX = 0, blockY = 0;
+    band->GetBlockSize(&blockX, &blockY);
+    size_t blockBytes = static_cast<size_t>(std::max(blockX, 0)) * std::max(blockY, 0) *
+                        std::max(GDALGetDataTypeSizeBytes(layout.type), 1);
+    layout.useBlocks = blockX > 0 && blockY > 0 && blockBytes <= kMaxBlockBytes;
+    if (layout.useBlocks) {
+      layout.windowX = blockX;
+      layout.windowY = blockY;
+    } else {
+      layout.windowX = std::max(layout.xSize, 1);
+      layout.windowY = static_cast<int>(std::max<size_t>(1, kRowWindowPixels / layout.windowX));
+    }
+    layout.windowsPerRow    = (layout.xSize + layout.windowX - 1) / layout.windowX;
+    layout.windowsPerColumn = (layout.ySize + layout.windowY - 1) / layout.windowY;
+    return layout;
+  }
+
+  // Dataset handles shared by the decode workers; each handle is used by one
+  // worker at a time. Handles other than the caller's are opened up front.
+  class HandlePool {
+  public:
+    HandlePool(const std::string& filename, GDALDataset* primary, int wanted) {
+      handles.push_back(primary);
+      CPLPushErrorHandler(CPLQuietErrorHandler);
+      for (int i = 1; i < wanted; ++i) {
+        GDALDataset* ds = (GDALDataset*)GDALOpenEx(filename.c_str(), GDAL_OF_RASTER | GDAL_OF_READONLY, NULL, NULL, NULL);
+        if (!ds) {
+          break;
+        }
+        handles.push_back(ds);
+        owned.push_back(ds);
+      }
+      CPLPopErrorHandler();
+    }
+    ~HandlePool() {
+      for (GDALDataset* ds : owned) {
+        GDALClose(ds);
+      }
+    }
+
+    int size() const { return static_cast<int>(owned.size()) + 1; }
+
+    GDALDataset* acquire() {
+      std::lock_guard<std::mutex> lock(mutex);
+      GDALDataset* ds = handles.back();
+      handles.pop_back();
+      return ds;
+    }
+    void release(GDALDataset* ds) {
+      std::lock_guard<std::mutex> lock(mutex);
+      handles.push_back(ds);
+    }
+
+  private:
+    std::mutex                mutex;
+    std::vector<GDALDataset*> handles;
+    std::vector<GDALDataset*> owned;
+  };
+
+  // Scratch buffers of one decode call.
+  struct WindowBuffer {
+    std::vector<char>  raw;
+    std::vector<float> values;
+  };
+
+  // Decodes window `index` to float32 values with a row stride of layout.windowX.
+  // Returns false when the window cannot be read, which skips it.
+  bool readWindow(GDALRasterBand* band, const RasterLayout& layout, size_t index, WindowBuffer& buffer,
+                  int& x0, int& y0, int& width, int& height) {
+    int column = static_cast<int>(index % layout.windowsPerRow);
+    int row    = static_cast<int>(index / layout.windowsPerRow);
+    x0     = column * layout.windowX;
+    y0     = row * layout.windowY;
+    width  = std::min(layout.windowX, layout.xSize - x0);
+    height = std::min(layout.windowY, layout.ySize - y0);
+
+    size_t pixels = static_cast<size_t>(layout.windowX) * layout.windowY;
+    buffer.values.resize(pixels);
+    if (!layout.useBlocks) {
+      return band->RasterIO(GF_Read, x0, y0, width, height, &buffer.values[0], width, height,
+                            GDT_Float32, 0, static_cast<GSpacing>(layout.windowX) * sizeof(float)) == CE_None;
+    }
+    if (layout.type == GDT_Float32) {
+      return band->ReadBlock(column, row, &buffer.values[0]) == CE_None;
+    }
+    int typeBytes = GDALGetDataTypeSizeBytes(layout.type);
+    buffer.raw.resize(pixels * typeBytes);
+    if (band->ReadBlock(column, row, &buffer.raw[0]) != CE_None) {
+      return false;
+    }
+    GDALCopyWords(&buffer.raw[0], layout.type, typeBytes, &buffer.values[0], GDT_Float32, sizeof(float),
+                  static_cast<int>(pixels));
+    return true;
+  }
+
+  template <class Sink>
+  void emitWindow(const RasterLayout& layout, const WindowBuffer& buffer, int x0, int y0, int width, int height,
+                  Sink& sink) {
+    const double* gt = layout.geoTransform;
+    for (int j = 0; j < height; ++j) {
+      const float* row = &buffer.values[static_cast<size_t>(j) * layout.windowX];
+      int          y   = y0 + j;
+      for (int i = 0; i < width; ++i) {
+        double z = row[i];
+        if (std::isnan(z)) {
+          continue;
+        }
+        if (layout.hasNoData && (z == layout.noData || (std::isnan(layout.noData) && std::isnan(z)))) {
+          continue;
+        }
+        z = z * layout.bandScale + layout.bandOffset;
+        int    x  = x0 + i;
+        double wx = static_cast<double>(x), wy = static_cast<double>(y);
+        if (layout.hasGeo) {
+          wx = gt[0] + (x + 0.5) * gt[1] + (y + 0.5) * gt[2];
+          wy = gt[3] + (x + 0.5) * gt[4] + (y + 0.5) * gt[5];
+        }
+        sink.addPoint(wx, wy, z);
+      }
+    }
+  }
+
+  // Decodes one window on a pooled handle and emits its points to `sink`.
+  template <class Sink>
+  void decodeWindow(HandlePool& pool, const RasterLayout& layout, size_t index, Sink& sink) {
+    GDALDataset* ds = pool.acquire();
+    WindowBuffer buffer;
+    int          x0, y0, width, height;
+    bool         ok = false;
+    try {
+      ok = readWindow(ds->GetRasterBand(1), layout, index, buffer, x0, y0, width, height);
+    } catch (...) {
+      pool.release(ds);
+      throw;
+    }
+    pool.release(ds);
+    if (ok) {
+      emitWindow(layout, buffer, x0, y0, width, height, sink);
+    }
+  }
+} // namespace
+
+void processRaster(const std::string& filename, GDALDataset* dataset, PointCollector& pc) {
+  RasterLayout layout   = describeRaster(dataset);
+  size_t       windows  = layout.windowCount();
+  bool         scanning = !pc.quiet && pc.totalPoints == 0;
+  int          threads  = static_cast<int>(std::min<size_t>(resolveThreadCount(pc.threads), windows));
+
+  std::atomic<size_t> done(0);
+  auto reportProgress = [&](size_t count) {
+    if (scanning) {
+      int percent = static_cast<int>((count * 100.0) / windows);
+      std::cout << "\rScanning file: " << percent << "%   " << std::flush;
+    }
+  };
+
+  HandlePool pool(filename, dataset, threads);
+  threads = pool.size();
+
+  if (threads <= 1) {
+    WindowBuffer buffer;
+    GDALRasterBand* band = dataset->GetRasterBand(1);
+    for (size_t w = 0; w < windows; ++w) {
+      int x0, y0, width, height;
+      if (readWindow(band, layout, w, buffer, x0, y0, width, height)) {
+        emitWindow(layout, buffer, x0, y0, width, height, pc);
+      }
+      reportProgress(w + 1);
+    }
+  } else if (!pc.isWriting()) {
+    // Bounds pass: every worker accumulates into its own collector, merged at the end
+    std::vector<PointCollector> locals(threads);
+    std::vector<ZHistogram>     localZ(threads, ZHistogram(pc.zHistogram ? pc.zHistogram->relativeError : 0.001));
+    for (int t = 0; t < threads; ++t) {
+      locals[t].quiet      = true;
+      locals[t].colorize   = pc.colorize;
+      locals[t].zHistogram = pc.zHistogram ? &localZ[t] : nullptr;
+    }
+    parallelFor(windows, threads, [&](size_t w, int worker) {
+      decodeWindow(pool, layout, w, locals[worker]);
+      size_t count = ++done;
+      if (worker == 0) {
+        reportProgress(count);
+      }
+    });
+    for (int t = 0; t < threads; ++t) {
+      pc.merge(locals[t]);
+    }
+  } else {
+    // Write pass: workers decode blocks into batches, the calling thread feeds the writer
+    parallelBatches(
+        windows, threads, pc.ordered,
+        [&](size_t w, PointBatch& batch) {
+          decodeWindow(pool, layout, w, batch);
+        },
+        [&](size_t, PointBatch& batch) {
+          pc.addBatch(batch);
+          reportProgress(++done);
+        });
+  }
+
+  if (scanning) {
+    std::cout << "\rScanning file: 100%   " << std::flush;
+  }
+}
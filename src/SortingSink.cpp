@@ -0,0 +1,232 @@
+#include "SortingSink.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+  // Records per write handed downstream, and the smallest read buffer per run
+  const size_t kEmitRecords   = 65536;
+  const size_t kMinReadBuffer = 64 * 1024;
+
+  // Maps a signed quantized coordinate to unsigned while keeping its order.
+  uint32_t toUnsigned(const char* p) {
+    int32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return static_cast<uint32_t>(v) ^ 0x80000000u;
+  }
+
+  uint64_t spreadBits(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+  }
+
+  // Sequential reader over one spilled run.
+  struct RunReader {
+    std::ifstream     in;
+    std::vector<char> buffer;
+    size_t            pos, end, recordLength;
+
+    RunReader(const std::string& path, size_t bufferBytes, size_t recordLength)
+        : in(path, std::ios::in | std::ios::binary), pos(0), end(0), recordLength(recordLength) {
+      buffer.resize(std::max(recordLength, bufferBytes / recordLength * recordLength));
+    }
+
+    // Returns the next record, or nullptr at the end of the run.
+    const char* next() {
+      if (pos == end) {
+        in.read(&buffer[0], static_cast<std::streamsize>(buffer.size()));
+        end = static_cast<size_t>(in.gcount()) / recordLength * recordLength;
+        pos = 0;
+        if (end == 0) {
+          return nullptr;
+        }
+      }
+      const char* record = &buffer[pos];
+      pos += recordLength;
+      return record;
+    }
+  };
+
+  struct MergeHead {
+    uint64_t key;
+    size_t   run;
+    bool operator>(const MergeHead& o) const { return key > o.key || (key == o.key && run > o.run); }
+  };
+} // namespace
+
+bool parseSortOrder(const std::string& name, SortOrder& order) {
+  if (name == "none") {
+    order = kSortNone;
+  } else if (name == "morton") {
+    order = kSortMorton;
+  } else if (name == "hilbert") {
+    order = kSortHilbert;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+uint64_t mortonKey(uint32_t x, uint32_t y) {
+  return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+uint64_t hilbertKey(uint32_t x, uint32_t y) {
+  uint64_t d = 0;
+  for (uint32_t s = 0x80000000u; s > 0; s >>= 1) {
+    uint32_t rx = (x & s) ? 1 : 0;
+    uint32_t ry = (y & s) ? 1 : 0;
+    d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant so the sub-curve connects to its neighbours
+    if (ry == 0) {
+      if (rx == 1) {
+        x = ~x;
+        y = ~y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+uint64_t curveKey(SortOrder order, const char* record) {
+  uint32_t x = toUnsigned(record);
+  uint32_t y = toUnsigned(record + 4);
+  return order == kSortHilbert ? hilbertKey(x, y) : mortonKey(x, y);
+}
+
+SortingSink::SortingSink(RecordSink& downstream, SortOrder order, size_t memoryBytes, const std::string& tempPrefix)
+    : downstream(downstream), order(order), memoryBytes(memoryBytes), tempPrefix(tempPrefix),
+      recordLength(0), runRecords(0), closed(false) {}
+
+SortingSink::~SortingSink() {
+  removeRuns();
+}
+
+void SortingSink::write(const char* records, size_t count, size_t length) {
+  if (recordLength == 0) {
+    recordLength = length;
+    runRecords   = std::max<size_t>(kEmitRecords, memoryBytes / (length + sizeof(Entry)));
+    runRecords   = std::min<size_t>(runRecords, UINT32_MAX);
+  } else if (length != recordLength) {
+    throw std::runtime_error("Record length changed while sorting");
+  }
+  while (count > 0) {
+    size_t take = std::min(count, runRecords - entries.size());
+    for (size_t i = 0; i < take; ++i) {
+      Entry e;
+      e.key   = curveKey(order, records + i * length);
+      e.index = static_cast<uint32_t>(entries.size());
+      entries.push_back(e);
+    }
+    buffer.insert(buffer.end(), records, records + take * length);
+    records += take * length;
+    count -= take;
+    if (entries.size() == runRecords) {
+      spill();
+    }
+  }
+}
+
+void SortingSink::writeSorted(RecordSink& out) {
+  std::sort(entries.begin(), entries.end());
+  std::vector<char> staging(kEmitRecords * recordLength);
+  for (size_t i = 0; i < entries.size(); i += kEmitRecords) {
+    size_t n = std::min(kEmitRecords, entries.size() - i);
+    for (size_t j = 0; j < n; ++j) {
+      std::memcpy(&staging[j * recordLength], &buffer[entries[i + j].index * recordLength], recordLength);
+    }
+    out.write(&staging[0], n, recordLength);
+  }
+  entries.clear();
+  buffer.clear();
+}
+
+void SortingSink::spill() {
+  std::string   path = tempPrefix + ".sort" + std::to_string(runs.size()) + ".tmp";
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  runs.push_back(path);
+  if (!out.is_open()) {
+    throw std::runtime_error("Cannot create sort run: " + path);
+  }
+  StreamSink file(out);
+  writeSorted(file);
+  out.close();
+  if (out.fail()) {
+    throw std::runtime_error("Cannot write sort run: " + path);
+  }
+}
+
+void SortingSink::merge() {
+  size_t readBuffer = std::max(kMinReadBuffer, memoryBytes / (runs.size() + 1));
+  std::vector<std::unique_ptr<RunReader>> readers;
+  std::vector<const char*>                current(runs.size());
+  std::priority_queue<MergeHead, std::vector<MergeHead>, std::greater<MergeHead>> heads;
+  for (size_t r = 0; r < runs.size(); ++r) {
+    readers.push_back(std::unique_ptr<RunReader>(new RunReader(runs[r], readBuffer, recordLength)));
+    if (!readers[r]->in.is_open()) {
+      throw std::runtime_error("Cannot read sort run: " + runs[r]);
+    }
+    current[r] = readers[r]->next();
+    if (current[r]) {
+      MergeHead h = {curveKey(order, current[r]), r};
+      heads.push(h);
+    }
+  }
+
+  std::vector<char> staging(kEmitRecords * recordLength);
+  size_t            pending = 0;
+  while (!heads.empty()) {
+    size_t r = heads.top().run;
+    heads.pop();
+    std::memcpy(&staging[pending * recordLength], current[r], recordLength);
+    if (++pending == kEmitRecords) {
+      downstream.write(&staging[0], pending, recordLength);
+      pending = 0;
+    }
+    current[r] = readers[r]->next();
+    if (current[r]) {
+      MergeHead h = {curveKey(order, current[r]), r};
+      heads.push(h);
+    }
+  }
+  if (pending > 0) {
+    downstream.write(&staging[0], pending, recordLength);
+  }
+}
+
+void SortingSink::close() {
+  if (closed) {
+    return;
+  }
+  closed = true;
+
+  if (runs.empty()) {
+    writeSorted(downstream);
+  } else {
+    if (!entries.empty()) {
+      spill();
+    }
+    std::vector<char>().swap(buffer);
+    std::vector<Entry>().swap(entries);
+    merge();
+    removeRuns();
+  }
+  downstream.close();
+}
+
+void SortingSink::removeRuns() {
+  for (const auto& path : runs) {
+    std::remove(path.c_str());
+  }
+}
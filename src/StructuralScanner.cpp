@@ -0,0 +1,156 @@
+#include "StructuralScanner.hpp"
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define XYZ2LAS_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace {
+  const size_t kBlockBytes = 64;
+
+  struct BlockMasks {
+    uint64_t newline;
+    uint64_t blank;
+  };
+
+  typedef void (*ClassifyFn)(const char* block, BlockMasks& out);
+
+  void classifyScalar(const char* block, BlockMasks& out) {
+    uint64_t newline = 0, blank = 0;
+    for (size_t i = 0; i < kBlockBytes; ++i) {
+      char c = block[i];
+      if (c == '\n') newline |= uint64_t(1) << i;
+      if (c == ' ' || c == '\t' || c == '\r') blank |= uint64_t(1) << i;
+    }
+    out.newline = newline;
+    out.blank   = blank;
+  }
+
+#ifdef XYZ2LAS_X86_DISPATCH
+  __attribute__((target("sse4.2"))) void classifySSE42(const char* block, BlockMasks& out) {
+    const __m128i nl     = _mm_set1_epi8('\n');
+    const __m128i blanks = _mm_setr_epi8(' ', '\t', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    uint64_t      newline = 0, blank = 0;
+    for (int i = 0; i < 4; ++i) {
+      __m128i  v    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+      uint64_t nlm  = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+      __m128i  any  = _mm_cmpestrm(blanks, 3, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+      uint64_t blm  = static_cast<uint32_t>(_mm_cvtsi128_si32(any)) & 0xFFFF;
+      newline      |= nlm << (16 * i);
+      blank        |= blm << (16 * i);
+    }
+    out.newline = newline;
+    out.blank   = blank;
+  }
+
+  __attribute__((target("avx2"))) void classifyAVX2(const char* block, BlockMasks& out) {
+    const __m256i nl  = _mm256_set1_epi8('\n');
+    const __m256i sp  = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cr  = _mm256_set1_epi8('\r');
+    uint64_t      newline = 0, blank = 0;
+    for (int i = 0; i < 2; ++i) {
+      __m256i  v   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+      __m256i  bl  = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                                     _mm256_cmpeq_epi8(v, cr));
+      uint64_t nlm = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+      uint64_t blm = static_cast<uint32_t>(_mm256_movemask_epi8(bl));
+      newline     |= nlm << (32 * i);
+      blank       |= blm << (32 * i);
+    }
+    out.newline = newline;
+    out.blank   = blank;
+  }
+#endif
+
+  ClassifyFn classifierFor(ScannerLevel level) {
+#ifdef XYZ2LAS_X86_DISPATCH
+    switch (level) {
+    case kScannerAVX2:
+      return classifyAVX2;
+    case kScannerSSE42:
+      return classifySSE42;
+    default:
+      break;
+    }
+#else
+    (void)level;
+#endif
+    return classifyScalar;
+  }
+
+  inline int countTrailingZeros(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1)) {
+      v >>= 1;
+      n++;
+    }
+    return n;
+#endif
+  }
+
+  inline void emitIndices(uint64_t mask, uint32_t base, std::vector<uint32_t>& indices) {
+    while (mask) {
+      indices.push_back(base + static_cast<uint32_t>(countTrailingZeros(mask)));
+      mask &= mask - 1;
+    }
+  }
+} // namespace
+
+ScannerLevel detectScannerLevel() {
+#ifdef XYZ2LAS_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return kScannerAVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return kScannerSSE42;
+  }
+#endif
+  return kScannerScalar;
+}
+
+const char* scannerLevelName(ScannerLevel level) {
+  switch (level) {
+  case kScannerAVX2:
+    return "AVX2";
+  case kScannerSSE42:
+    return "SSE4.2";
+  default:
+    return "scalar";
+  }
+}
+
+void scanStructure(const char* begin, const char* end, std::vector<uint32_t>& indices, ScannerLevel level) {
+  ClassifyFn classify = classifierFor(level);
+  size_t     size     = static_cast<size_t>(end - begin);
+  // A field starts on any non-separator byte that follows a separator; the
+  // start of the range counts as following one.
+  uint64_t   prevSep  = 1;
+  BlockMasks masks;
+
+  size_t offset = 0;
+  for (; offset + kBlockBytes <= size; offset += kBlockBytes) {
+    classify(begin + offset, masks);
+    uint64_t sep        = masks.newline | masks.blank;
+    uint64_t fieldStart = ~sep & ((sep << 1) | prevSep);
+    prevSep             = sep >> 63;
+    emitIndices(fieldStart | masks.newline, static_cast<uint32_t>(offset), indices);
+  }
+
+  if (offset < size) {
+    // Pad the tail with blanks, which never produce an index
+    char tail[kBlockBytes];
+    std::memset(tail, ' ', kBlockBytes);
+    std::memcpy(tail, begin + offset, size - offset);
+    classify(tail, masks);
+    uint64_t valid      = (uint64_t(1) << (size - offset)) - 1;
+    uint64_t sep        = masks.newline | masks.blank;
+    uint64_t fieldStart = ~sep & ((sep << 1) | prevSep);
+    emitIndices((fieldStart | masks.newline) & valid, static_cast<uint32_t>(offset), indices);
+  }
+}
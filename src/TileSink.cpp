@@ -0,0 +1,150 @@
+#include "TileSink.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include "HeaderPatcher.hpp"
+#include "LazChunkSink.hpp"
+#include "ParallelChunks.hpp"
+
+namespace {
+  const size_t kCopyBytes = 4 << 20;
+
+  uint64_t tileKey(int64_t column, int64_t row) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(column)) << 32) | static_cast<uint32_t>(row);
+  }
+
+  int32_t rawAt(const char* record, int axis) {
+    int32_t v;
+    std::memcpy(&v, record + 4 * axis, sizeof(v));
+    return v;
+  }
+} // namespace
+
+TileSink::TileSink(const liblas::Header& header, const std::string& filename, double tileSize, int threads)
+    : header(header), filename(filename), tileSize(tileSize), threads(threads),
+      compressed(header.Compressed()), recordLength(0),
+      spool([this](uint64_t key) { return tiles[key].spool; },
+            [this](std::ostream& os, uint64_t) {
+              if (!compressed) {
+                writeLasHeader(os, this->header);
+              }
+            }),
+      closed(false) {
+  if (!(tileSize > 0.0)) {
+    throw std::runtime_error("Tile size must be positive");
+  }
+}
+
+std::string TileSink::tilePath(const std::string& filename, int64_t column, int64_t row) {
+  size_t      dot   = filename.find_last_of('.');
+  size_t      slash = filename.find_last_of("/\\");
+  std::string base  = filename;
+  std::string ext;
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+    base = filename.substr(0, dot);
+    ext  = filename.substr(dot);
+  }
+  return base + "_" + std::to_string(column) + "_" + std::to_string(row) + ext;
+}
+
+void TileSink::write(const char* records, size_t count, size_t length) {
+  if (recordLength == 0) {
+    recordLength = length;
+  } else if (length != recordLength) {
+    throw std::runtime_error("Record length changed while tiling");
+  }
+  for (size_t i = 0; i < count; ++i, records += length) {
+    double   x      = rawAt(records, 0) * header.GetScaleX() + header.GetOffsetX();
+    double   y      = rawAt(records, 1) * header.GetScaleY() + header.GetOffsetY();
+    int64_t  column = static_cast<int64_t>(std::floor(x / tileSize));
+    int64_t  row    = static_cast<int64_t>(std::floor(y / tileSize));
+    uint64_t key    = tileKey(column, row);
+
+    Tile& tile = tiles[key];
+    if (tile.path.empty()) {
+      tile.path  = tilePath(filename, column, row);
+      tile.spool = compressed ? tile.path + ".tmp" : tile.path;
+      tile.count = 0;
+      for (int axis = 0; axis < 3; ++axis) {
+        tile.minRaw[axis] = INT32_MAX;
+        tile.maxRaw[axis] = INT32_MIN;
+      }
+    }
+    tile.count++;
+    for (int axis = 0; axis < 3; ++axis) {
+      int32_t v = rawAt(records, axis);
+      tile.minRaw[axis] = std::min(tile.minRaw[axis], v);
+      tile.maxRaw[axis] = std::max(tile.maxRaw[axis], v);
+    }
+    spool.append(key, records, length);
+  }
+}
+
+void TileSink::finishTile(Tile& tile) {
+  if (compressed) {
+    std::ifstream in(tile.spool, std::ios::in | std::ios::binary);
+    std::ofstream out(tile.path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!in.is_open() || !out.is_open()) {
+      throw std::runtime_error("Cannot open tile file: " + tile.path);
+    }
+    std::unique_ptr<liblas::Writer> writer;
+    std::unique_ptr<RecordSink>     sink;
+    if (parallelLazAvailable()) {
+      liblas::Header rendered = writeLasHeader(out, header);
+      sink.reset(new LazChunkSink(out, rendered, 1));
+    } else {
+      writer.reset(new liblas::Writer(out, header));
+      sink.reset(new WriterSink(*writer, header));
+    }
+    std::vector<char> block(std::max<size_t>(1, kCopyBytes / recordLength) * recordLength);
+    for (;;) {
+      in.read(&block[0], static_cast<std::streamsize>(block.size()));
+      size_t records = static_cast<size_t>(in.gcount()) / recordLength;
+      if (records == 0) {
+        break;
+      }
+      sink->write(&block[0], records, recordLength);
+    }
+    sink->close();
+    sink.reset();
+    writer.reset();
+    out.close();
+    in.close();
+    if (out.fail()) {
+      throw std::runtime_error("Failed to write tile: " + tile.path);
+    }
+    std::remove(tile.spool.c_str());
+  }
+
+  double minXYZ[3], maxXYZ[3];
+  double scale[3]  = {header.GetScaleX(), header.GetScaleY(), header.GetScaleZ()};
+  double offset[3] = {header.GetOffsetX(), header.GetOffsetY(), header.GetOffsetZ()};
+  for (int axis = 0; axis < 3; ++axis) {
+    minXYZ[axis] = tile.minRaw[axis] * scale[axis] + offset[axis];
+    maxXYZ[axis] = tile.maxRaw[axis] * scale[axis] + offset[axis];
+  }
+  if (!patchLasHeader(tile.path, tile.count, minXYZ, maxXYZ)) {
+    throw std::runtime_error("Cannot finalize tile: " + tile.path);
+  }
+}
+
+void TileSink::close() {
+  if (closed) {
+    return;
+  }
+  closed = true;
+
+  spool.finish();
+
+  std::vector<Tile*> all;
+  for (auto& entry : tiles) {
+    all.push_back(&entry.second);
+  }
+  // Only LAZ tiles have real work left; LAS tiles just get their header patched
+  int workers = compressed && parallelLazAvailable() ? resolveThreadCount(threads) : 1;
+  parallelFor(all.size(), workers, [&](size_t i, int) { finishTile(*all[i]); });
+}
@@ -0,0 +1,442 @@
+#include "UringReader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(XYZ2LAS_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+  // O_DIRECT transfers must be aligned to the device's logical block size,
+  // which a page covers
+  const size_t kAlignment = 4096;
+
+  size_t alignUp(size_t n) {
+    return (n + kAlignment - 1) & ~(kAlignment - 1);
+  }
+
+  std::runtime_error readError(int error) {
+    return std::runtime_error(std::string("Read error: ") + std::strerror(error));
+  }
+
+#if defined(XYZ2LAS_HAVE_IO_URING)
+  // Submission and completion rings of one io_uring instance, driven with the
+  // raw system calls. Only the owning thread touches it.
+  struct Ring {
+    int           fd;
+    void*         sqMap;
+    size_t        sqMapSize;
+    void*         cqMap;
+    size_t        cqMapSize;
+    io_uring_sqe* sqes;
+    size_t        sqesSize;
+    unsigned*     sqTail;
+    unsigned*     sqMask;
+    unsigned*     sqArray;
+    unsigned*     cqHead;
+    unsigned*     cqTail;
+    unsigned*     cqMask;
+    io_uring_cqe* cqes;
+
+    Ring() : fd(-1), sqMap(MAP_FAILED), sqMapSize(0), cqMap(MAP_FAILED), cqMapSize(0), sqes(nullptr), sqesSize(0) {}
+
+    ~Ring() {
+      if (sqes) {
+        munmap(sqes, sqesSize);
+      }
+      if (cqMap != MAP_FAILED && cqMap != sqMap) {
+        munmap(cqMap, cqMapSize);
+      }
+      if (sqMap != MAP_FAILED) {
+        munmap(sqMap, sqMapSize);
+      }
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+
+    bool open(unsigned entries) {
+      io_uring_params p;
+      std::memset(&p, 0, sizeof(p));
+      fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+      if (fd < 0) {
+        return false;
+      }
+      sqMapSize   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      cqMapSize   = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+      bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+      if (single) {
+        sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+      }
+      sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+      if (sqMap == MAP_FAILED) {
+        return false;
+      }
+      cqMap = single ? sqMap
+                     : mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cqMap == MAP_FAILED) {
+        return false;
+      }
+      sqesSize  = p.sq_entries * sizeof(io_uring_sqe);
+      void* map = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+      if (map == MAP_FAILED) {
+        return false;
+      }
+      sqes = static_cast<io_uring_sqe*>(map);
+
+      char* sq = static_cast<char*>(sqMap);
+      char* cq = static_cast<char*>(cqMap);
+      sqTail   = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+      sqMask   = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+      sqArray  = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+      cqHead   = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+      cqTail   = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+      cqMask   = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+      cqes     = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+      return true;
+    }
+
+    void prepareRead(int file, char* buffer, size_t length, uint64_t offset, uint64_t userData) {
+      unsigned      tail  = *sqTail; // only this thread moves the tail
+      unsigned      index = tail & *sqMask;
+      io_uring_sqe& sqe   = sqes[index];
+      std::memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode    = IORING_OP_READ;
+      sqe.fd        = file;
+      sqe.addr      = reinterpret_cast<uintptr_t>(buffer);
+      sqe.len       = static_cast<unsigned>(length);
+      sqe.off       = offset;
+      sqe.user_data = userData;
+      sqArray[index] = index;
+      __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // Submits `submit` prepared reads and waits until at least `wait` have completed.
+    void enter(unsigned submit, unsigned wait) {
+      for (;;) {
+        long ret = syscall(__NR_io_uring_enter, fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (ret >= 0) {
+          return;
+        }
+        if (errno != EINTR) {
+          throw readError(errno);
+        }
+      }
+    }
+
+    bool nextCompletion(io_uring_cqe& cqe) {
+      unsigned head = *cqHead;
+      if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        return false;
+      }
+      cqe = cqes[head & *cqMask];
+      __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+  };
+#endif
+} // namespace
+
+bool parseInputEngine(const std::string& name, InputEngine& engine) {
+  if (name == "mmap") {
+    engine = kInputEngineMmap;
+  } else if (name == "uring") {
+    engine = kInputEngineUring;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool uringAvailable() {
+#if defined(XYZ2LAS_HAVE_IO_URING)
+  Ring ring;
+  return ring.open(1);
+#else
+  return false;
+#endif
+}
+
+struct UringReader::Impl {
+  enum SlotState { kFree, kReading, kLoaded };
+
+  struct Slot {
+    SlotState state;
+    size_t    block;
+    size_t    length; // bytes of the block
+    size_t    done;   // bytes read so far
+  };
+
+  int                     fd;
+  uint64_t                fileSize;
+  size_t                  blockBytes;
+  size_t                  depth;
+  size_t                  blocks;
+  bool                    direct;
+  std::atomic<bool>       uring; // cleared by the I/O thread if the kernel rejects the reads
+  char*                   buffers; // depth * blockBytes, page aligned
+  std::vector<Slot>       slots;
+  std::mutex              m;
+  std::condition_variable changed;
+  bool                    stop;
+  std::exception_ptr      error;
+  std::thread             io;
+#if defined(XYZ2LAS_HAVE_IO_URING)
+  Ring ring;
+#endif
+
+  Impl()
+      : fd(-1), fileSize(0), blockBytes(0), depth(0), blocks(0), direct(false), uring(false), buffers(nullptr),
+        stop(false) {}
+
+  ~Impl() {
+    if (io.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(m);
+        stop = true;
+      }
+      changed.notify_all();
+      io.join();
+    }
+    std::free(buffers);
+#if defined(__unix__) || defined(__APPLE__)
+    if (fd >= 0) {
+      close(fd);
+    }
+#endif
+  }
+
+  char* bufferOf(size_t slot) { return buffers + slot * blockBytes; }
+
+  // Bytes to request for the rest of a slot; O_DIRECT needs whole pages, and
+  // the read simply comes back short at the end of the file.
+  size_t requestBytes(const Slot& s) const {
+    size_t rest = s.length - s.done;
+    return direct ? std::min(alignUp(rest), blockBytes - s.done) : rest;
+  }
+
+  uint64_t offsetOf(const Slot& s) const { return static_cast<uint64_t>(s.block) * blockBytes + s.done; }
+
+  // Accounts `bytes` read into slot `slot`; returns true once the block is complete.
+  bool advance(size_t slot, long bytes) {
+    if (bytes < 0) {
+      throw readError(static_cast<int>(-bytes));
+    }
+    Slot& s = slots[slot];
+    s.done += static_cast<size_t>(bytes);
+    if (s.done >= s.length) {
+      std::lock_guard<std::mutex> lock(m);
+      s.state = kLoaded;
+      changed.notify_all();
+      return true;
+    }
+    if (bytes == 0) {
+      throw std::runtime_error("Input file shrank while it was read");
+    }
+    return false;
+  }
+
+  // Issues the next blocks into free slots as parsers release them, keeping up
+  // to `depth` reads in flight, until every block is read or `stop` is set.
+  void run() {
+    size_t              next     = 0; // next block to issue
+    size_t              inFlight = 0;
+    std::vector<size_t> pending;      // slots whose reads are to be (re)submitted
+    try {
+      for (;;) {
+        {
+          std::unique_lock<std::mutex> lock(m);
+          for (;;) {
+            while (next < blocks && slots[next % depth].state == kFree) {
+              Slot& s  = slots[next % depth];
+              s.state  = kReading;
+              s.block  = next;
+              s.done   = 0;
+              s.length = static_cast<size_t>(std::min<uint64_t>(blockBytes, fileSize - offsetOf(s)));
+              pending.push_back(next % depth);
+              next++;
+            }
+            if (stop || !pending.empty() || inFlight > 0 || next >= blocks) {
+              break;
+            }
+            changed.wait(lock);
+          }
+          if (stop || (next >= blocks && pending.empty() && inFlight == 0)) {
+            break;
+          }
+        }
+
+#if defined(XYZ2LAS_HAVE_IO_URING)
+        if (uring) {
+          for (size_t slot : pending) {
+            ring.prepareRead(fd, bufferOf(slot) + slots[slot].done, requestBytes(slots[slot]), offsetOf(slots[slot]),
+                             slot);
+          }
+          unsigned submit = static_cast<unsigned>(pending.size());
+          inFlight += pending.size();
+          pending.clear();
+          ring.enter(submit, 1);
+          // Kernels before 5.6 lack IORING_OP_READ and fail it with -EINVAL;
+          // drain the ring, then redo those reads with pread from here on
+          bool unsupported = false;
+          do {
+            if (unsupported) {
+              ring.enter(0, 1);
+            }
+            io_uring_cqe cqe;
+            while (ring.nextCompletion(cqe)) {
+              inFlight--;
+              size_t slot = static_cast<size_t>(cqe.user_data);
+              if (cqe.res == -EINVAL && slots[slot].done == 0) {
+                unsupported = true;
+                pending.push_back(slot);
+              } else if (!advance(slot, cqe.res)) {
+                pending.push_back(slot); // short read: ask for the rest
+              }
+            }
+          } while (unsupported && inFlight > 0);
+          if (!unsupported) {
+            continue;
+          }
+          uring = false;
+        }
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+        for (size_t slot : pending) {
+          Slot& s = slots[slot];
+          for (;;) {
+            ssize_t n = pread(fd, bufferOf(slot) + s.done, requestBytes(s), static_cast<off_t>(offsetOf(s)));
+            if (n < 0 && errno == EINTR) {
+              continue;
+            }
+            if (advance(slot, n < 0 ? -errno : n)) {
+              break;
+            }
+          }
+        }
+        pending.clear();
+#endif
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(m);
+      error = std::current_exception();
+      changed.notify_all();
+    }
+#if defined(XYZ2LAS_HAVE_IO_URING)
+    // The kernel may still write into the buffers; wait for what is in flight
+    while (uring && inFlight > 0) {
+      try {
+        ring.enter(0, 1);
+      } catch (...) {
+        break;
+      }
+      io_uring_cqe cqe;
+      while (ring.nextCompletion(cqe)) {
+        inFlight--;
+      }
+    }
+#endif
+  }
+};
+
+UringReader::UringReader(const std::string& filename, size_t blockBytes, size_t depth, bool directIO) : impl(new Impl) {
+#if defined(__unix__) || defined(__APPLE__)
+  int flags = O_RDONLY;
+#if defined(O_CLOEXEC)
+  flags |= O_CLOEXEC;
+#endif
+#if defined(O_DIRECT)
+  if (directIO) {
+    impl->fd     = open(filename.c_str(), flags | O_DIRECT);
+    impl->direct = impl->fd >= 0;
+  }
+#else
+  (void)directIO;
+#endif
+  if (impl->fd < 0) {
+    impl->fd = open(filename.c_str(), flags);
+  }
+  struct stat st;
+  if (impl->fd < 0 || fstat(impl->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return; // pipes and devices are streamed instead
+  }
+
+  impl->fileSize   = static_cast<uint64_t>(st.st_size);
+  impl->blockBytes = alignUp(blockBytes);
+  impl->blocks     = static_cast<size_t>((impl->fileSize + impl->blockBytes - 1) / impl->blockBytes);
+  impl->depth      = std::max<size_t>(1, std::min(depth, impl->blocks));
+  void* buffers    = nullptr;
+  if (posix_memalign(&buffers, kAlignment, impl->depth * impl->blockBytes) != 0) {
+    throw std::bad_alloc();
+  }
+  impl->buffers = static_cast<char*>(buffers);
+  Impl::Slot free = {Impl::kFree, 0, 0, 0};
+  impl->slots.assign(impl->depth, free);
+#if defined(XYZ2LAS_HAVE_IO_URING)
+  impl->uring = impl->ring.open(static_cast<unsigned>(impl->depth));
+#endif
+  impl->io = std::thread(&Impl::run, impl.get());
+#else
+  (void)filename;
+  (void)blockBytes;
+  (void)depth;
+  (void)directIO;
+#endif
+}
+
+UringReader::~UringReader() {}
+
+bool UringReader::isOpen() const {
+  return impl->io.joinable();
+}
+
+uint64_t UringReader::size() const {
+  return impl->fileSize;
+}
+
+size_t UringReader::blockCount() const {
+  return impl->blocks;
+}
+
+bool UringReader::usingUring() const {
+  return impl->uring;
+}
+
+bool UringReader::usingDirectIO() const {
+  return impl->direct;
+}
+
+const char* UringReader::acquire(size_t block, size_t& length) {
+  Impl::Slot&                  s = impl->slots[block % impl->depth];
+  std::unique_lock<std::mutex> lock(impl->m);
+  impl->changed.wait(lock, [&] { return impl->error || (s.state == Impl::kLoaded && s.block == block); });
+  if (impl->error) {
+    std::rethrow_exception(impl->error);
+  }
+  length = s.length;
+  return impl->bufferOf(block % impl->depth);
+}
+
+void UringReader::release(size_t block) {
+  {
+    std::lock_guard<std::mutex> lock(impl->m);
+    impl->slots[block % impl->depth].state = Impl::kFree;
+  }
+  impl->changed.notify_all();
+}
@@ -0,0 +1,296 @@
+#include "VectorReader.hpp"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gdal_version.h"
+
+namespace {
+  const int kMaxWkbDepth = 32;
+
+  // Bounds-checked cursor over one WKB geometry; `swap` when its byte order
+  // differs from the host's.
+  struct WkbCursor {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool           swap;
+
+    bool has(size_t bytes) const { return static_cast<size_t>(end - p) >= bytes; }
+
+    uint32_t uint32() {
+      uint32_t v;
+      std::memcpy(&v, p, sizeof(v));
+      p += sizeof(v);
+      return swap ? __builtin_bswap32(v) : v;
+    }
+
+    double float64() {
+      uint64_t v;
+      std::memcpy(&v, p, sizeof(v));
+      p += sizeof(v);
+      if (swap) {
+        v = __builtin_bswap64(v);
+      }
+      double d;
+      std::memcpy(&d, &v, sizeof(d));
+      return d;
+    }
+  };
+
+  bool hostIsLittleEndian() {
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+  }
+
+  // Reads `count` vertices of `dims` ordinates (x, y, then z when hasZ).
+  bool addVertices(WkbCursor& c, uint32_t count, int dims, bool hasZ, PointCollector& pc) {
+    if (static_cast<size_t>(count) > static_cast<size_t>(c.end - c.p) / (dims * sizeof(double))) {
+      return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      double x = c.float64();
+      double y = c.float64();
+      double z = hasZ ? c.float64() : 0.0;
+      if (dims == 4 || (dims == 3 && !hasZ)) {
+        c.p += sizeof(double); // M
+      }
+      pc.addPoint(x, y, z);
+    }
+    return true;
+  }
+
+  bool addWkb(WkbCursor& c, int depth, PointCollector& pc) {
+    if (depth > kMaxWkbDepth || !c.has(5)) {
+      return false;
+    }
+    uint8_t order = *c.p++;
+    if (order > 1) {
+      return false;
+    }
+    c.swap = (order == 1) != hostIsLittleEndian();
+
+    // ISO WKB encodes Z/M as +1000/+2000/+3000, EWKB as high flag bits
+    uint32_t type = c.uint32();
+    bool     hasZ = (type & 0x80000000u) != 0;
+    bool     hasM = (type & 0x40000000u) != 0;
+    if (type & 0x20000000u) {
+      if (!c.has(4)) {
+        return false;
+      }
+      c.p += 4; // EWKB SRID
+    }
+    type &= 0x0FFFFFFFu;
+    uint32_t iso = type / 1000;
+    type %= 1000;
+    hasZ = hasZ || iso == 1 || iso == 3;
+    hasM = hasM || iso == 2 || iso == 3;
+    int dims = 2 + (hasZ ? 1 : 0) + (hasM ? 1 : 0);
+
+    switch (type) {
+    case wkbPoint: {
+      if (!c.has(dims * sizeof(double))) {
+        return false;
+      }
+      WkbCursor peek = c;
+      double    x    = peek.float64();
+      double    y    = peek.float64();
+      if (std::isnan(x) && std::isnan(y)) { // POINT EMPTY
+        c.p += dims * sizeof(double);
+        return true;
+      }
+      return addVertices(c, 1, dims, hasZ, pc);
+    }
+    case wkbLineString:
+      return c.has(4) && addVertices(c, c.uint32(), dims, hasZ, pc);
+    case wkbPolygon: {
+      if (!c.has(4)) {
+        return false;
+      }
+      uint32_t rings = c.uint32();
+      for (uint32_t r = 0; r < rings; ++r) {
+        if (!c.has(4) || !addVertices(c, c.uint32(), dims, hasZ, pc)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case wkbMultiPoint:
+    case wkbMultiLineString:
+    case wkbMultiPolygon:
+    case wkbGeometryCollection: {
+      if (!c.has(4)) {
+        return false;
+      }
+      uint32_t parts = c.uint32();
+      for (uint32_t i = 0; i < parts; ++i) {
+        if (!addWkb(c, depth + 1, pc)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    default:
+      return false;
+    }
+  }
+
+  void reportFeatures(const PointCollector& pc, GIntBig current, GIntBig total) {
+    if (!pc.quiet && pc.totalPoints == 0 && total > 0) {
+      int percent = static_cast<int>((current * 100.0) / total);
+      std::cout << "\rScanning file: " << percent << "%   " << std::flush;
+    }
+  }
+
+  void processLayerFeatures(OGRLayer* layer, PointCollector& pc, GIntBig totalFeatures) {
+    GIntBig     currentFeature = 0;
+    OGRFeature* poFeature;
+    while ((poFeature = layer->GetNextFeature()) != nullptr) {
+      currentFeature++;
+      if (currentFeature % 10000 == 0) {
+        reportFeatures(pc, currentFeature, totalFeatures);
+      }
+      pc.processGeometry(poFeature->GetGeometryRef());
+      OGRFeature::DestroyFeature(poFeature);
+    }
+  }
+
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 6, 0)
+  const char* const kArrowOptions[] = {"INCLUDE_FID=NO", "GEOMETRY_ENCODING=WKB", "MAX_FEATURES_IN_BATCH=65536", nullptr};
+
+  // Owns an Arrow stream, its schema and the layer's ignored-field setting.
+  struct ArrowLayerStream {
+    OGRLayer*        layer;
+    ArrowArrayStream stream;
+    ArrowSchema      schema;
+
+    explicit ArrowLayerStream(OGRLayer* layer) : layer(layer) {
+      stream.release = nullptr;
+      schema.release = nullptr;
+    }
+    ~ArrowLayerStream() {
+      if (schema.release) schema.release(&schema);
+      if (stream.release) stream.release(&stream);
+      layer->SetIgnoredFields(nullptr);
+    }
+
+    std::string lastError() {
+      const char* message = stream.get_last_error(&stream);
+      return message ? message : "unknown error";
+    }
+  };
+
+  struct ArrowBatch {
+    ArrowArray array;
+    ArrowBatch() { array.release = nullptr; }
+    ~ArrowBatch() { reset(); }
+    void reset() {
+      if (array.release) array.release(&array);
+      array.release = nullptr;
+    }
+  };
+
+  // Index of the WKB geometry column among the top-level schema children, or -1.
+  int findGeometryColumn(const ArrowSchema& schema, const char* geometryName) {
+    int firstBinary = -1;
+    for (int64_t i = 0; i < schema.n_children; ++i) {
+      const ArrowSchema* child  = schema.children[i];
+      std::string        format = child->format ? child->format : "";
+      if (format != "z" && format != "Z") {
+        continue;
+      }
+      if (geometryName && *geometryName && child->name && std::strcmp(child->name, geometryName) == 0) {
+        return static_cast<int>(i);
+      }
+      if (firstBinary < 0) {
+        firstBinary = static_cast<int>(i);
+      }
+    }
+    return firstBinary;
+  }
+
+  // Binary (int32 offsets) or large binary (int64 offsets) column of WKB blobs.
+  template <class Offset>
+  void addWkbColumn(const ArrowArray& column, int64_t first, int64_t length, PointCollector& pc) {
+    const uint8_t* validity = static_cast<const uint8_t*>(column.buffers[0]);
+    const Offset*  offsets  = static_cast<const Offset*>(column.buffers[1]);
+    const uint8_t* data     = static_cast<const uint8_t*>(column.buffers[2]);
+    for (int64_t row = first; row < first + length; ++row) {
+      if (validity && !((validity[row >> 3] >> (row & 7)) & 1)) {
+        continue;
+      }
+      Offset begin = offsets[row];
+      Offset end   = offsets[row + 1];
+      if (end > begin) {
+        addWkbGeometry(data + begin, static_cast<size_t>(end - begin), pc);
+      }
+    }
+  }
+
+  // Returns false, before reading anything, when the layer cannot be streamed.
+  bool processLayerArrow(OGRLayer* layer, PointCollector& pc, GIntBig totalFeatures) {
+    // Attribute fields are never used; ignoring them keeps them out of the batches
+    OGRFeatureDefn*          defn = layer->GetLayerDefn();
+    std::vector<const char*> ignored;
+    for (int i = 0; defn && i < defn->GetFieldCount(); ++i) {
+      ignored.push_back(defn->GetFieldDefn(i)->GetNameRef());
+    }
+    ignored.push_back(nullptr);
+    layer->SetIgnoredFields(&ignored[0]);
+
+    ArrowLayerStream reader(layer);
+    if (!layer->GetArrowStream(&reader.stream, kArrowOptions) ||
+        reader.stream.get_schema(&reader.stream, &reader.schema) != 0) {
+      return false;
+    }
+    int geometryColumn = findGeometryColumn(reader.schema, layer->GetGeometryColumn());
+    if (geometryColumn < 0) {
+      return false;
+    }
+    bool largeOffsets = std::strcmp(reader.schema.children[geometryColumn]->format, "Z") == 0;
+
+    GIntBig    currentFeature = 0;
+    ArrowBatch batch;
+    for (;;) {
+      if (reader.stream.get_next(&reader.stream, &batch.array) != 0) {
+        throw std::runtime_error("Cannot read Arrow batch: " + reader.lastError());
+      }
+      if (!batch.array.release) {
+        break; // end of stream
+      }
+      const ArrowArray& column = *batch.array.children[geometryColumn];
+      int64_t           first  = batch.array.offset + column.offset;
+      if (largeOffsets) {
+        addWkbColumn<int64_t>(column, first, batch.array.length, pc);
+      } else {
+        addWkbColumn<int32_t>(column, first, batch.array.length, pc);
+      }
+      currentFeature += batch.array.length;
+      reportFeatures(pc, currentFeature, totalFeatures);
+      batch.reset();
+    }
+    return true;
+  }
+#endif
+} // namespace
+
+size_t addWkbGeometry(const uint8_t* wkb, size_t size, PointCollector& pc) {
+  WkbCursor c = {wkb, wkb + size, false};
+  if (!addWkb(c, 0, pc)) {
+    return 0;
+  }
+  return static_cast<size_t>(c.p - wkb);
+}
+
+void processLayer(OGRLayer* layer, PointCollector& pc) {
+  layer->ResetReading();
+  GIntBig totalFeatures = layer->GetFeatureCount();
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 6, 0)
+  if (processLayerArrow(layer, pc, totalFeatures)) {
+    return;
+  }
+  layer->ResetReading();
+#endif
+  processLayerFeatures(layer, pc, totalFeatures);
+}
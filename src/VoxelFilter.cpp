@@ -0,0 +1,374 @@
+#include "VoxelFilter.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+  const uint32_t kEmptySlot      = UINT32_MAX;
+  const size_t   kInitialSlots   = 1 << 16;
+  const size_t   kAggregateBytes = 3 * sizeof(int64_t) + sizeof(uint32_t);
+  const size_t   kEmitRecords    = 65536;
+  const size_t   kReadBytes      = 4 << 20;
+  // Buckets per side of the voxels held when spilling starts
+  const int32_t  kBucketsPerSide = 16;
+
+  int32_t rawAt(const char* record, int axis) {
+    int32_t v;
+    std::memcpy(&v, record + 4 * axis, sizeof(v));
+    return v;
+  }
+
+  uint64_t hashKey(const int32_t key[3]) {
+    uint64_t h = static_cast<uint32_t>(key[0]) * 0x9E3779B97F4A7C15ull;
+    h ^= static_cast<uint32_t>(key[1]) * 0xC2B2AE3D27D4EB4Full;
+    h ^= static_cast<uint32_t>(key[2]) * 0x165667B19E3779F9ull;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ (h >> 29);
+  }
+
+  uint64_t bucketKey(const int32_t key[3], int shift) {
+    // Arithmetic shifts keep negative voxel coordinates in their own buckets
+    return (static_cast<uint64_t>(static_cast<uint32_t>(key[0] >> shift)) << 32) |
+           static_cast<uint32_t>(key[1] >> shift);
+  }
+} // namespace
+
+bool parseVoxelMode(const std::string& name, VoxelMode& mode) {
+  if (name == "first") {
+    mode = kVoxelFirst;
+  } else if (name == "center") {
+    mode = kVoxelCenter;
+  } else if (name == "average") {
+    mode = kVoxelAverage;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+VoxelFilterSink::VoxelFilterSink(RecordSink& downstream, const liblas::Header& header, double voxelSize,
+                                 VoxelMode mode, size_t memoryBytes, const std::string& tempPrefix)
+    : downstream(downstream), voxelSize(voxelSize), mode(mode), memoryBytes(memoryBytes), tempPrefix(tempPrefix),
+      recordLength(0), entryLength(0), entries(0), shift(0), kept(0), closed(false) {
+  if (!(voxelSize > 0.0)) {
+    throw std::runtime_error("Voxel size must be positive");
+  }
+  scale[0]  = header.GetScaleX();
+  scale[1]  = header.GetScaleY();
+  scale[2]  = header.GetScaleZ();
+  offset[0] = header.GetOffsetX();
+  offset[1] = header.GetOffsetY();
+  offset[2] = header.GetOffsetZ();
+  for (int axis = 0; axis < 3; ++axis) {
+    minRaw[axis] = INT32_MAX;
+    maxRaw[axis] = INT32_MIN;
+  }
+  Slot empty = {{0, 0, 0}, kEmptySlot};
+  slots.assign(kInitialSlots, empty);
+}
+
+VoxelFilterSink::~VoxelFilterSink() {
+  if (buckets) {
+    buckets->remove();
+  }
+}
+
+void VoxelFilterSink::keptBounds(double minXYZ[3], double maxXYZ[3]) const {
+  for (int axis = 0; axis < 3; ++axis) {
+    minXYZ[axis] = minRaw[axis] * scale[axis] + offset[axis];
+    maxXYZ[axis] = maxRaw[axis] * scale[axis] + offset[axis];
+  }
+}
+
+void VoxelFilterSink::voxelOf(const char* record, int32_t key[3]) const {
+  for (int axis = 0; axis < 3; ++axis) {
+    double v = std::floor((rawAt(record, axis) * scale[axis] + offset[axis]) / voxelSize);
+    if (!(v >= INT32_MIN && v <= INT32_MAX)) {
+      throw std::runtime_error("Voxel size is too small for the coordinate range");
+    }
+    key[axis] = static_cast<int32_t>(v);
+  }
+}
+
+double VoxelFilterSink::centerDistance(const int32_t key[3], const char* record) const {
+  double d = 0.0;
+  for (int axis = 0; axis < 3; ++axis) {
+    double delta = rawAt(record, axis) * scale[axis] + offset[axis] - (key[axis] + 0.5) * voxelSize;
+    d += delta * delta;
+  }
+  return d;
+}
+
+size_t VoxelFilterSink::tableBytes() const {
+  return slots.size() * sizeof(Slot) + records.size() + distances.size() * sizeof(double) +
+         sums.size() * sizeof(int64_t) + counts.size() * sizeof(uint32_t);
+}
+
+void VoxelFilterSink::grow() {
+  std::vector<Slot> old(slots.size() * 2);
+  old.swap(slots);
+  for (Slot& s : slots) {
+    s.entry = kEmptySlot;
+  }
+  size_t mask = slots.size() - 1;
+  for (const Slot& s : old) {
+    if (s.entry == kEmptySlot) {
+      continue;
+    }
+    size_t i = hashKey(s.key) & mask;
+    while (slots[i].entry != kEmptySlot) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = s;
+  }
+}
+
+// Entry index of the voxel `key`, added (and `inserted` set) when new.
+size_t VoxelFilterSink::lookup(const int32_t key[3], bool& inserted) {
+  if ((entries + 1) * 2 > slots.size()) {
+    grow();
+  }
+  size_t mask = slots.size() - 1;
+  size_t i    = hashKey(key) & mask;
+  for (;; i = (i + 1) & mask) {
+    Slot& s = slots[i];
+    if (s.entry == kEmptySlot) {
+      std::memcpy(s.key, key, sizeof(s.key));
+      s.entry  = static_cast<uint32_t>(entries++);
+      inserted = true;
+      return s.entry;
+    }
+    if (s.key[0] == key[0] && s.key[1] == key[1] && s.key[2] == key[2]) {
+      inserted = false;
+      return s.entry;
+    }
+  }
+}
+
+void VoxelFilterSink::addEntry(const char* e) {
+  int32_t key[3];
+  voxelOf(e, key);
+  bool   inserted;
+  size_t index = lookup(key, inserted);
+
+  if (inserted) {
+    records.insert(records.end(), e, e + recordLength);
+    if (mode == kVoxelCenter) {
+      distances.push_back(centerDistance(key, e));
+    } else if (mode == kVoxelAverage) {
+      int64_t  sum[3];
+      uint32_t count;
+      std::memcpy(sum, e + recordLength, sizeof(sum));
+      std::memcpy(&count, e + recordLength + sizeof(sum), sizeof(count));
+      sums.insert(sums.end(), sum, sum + 3);
+      counts.push_back(count);
+    }
+    return;
+  }
+
+  if (mode == kVoxelCenter) {
+    double d = centerDistance(key, e);
+    if (d < distances[index]) {
+      distances[index] = d;
+      std::memcpy(&records[index * recordLength], e, recordLength);
+    }
+  } else if (mode == kVoxelAverage) {
+    int64_t  sum[3];
+    uint32_t count;
+    std::memcpy(sum, e + recordLength, sizeof(sum));
+    std::memcpy(&count, e + recordLength + sizeof(sum), sizeof(count));
+    for (int axis = 0; axis < 3; ++axis) {
+      sums[index * 3 + axis] += sum[axis];
+    }
+    counts[index] += count;
+  }
+}
+
+void VoxelFilterSink::write(const char* data, size_t count, size_t length) {
+  if (recordLength == 0) {
+    recordLength = length;
+    entryLength  = length + (mode == kVoxelAverage ? kAggregateBytes : 0);
+    entry.resize(entryLength);
+  } else if (length != recordLength) {
+    throw std::runtime_error("Record length changed while thinning");
+  }
+
+  for (size_t i = 0; i < count; ++i, data += length) {
+    const char* e = data;
+    if (mode == kVoxelAverage) {
+      // A raw record is an aggregate of one point
+      int64_t  sum[3] = {rawAt(data, 0), rawAt(data, 1), rawAt(data, 2)};
+      uint32_t one    = 1;
+      std::memcpy(&entry[0], data, length);
+      std::memcpy(&entry[length], sum, sizeof(sum));
+      std::memcpy(&entry[length + sizeof(sum)], &one, sizeof(one));
+      e = &entry[0];
+    }
+    if (buckets) {
+      spillEntry(e, shift, *buckets);
+      continue;
+    }
+    addEntry(e);
+    if (tableBytes() > memoryBytes) {
+      spillTable();
+    }
+  }
+}
+
+std::string VoxelFilterSink::bucketPath(int level, uint64_t key) const {
+  return tempPrefix + ".voxel-" + std::to_string(level) + "-" + std::to_string(key) + ".tmp";
+}
+
+void VoxelFilterSink::spillEntry(const char* e, int level, BucketSpool& spool) {
+  int32_t key[3];
+  voxelOf(e, key);
+  spool.append(bucketKey(key, level), e, entryLength);
+}
+
+// Moves the table into buckets sized so its voxels spread over about
+// kBucketsPerSide^2 of them; every later record goes straight to its bucket.
+void VoxelFilterSink::spillTable() {
+  int32_t low[2] = {INT32_MAX, INT32_MAX}, high[2] = {INT32_MIN, INT32_MIN};
+  for (const Slot& s : slots) {
+    if (s.entry != kEmptySlot) {
+      for (int axis = 0; axis < 2; ++axis) {
+        low[axis]  = std::min(low[axis], s.key[axis]);
+        high[axis] = std::max(high[axis], s.key[axis]);
+      }
+    }
+  }
+  int64_t span = std::max(static_cast<int64_t>(high[0]) - low[0], static_cast<int64_t>(high[1]) - low[1]) + 1;
+  shift        = 0;
+  while ((span >> shift) > kBucketsPerSide) {
+    shift++;
+  }
+
+  int level = shift;
+  buckets.reset(new BucketSpool([this, level](uint64_t key) { return bucketPath(level, key); }));
+  for (size_t i = 0; i < entries; ++i) {
+    std::memcpy(&entry[0], &records[i * recordLength], recordLength);
+    if (mode == kVoxelAverage) {
+      std::memcpy(&entry[recordLength], &sums[i * 3], 3 * sizeof(int64_t));
+      std::memcpy(&entry[recordLength + 3 * sizeof(int64_t)], &counts[i], sizeof(uint32_t));
+    }
+    spillEntry(&entry[0], shift, *buckets);
+  }
+  clearTable();
+}
+
+void VoxelFilterSink::clearTable() {
+  Slot empty = {{0, 0, 0}, kEmptySlot};
+  std::vector<Slot>(kInitialSlots, empty).swap(slots);
+  std::vector<char>().swap(records);
+  std::vector<double>().swap(distances);
+  std::vector<int64_t>().swap(sums);
+  std::vector<uint32_t>().swap(counts);
+  entries = 0;
+}
+
+void VoxelFilterSink::emitTable() {
+  std::vector<char> staging(std::min(entries, kEmitRecords) * recordLength);
+  size_t            pending = 0;
+  for (size_t i = 0; i < entries; ++i) {
+    char* r = &staging[pending * recordLength];
+    std::memcpy(r, &records[i * recordLength], recordLength);
+    if (mode == kVoxelAverage) {
+      for (int axis = 0; axis < 3; ++axis) {
+        double  mean = static_cast<double>(sums[i * 3 + axis]) / counts[i];
+        int32_t raw  = static_cast<int32_t>(std::llround(mean));
+        std::memcpy(r + 4 * axis, &raw, sizeof(raw));
+      }
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+      int32_t v    = rawAt(r, axis);
+      minRaw[axis] = std::min(minRaw[axis], v);
+      maxRaw[axis] = std::max(maxRaw[axis], v);
+    }
+    if (++pending == kEmitRecords) {
+      downstream.write(&staging[0], pending, recordLength);
+      pending = 0;
+    }
+  }
+  if (pending > 0) {
+    downstream.write(&staging[0], pending, recordLength);
+  }
+  kept += entries;
+  clearTable();
+}
+
+// Thins one bucket in memory, or splits it into its four quarters first when
+// it would not fit.
+void VoxelFilterSink::thinBucket(const std::string& path, uint64_t bytes, int level) {
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    throw std::runtime_error("Cannot read voxel bucket: " + path);
+  }
+  std::vector<char> block(std::max<size_t>(1, kReadBytes / entryLength) * entryLength);
+
+  if (bytes * 2 > memoryBytes && level > 0) {
+    int         finer = level - 1;
+    BucketSpool quarters([this, finer](uint64_t key) { return bucketPath(finer, key); });
+    try {
+      for (;;) {
+        in.read(&block[0], static_cast<std::streamsize>(block.size()));
+        size_t n = static_cast<size_t>(in.gcount()) / entryLength;
+        if (n == 0) {
+          break;
+        }
+        for (size_t i = 0; i < n; ++i) {
+          spillEntry(&block[i * entryLength], finer, quarters);
+        }
+      }
+      in.close();
+      std::remove(path.c_str());
+      quarters.finish();
+      std::vector<uint64_t> keys = quarters.keys();
+      std::sort(keys.begin(), keys.end());
+      for (uint64_t key : keys) {
+        thinBucket(quarters.path(key), quarters.bytes(key), finer);
+      }
+    } catch (...) {
+      quarters.remove();
+      throw;
+    }
+    return;
+  }
+
+  for (;;) {
+    in.read(&block[0], static_cast<std::streamsize>(block.size()));
+    size_t n = static_cast<size_t>(in.gcount()) / entryLength;
+    if (n == 0) {
+      break;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      addEntry(&block[i * entryLength]);
+    }
+  }
+  in.close();
+  std::remove(path.c_str());
+  emitTable();
+}
+
+void VoxelFilterSink::close() {
+  if (closed) {
+    return;
+  }
+  closed = true;
+
+  if (!buckets) {
+    emitTable();
+  } else {
+    buckets->finish();
+    std::vector<uint64_t> keys = buckets->keys();
+    std::sort(keys.begin(), keys.end());
+    for (uint64_t key : keys) {
+      thinBucket(buckets->path(key), buckets->bytes(key), shift);
+    }
+  }
+  downstream.close();
+}
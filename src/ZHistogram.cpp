@@ -0,0 +1,184 @@
+#include "ZHistogram.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+  // Keys are kept well inside the int64 range
+  const double kMaxKey = 4611686018427387904.0; // 2^62
+
+  inline int64_t floorDiv2(int64_t v) {
+    return (v >= 0) ? v / 2 : -((-v + 1) / 2);
+  }
+} // namespace
+
+ZHistogram::ZHistogram(double relativeError) : relativeError(relativeError), exponent(0), base(0),
+                                               total(0), minZ(DBL_MAX), maxZ(-DBL_MAX) {
+  if (!(this->relativeError > 0.0)) {
+    this->relativeError = 0.001;
+  }
+  // Alignment of the power-of-two grid can cost up to a factor of four in
+  // resolution, so size the window accordingly.
+  size_t binCount = static_cast<size_t>(std::ceil(4.0 / this->relativeError));
+  binCount        = std::max<size_t>(16, std::min<size_t>(binCount, 1 << 24));
+  bins.assign(binCount + (binCount & 1), 0);
+}
+
+int64_t ZHistogram::key(double z) const {
+  return static_cast<int64_t>(std::floor(std::ldexp(z, -exponent)));
+}
+
+double ZHistogram::binWidth() const {
+  return std::ldexp(1.0, exponent);
+}
+
+void ZHistogram::coarsen() {
+  const int64_t         n = static_cast<int64_t>(bins.size());
+  std::vector<uint64_t> folded(bins.size(), 0);
+  // Keep the folded data centred so it can grow in both directions
+  int64_t               newBase = floorDiv2(base) - n / 4;
+  for (int64_t i = 0; i < n; ++i) {
+    if (bins[i]) {
+      folded[floorDiv2(base + i) - newBase] += bins[i];
+    }
+  }
+  bins.swap(folded);
+  base = newBase;
+  exponent++;
+}
+
+void ZHistogram::rebase(int64_t newBase) {
+  if (newBase == base) {
+    return;
+  }
+  const int64_t         n = static_cast<int64_t>(bins.size());
+  std::vector<uint64_t> moved(bins.size(), 0);
+  for (int64_t i = 0; i < n; ++i) {
+    if (bins[i]) {
+      moved[base + i - newBase] = bins[i];
+    }
+  }
+  bins.swap(moved);
+  base = newBase;
+}
+
+// Makes the window cover [lo, hi] in addition to the values already counted.
+void ZHistogram::cover(double lo, double hi) {
+  if (minZ > maxZ) {
+    // Start with a width far below the magnitude of the first value
+    double mag = std::max(std::fabs(lo), std::fabs(hi));
+    exponent   = (mag > 0.0 ? std::ilogb(mag) : 0) - 40;
+    while (std::ldexp(hi - lo, -exponent) >= static_cast<double>(bins.size() / 2)) {
+      exponent++;
+    }
+    base = key(lo) - static_cast<int64_t>(bins.size() / 4);
+    return;
+  }
+
+  double        newMin = std::min(lo, minZ);
+  double        newMax = std::max(hi, maxZ);
+  const int64_t n      = static_cast<int64_t>(bins.size());
+  while (std::max(std::fabs(std::ldexp(newMin, -exponent)), std::fabs(std::ldexp(newMax, -exponent))) > kMaxKey) {
+    coarsen();
+  }
+  for (;;) {
+    int64_t kLo = key(newMin), kHi = key(newMax);
+    if (kLo >= base && kHi < base + n) {
+      return;
+    }
+    if (kHi - kLo < n) {
+      rebase(kLo - (n - (kHi - kLo + 1)) / 2);
+      return;
+    }
+    coarsen();
+  }
+}
+
+void ZHistogram::add(double z, uint64_t n) {
+  if (std::isnan(z)) {
+    return;
+  }
+  int64_t k = key(z);
+  if (total == 0 || k < base || k >= base + static_cast<int64_t>(bins.size())) {
+    cover(z, z);
+    k = key(z);
+  }
+  bins[k - base] += n;
+  total += n;
+  if (z < minZ) minZ = z;
+  if (z > maxZ) maxZ = z;
+}
+
+void ZHistogram::merge(const ZHistogram& other) {
+  if (other.total == 0) {
+    return;
+  }
+  ZHistogram o = other;
+  if (o.bins.size() != bins.size()) {
+    // Different error bounds: re-bin the other histogram at its bin centres
+    o = ZHistogram(relativeError);
+    for (size_t i = 0; i < other.bins.size(); ++i) {
+      if (other.bins[i]) {
+        double center = (static_cast<double>(other.base + static_cast<int64_t>(i)) + 0.5) * other.binWidth();
+        o.add(std::min(std::max(center, other.minZ), other.maxZ), other.bins[i]);
+      }
+    }
+    o.add(other.minZ, 0);
+    o.add(other.maxZ, 0);
+  }
+
+  if (total == 0) {
+    *this = o;
+    return;
+  }
+
+  while (o.exponent < exponent) {
+    o.coarsen();
+  }
+  while (exponent < o.exponent) {
+    coarsen();
+  }
+  // Widening this window may coarsen it again; keep the two grids in step
+  for (;;) {
+    int before = exponent;
+    cover(o.minZ, o.maxZ);
+    if (exponent == before) {
+      break;
+    }
+    while (o.exponent < exponent) {
+      o.coarsen();
+    }
+  }
+
+  for (size_t i = 0; i < o.bins.size(); ++i) {
+    if (o.bins[i]) {
+      bins[o.base + static_cast<int64_t>(i) - base] += o.bins[i];
+    }
+  }
+  total += o.total;
+  minZ = std::min(minZ, o.minZ);
+  maxZ = std::max(maxZ, o.maxZ);
+}
+
+double ZHistogram::quantile(double q) const {
+  if (total == 0) {
+    return 0.0;
+  }
+  q           = std::min(std::max(q, 0.0), 1.0);
+  double rank = q * static_cast<double>(total - 1);
+
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < bins.size(); ++i) {
+    if (bins[i] == 0) {
+      continue;
+    }
+    if (static_cast<double>(cumulative + bins[i]) > rank) {
+      // Spread the bin's values evenly across its width
+      double frac  = (rank - static_cast<double>(cumulative) + 0.5) / static_cast<double>(bins[i]);
+      double value = (static_cast<double>(base + static_cast<int64_t>(i)) + frac) * binWidth();
+      return std::min(std::max(value, minZ), maxZ);
+    }
+    cumulative += bins[i];
+  }
+  return maxZ;
+}
@@ -4,11 +4,15 @@
 #include <vector>
 #include <cmath>
 #include <fstream>
+#include <stdexcept>
 #include <liblas/liblas.hpp>
 #include "gdal_priv.h"
 #include "ogrsf_frmts.h"
 #include "PointCollector.hpp"
 #include "InputProcessor.hpp"
+#include "LasOutput.hpp"
+#include "MultiInput.hpp"
+#include "Profiler.hpp"
 
 #include <cxxopts.hpp>
 
@@ -23,6 +27,150 @@ bool isLazFile(const std::string& filename) {
   return ext == ".laz";
 }
 
+// Settings shared by the two-pass and single-pass conversions.
+struct ConversionOptions {
+  double              scale;
+  bool                colorize;
+  double              colorError; // histogram bin width relative to the Z range
+  std::vector<double> offset;  // empty = derive from the data
+  int                 threads; // 0 = all cores
+  bool                ordered;
+  ColumnSchema        columns; // field layout of XYZ text input
+  InputEngine         inputEngine;
+  bool                directIO;
+  OutputOptions       output;
+  bool                stats;       // print the per-phase profile
+  std::string         profileJson; // also write it to this file
+};
+
+uint64_t fileBytes(const std::string& filename) {
+  if (isStream(filename)) {
+    return 0; // opening it again would wait for another writer
+  }
+  std::ifstream in(filename, std::ios::in | std::ios::binary | std::ios::ate);
+  return in.is_open() ? static_cast<uint64_t>(in.tellg()) : 0;
+}
+
+uint64_t totalBytes(const std::vector<std::string>& filenames) {
+  uint64_t total = 0;
+  for (const auto& filename : filenames) {
+    total += fileBytes(filename);
+  }
+  return total;
+}
+
+// Prints and/or saves the phase profile as requested.
+bool reportProfile(const Profiler& profiler, const ConversionOptions& opts) {
+  if (opts.stats) {
+    profiler.printTable(std::cout);
+  }
+  if (!opts.profileJson.empty() && !profiler.writeJson(opts.profileJson)) {
+    std::cerr << "Cannot write profile: " << opts.profileJson << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Sets up the fields shared by the two-pass and single-pass writers.
+void configureHeader(liblas::Header& header, double scale, int pointFormat,
+                     const std::string& srsWKT, const std::string& outputFilename) {
+  header.SetVersionMajor(1);
+  header.SetVersionMinor(2);
+
+  if (!srsWKT.empty()) {
+    liblas::SpatialReference srs;
+    try {
+      srs.SetWKT(srsWKT);
+      header.SetSRS(srs);
+      std::cout << "Spatial Reference system set from input metadata." << std::endl;
+    } catch (...) {
+    }
+  }
+
+  header.SetScale(scale, scale, scale);
+  header.SetDataFormatId(static_cast<liblas::PointFormatName>(pointFormat));
+  if (isLazFile(outputFilename)) {
+    header.SetCompressed(true);
+  }
+}
+
+// Streams every input straight to the output behind a placeholder header, then
+// back-patches the point count and bounds. The quantization offset is either
+// user supplied or derived from the first buffered chunk of points.
+int convertSinglePass(const std::vector<std::string>& inputFilenames, const std::string& outputFilename,
+                      const ConversionOptions& opts) {
+  std::string    srsWKT = "";
+  Profiler       profiler(opts.stats || !opts.profileJson.empty());
+  LasOutput      output;
+  bool           opened = false;
+  PointCollector pc;
+  pc.threads     = opts.threads;
+  pc.ordered     = opts.ordered;
+  pc.columns     = &opts.columns;
+  pc.inputEngine = opts.inputEngine;
+  pc.directIO    = opts.directIO;
+  pc.openWriter  = [&](PointCollector& c) {
+    liblas::Header header;
+    configureHeader(header, opts.scale, opts.columns.pointFormat(false), srsWKT, outputFilename);
+    if (opts.offset.size() == 3) {
+      header.SetOffset(opts.offset[0], opts.offset[1], opts.offset[2]);
+    } else {
+      header.SetOffset(std::floor(c.minX), std::floor(c.minY), std::floor(c.minZ));
+    }
+    if (!output.open(outputFilename, header, opts.output)) {
+      throw std::runtime_error("Cannot open output file: " + outputFilename);
+    }
+    output.attach(c);
+    opened = true;
+  };
+
+  try {
+    std::string failedInput;
+    profiler.begin("write");
+    if (!processInputs(inputFilenames, pc, srsWKT, failedInput)) {
+      std::cerr << "Cannot open or process input file: " << failedInput << std::endl;
+      return 1;
+    }
+    pc.flush();
+    profiler.end(pc.count, totalBytes(inputFilenames), 0);
+  } catch (std::exception const& e) {
+    std::cerr << "Error during writing: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if (pc.count == 0 || !opened) {
+    std::cerr << "No valid points found." << std::endl;
+    return 1;
+  }
+
+  try {
+    profiler.begin("finalize");
+    if (!output.close(pc)) {
+      std::cerr << "Cannot finalize output file: " << outputFilename << std::endl;
+      if (!opts.output.las14 && !output.tiles && output.pointCount(pc) > uint64_t(UINT32_MAX)) {
+        std::cerr << "LAS 1.2 holds at most 4294967295 points; write LAS 1.4 with --las-version 1.4." << std::endl;
+      }
+      return 1;
+    }
+    profiler.end(output.pointCount(pc), 0, output.tiles ? 0 : fileBytes(outputFilename));
+  } catch (std::exception const& e) {
+    std::cerr << "Error during writing: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << "Bounds: [" << pc.minX << ", " << pc.minY << ", " << pc.minZ << "] - ["
+            << pc.maxX << ", " << pc.maxY << ", " << pc.maxZ << "]" << std::endl;
+  std::cout << "Successfully wrote " << output.pointCount(pc) << " points";
+  if (output.tiles) {
+    std::cout << " into " << output.tiles->tileCount() << " tiles";
+  }
+  if (output.dedupe) {
+    std::cout << " (" << output.dedupe->duplicateCount() << " duplicates removed)";
+  }
+  std::cout << "." << std::endl;
+  return reportProfile(profiler, opts) ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
   GDALAllRegister();
   OGRRegisterAll();
@@ -32,10 +180,31 @@ int main(int argc, char* argv[]) {
     ("positional", "Positional arguments (inputs... output)", cxxopts::value<std::vector<std::string>>())
     ("s,scale", "Scale factor", cxxopts::value<double>()->default_value("0.01"))
     ("c,color", "Colorize points based on Z-height (dark to light)", cxxopts::value<bool>()->default_value("false"))
+    ("color-error", "Max error of the --color percentiles, relative to the Z range", cxxopts::value<double>()->default_value("0.001"))
+    ("single-pass", "Read inputs once and back-patch the LAS header (not compatible with --color)", cxxopts::value<bool>()->default_value("false"))
+    ("j,threads", "Parser threads (0 = all cores)", cxxopts::value<int>()->default_value("0"))
+    ("unordered", "Let parallel parsing write points out of input order (faster)", cxxopts::value<bool>()->default_value("false"))
+    ("inflight-mb", "Memory budget (MB) for point batches in flight between the parse, encode and write stages (0 = no pipelining)", cxxopts::value<int>()->default_value("256"))
+    ("sort", "Reorder output points along a space-filling curve: none, morton or hilbert", cxxopts::value<std::string>()->default_value("none"))
+    ("sort-memory-mb", "Memory (MB) for sorted runs, the voxel filter or the --dedupe set before they spill to temporary files next to the output", cxxopts::value<int>()->default_value("1024"))
+    ("tile-size", "Write a grid of square tiles of this size (map units) named <output>_<col>_<row>.las|laz instead of one file", cxxopts::value<double>()->default_value("0"))
+    ("voxel-size", "Thin to one point per cubic voxel of this size (map units, 0 = keep all points)", cxxopts::value<double>()->default_value("0"))
+    ("voxel-mode", "Point kept per voxel: first, center (closest to the voxel center) or average", cxxopts::value<std::string>()->default_value("first"))
+    ("dedupe", "Drop points whose quantized X, Y and Z repeat an earlier point's", cxxopts::value<bool>()->default_value("false"))
+    ("lax", "Also write a LASindex spatial index (<output>.lax) so box queries can skip most of the file", cxxopts::value<bool>()->default_value("false"))
+    ("stats", "Print wall/CPU time, points, bytes, page faults per phase and hardware counters for the whole run", cxxopts::value<bool>()->default_value("false"))
+    ("profile-json", "Write the per-phase profile to this JSON file", cxxopts::value<std::string>())
+    ("columns", "Fields of XYZ text lines, e.g. x,y,z,i,r,g,b,skip,c (i intensity, r/g/b color, c class, n return number, m number of returns, t GPS time); picks LAS point format 0-3", cxxopts::value<std::string>()->default_value("x,y,z"))
+    ("input-engine", "How uncompressed XYZ files are read: mmap (memory mapped) or uring (deep-queued io_uring reads, for cold files on fast storage)", cxxopts::value<std::string>()->default_value("mmap"))
+    ("direct-io", "With --input-engine uring, read with O_DIRECT and bypass the page cache", cxxopts::value<bool>()->default_value("false"))
+    ("output-buffer-mb", "Size (MB) of each of the two output file buffers, written in large aligned writes by a background thread (0 = plain buffered stream)", cxxopts::value<int>()->default_value("16"))
+    ("output-direct-io", "Write the output file with O_DIRECT, keeping it out of the page cache", cxxopts::value<bool>()->default_value("false"))
+    ("las-version", "LAS version of the output: 1.2 (point formats 0-3) or 1.4 (formats 6-7, 64-bit point counts; single uncompressed .las files only). Two-pass 1.2 output switches to 1.4 past 4294967295 points", cxxopts::value<std::string>()->default_value("1.2"))
+    ("offset", "Quantization offset x,y,z (single-pass default: floor of the first chunk minimum)", cxxopts::value<std::vector<double>>())
     ("h,help", "Print usage");
 
   options.parse_positional({"positional"});
-  options.positional_help("<input1.xyz> [input2.xyz ...] <output.las|laz>");
+  options.positional_help("<input1.xyz|-> [input2.xyz ...] <output.las|laz>");
 
   cxxopts::ParseResult result;
   try {
@@ -68,22 +237,145 @@ int main(int argc, char* argv[]) {
   files.pop_back();
   std::vector<std::string> inputFilenames = files;
 
-  double scale = result["scale"].as<double>();
-  bool colorize = result["color"].as<bool>();
+  ConversionOptions opts;
+  opts.scale    = result["scale"].as<double>();
+  opts.colorize = result["color"].as<bool>();
+  opts.colorError = result["color-error"].as<double>();
+  opts.threads  = result["threads"].as<int>();
+  opts.ordered  = !result["unordered"].as<bool>();
+  opts.output.threads         = opts.threads;
+  opts.output.inflightBytes   = static_cast<size_t>(std::max(0, result["inflight-mb"].as<int>())) * 1024 * 1024;
+  opts.output.spillMemoryBytes = static_cast<size_t>(std::max(1, result["sort-memory-mb"].as<int>())) * 1024 * 1024;
+  opts.output.tileSize        = result["tile-size"].as<double>();
+  if (opts.output.tileSize < 0.0) {
+    std::cerr << "Error: --tile-size must not be negative." << std::endl;
+    return 1;
+  }
+  opts.output.voxelSize = result["voxel-size"].as<double>();
+  if (opts.output.voxelSize < 0.0) {
+    std::cerr << "Error: --voxel-size must not be negative." << std::endl;
+    return 1;
+  }
+  if (!parseVoxelMode(result["voxel-mode"].as<std::string>(), opts.output.voxelMode)) {
+    std::cerr << "Error: --voxel-mode expects first, center or average." << std::endl;
+    return 1;
+  }
+  if (!parseSortOrder(result["sort"].as<std::string>(), opts.output.sort)) {
+    std::cerr << "Error: --sort expects none, morton or hilbert." << std::endl;
+    return 1;
+  }
+  std::string columnsError;
+  if (!ColumnSchema::parse(result["columns"].as<std::string>(), opts.columns, columnsError)) {
+    std::cerr << "Error: --columns: " << columnsError << "." << std::endl;
+    return 1;
+  }
+  if (opts.colorize && opts.columns.hasColor()) {
+    std::cerr << "Error: --color replaces the point colors and cannot be combined with r, g, b columns." << std::endl;
+    return 1;
+  }
+  if (!parseInputEngine(result["input-engine"].as<std::string>(), opts.inputEngine)) {
+    std::cerr << "Error: --input-engine expects mmap or uring." << std::endl;
+    return 1;
+  }
+  opts.directIO = result["direct-io"].as<bool>();
+  if (opts.directIO && opts.inputEngine != kInputEngineUring) {
+    std::cerr << "Error: --direct-io applies to --input-engine uring only." << std::endl;
+    return 1;
+  }
+  if (opts.inputEngine == kInputEngineUring && !uringAvailable()) {
+    std::cout << "io_uring is not available; the uring engine falls back to blocking reads." << std::endl;
+  }
+  opts.output.bufferBytes = static_cast<size_t>(std::max(0, result["output-buffer-mb"].as<int>())) * 1024 * 1024;
+  opts.output.directIO    = result["output-direct-io"].as<bool>();
+  if (opts.output.directIO && opts.output.bufferBytes == 0) {
+    std::cerr << "Error: --output-direct-io needs output buffers (--output-buffer-mb above 0)." << std::endl;
+    return 1;
+  }
+  opts.output.dedupe = result["dedupe"].as<bool>();
+  opts.stats         = result["stats"].as<bool>();
+  if (result.count("profile-json")) {
+    opts.profileJson = result["profile-json"].as<std::string>();
+  }
+  bool singlePass = result["single-pass"].as<bool>();
+  std::string lasVersion = result["las-version"].as<std::string>();
+  if (lasVersion != "1.2" && lasVersion != "1.4") {
+    std::cerr << "Error: --las-version expects 1.2 or 1.4." << std::endl;
+    return 1;
+  }
+  opts.output.las14 = lasVersion == "1.4";
+  if (opts.output.las14 && (isLazFile(outputFilename) || opts.output.tileSize > 0.0)) {
+    std::cerr << "Error: LAS 1.4 is written as a single uncompressed .las file; LAZ and --tile-size output stay on LAS 1.2." << std::endl;
+    return 1;
+  }
+  opts.output.lax = result["lax"].as<bool>();
+  if (opts.output.lax && opts.output.tileSize > 0.0) {
+    std::cerr << "Error: --lax indexes a single LAS/LAZ file and cannot be combined with --tile-size." << std::endl;
+    return 1;
+  }
+
+  if (result.count("offset")) {
+    opts.offset = result["offset"].as<std::vector<double>>();
+    if (opts.offset.size() != 3) {
+      std::cerr << "Error: --offset expects three comma separated values (x,y,z)." << std::endl;
+      return 1;
+    }
+  }
 
-  std::vector<double> zValues;
-  std::string         srsWKT = "";
-  PointCollector      pc1;
-  pc1.colorize = colorize;
-  pc1.zValues  = &zValues;
+  // Standard input, pipes, FIFOs and character devices can be read only
+  // once, so they always take the single pass
+  size_t stdinInputs = std::count(inputFilenames.begin(), inputFilenames.end(), std::string(kStdinName));
+  if (stdinInputs > 1) {
+    std::cerr << "Error: Standard input (-) can be given only once." << std::endl;
+    return 1;
+  }
+  auto stream = std::find_if(inputFilenames.begin(), inputFilenames.end(), isStream);
+  if (stream != inputFilenames.end() && !singlePass) {
+    if (opts.colorize) {
+      std::cerr << "Error: --color needs two passes over the input and cannot read " << *stream
+                << ", which is a stream (standard input, pipe, FIFO or device)." << std::endl;
+      return 1;
+    }
+    std::cout << "Reading stream input " << *stream << " in a single pass." << std::endl;
+    singlePass = true;
+  }
 
-  for (const auto& inputFilename : inputFilenames) {
-    std::cout << "Processing " << inputFilename << std::endl;
-    if (!processInput(inputFilename, pc1, srsWKT)) {
-      std::cerr << "Cannot open or process input file: " << inputFilename << std::endl;
+  if (singlePass) {
+    if (opts.colorize) {
+      std::cerr << "Error: --color needs the Z distribution up front and cannot be combined with --single-pass." << std::endl;
       return 1;
     }
-    std::cout << std::endl;
+    return convertSinglePass(inputFilenames, outputFilename, opts);
+  }
+
+  if (!(opts.colorError > 0.0 && opts.colorError < 1.0)) {
+    std::cerr << "Error: --color-error must be between 0 and 1." << std::endl;
+    return 1;
+  }
+
+  Profiler       profiler(opts.stats || !opts.profileJson.empty());
+  uint64_t       inputBytes = totalBytes(inputFilenames);
+  ZHistogram     zHistogram(opts.colorError);
+  std::string    srsWKT = "";
+  PointCollector pc1;
+  pc1.colorize    = opts.colorize;
+  pc1.zHistogram  = &zHistogram;
+  pc1.threads     = opts.threads;
+  pc1.columns     = &opts.columns;
+  pc1.inputEngine = opts.inputEngine;
+  pc1.directIO    = opts.directIO;
+  pc1.specialize();
+
+  std::string failedInput;
+  try {
+    profiler.begin("scan");
+    if (!processInputs(inputFilenames, pc1, srsWKT, failedInput)) {
+      std::cerr << "Cannot open or process input file: " << failedInput << std::endl;
+      return 1;
+    }
+    profiler.end(pc1.count, inputBytes, 0);
+  } catch (std::exception const& e) {
+    std::cerr << "Error during reading: " << e.what() << std::endl;
+    return 1;
   }
 
   if (pc1.count == 0) {
@@ -95,42 +387,42 @@ int main(int argc, char* argv[]) {
   std::cout << "Bounds: [" << pc1.minX << ", " << pc1.minY << ", " << pc1.minZ << "] - ["
             << pc1.maxX << ", " << pc1.maxY << ", " << pc1.maxZ << "]" << std::endl;
 
-  // Configure LAS Header
-  liblas::Header header;
-  header.SetVersionMajor(1);
-  header.SetVersionMinor(2);
-
-  if (!srsWKT.empty()) {
-    liblas::SpatialReference srs;
-    try {
-      srs.SetWKT(srsWKT);
-      header.SetSRS(srs);
-      std::cout << "Spatial Reference system set from input metadata." << std::endl;
-    } catch (...) {
+  // Tiles split the count; a single file past the 32-bit count needs LAS 1.4
+  if (pc1.count > uint64_t(UINT32_MAX) && !opts.output.las14 && opts.output.tileSize <= 0.0) {
+    if (isLazFile(outputFilename)) {
+      std::cerr << "Error: More than 4294967295 points need LAS 1.4, which is written only as uncompressed .las." << std::endl;
+      return 1;
     }
+    std::cout << "More than 4294967295 points: writing LAS 1.4." << std::endl;
+    opts.output.las14 = true;
+  }
+  if (pc1.count > uint64_t(UINT32_MAX) && opts.output.lax) {
+    std::cerr << "Error: --lax indexes at most 4294967295 points." << std::endl;
+    return 1;
   }
 
-  header.SetScale(scale, scale, scale);
-  header.SetPointRecordsCount(pc1.count);
+  // Configure LAS Header
+  liblas::Header header;
+  configureHeader(header, opts.scale, opts.columns.pointFormat(opts.colorize), srsWKT, outputFilename);
+  // liblas counts are 32-bit; LAS 1.4 output gets the full count on close
+  header.SetPointRecordsCount(static_cast<uint32_t>(std::min<uint64_t>(pc1.count, UINT32_MAX)));
   header.SetMin(pc1.minX, pc1.minY, pc1.minZ);
   header.SetMax(pc1.maxX, pc1.maxY, pc1.maxZ);
-  header.SetOffset(std::floor(pc1.minX), std::floor(pc1.minY), std::floor(pc1.minZ));
-  header.SetDataFormatId(colorize ? liblas::ePointFormat2 : liblas::ePointFormat0);
-  if (isLazFile(outputFilename)) {
-    header.SetCompressed(true);
+  if (opts.offset.size() == 3) {
+    header.SetOffset(opts.offset[0], opts.offset[1], opts.offset[2]);
+  } else {
+    header.SetOffset(std::floor(pc1.minX), std::floor(pc1.minY), std::floor(pc1.minZ));
   }
 
   // Compute percentile-based Z range for colorization
   double colorMinZ = pc1.minZ;
   double colorMaxZ = pc1.maxZ;
-  if (colorize && !zValues.empty()) {
-    std::cout << "Calculating Z percentiles for colorization..." << std::endl;
-    std::sort(zValues.begin(), zValues.end());
-    colorMinZ = zValues[static_cast<size_t>(zValues.size() * 0.02)];
-    colorMaxZ = zValues[std::min(static_cast<size_t>(zValues.size() * 0.98), zValues.size() - 1)];
+  if (opts.colorize && zHistogram.total > 0) {
+    profiler.begin("percentiles");
+    colorMinZ = zHistogram.quantile(0.02);
+    colorMaxZ = zHistogram.quantile(0.98);
+    profiler.end(zHistogram.total, 0, 0);
     std::cout << "Color Z range (2nd-98th percentile): [" << colorMinZ << ", " << colorMaxZ << "]" << std::endl;
-    zValues.clear();
-    zValues.shrink_to_fit();
   }
   double zRange = colorMaxZ - colorMinZ;
   if (zRange == 0.0) {
@@ -140,31 +432,58 @@ int main(int argc, char* argv[]) {
 
   // Create Writer and Second Pass
   try {
-    std::ofstream ofs(outputFilename, std::ios::out | std::ios::binary);
-    if (!ofs.is_open()) {
+    profiler.begin("write");
+    LasOutput output;
+    if (!output.open(outputFilename, header, opts.output)) {
       std::cerr << "Cannot open output file: " << outputFilename << std::endl;
       return 1;
     }
-    liblas::Writer writer(ofs, header);
     PointCollector pc2;
-    pc2.colorize    = colorize;
-    pc2.header      = &header;
-    pc2.writer      = &writer;
+    output.attach(pc2);
+    pc2.colorize    = opts.colorize;
     pc2.colorMinZ   = colorMinZ;
     pc2.zFactor     = zFactor;
     pc2.totalPoints = pc1.count;
+    pc2.threads     = opts.threads;
+    pc2.ordered     = opts.ordered;
+    pc2.columns     = &opts.columns;
+    pc2.inputEngine = opts.inputEngine;
+    pc2.directIO    = opts.directIO;
+    // Batch kernels for this output's format and color mode, chosen once
+    pc2.specialize();
+
+    // Progress is sampled off the hot path by a background reporter
+    std::atomic<long> written(0);
+    pc2.progress = &written;
+    ProgressReporter progress("Writing points", static_cast<long>(pc1.count), written);
+
+    std::string dummySrs;
+    if (!processInputs(inputFilenames, pc2, dummySrs, failedInput)) {
+      std::cerr << "Cannot open or process input file: " << failedInput << std::endl;
+      return 1;
+    }
+    progress.stop();
+    profiler.end(pc2.count, inputBytes, 0);
 
-    for (const auto& inputFilename : inputFilenames) {
-      std::string dummySrs;
-      processInput(inputFilename, pc2, dummySrs);
-      std::cout << std::endl;
+    profiler.begin("finalize");
+    if (!output.close(pc2)) {
+      std::cerr << "Cannot finalize output file: " << outputFilename << std::endl;
+      return 1;
     }
+    profiler.end(output.pointCount(pc2), 0, output.tiles ? 0 : fileBytes(outputFilename));
 
-    std::cout << "Successfully wrote " << pc2.count << " points." << std::endl;
+    std::cout << "Successfully wrote " << output.pointCount(pc2) << " points";
+    if (output.tiles) {
+      std::cout << " into " << output.tiles->tileCount() << " tiles";
+    }
+    if (output.dedupe) {
+      std::cout << " (" << output.dedupe->duplicateCount() << " duplicates removed)";
+    }
+    std::cout << "." << std::endl;
   } catch (std::exception const& e) {
     std::cerr << "Error during writing: " << e.what() << std::endl;
     return 1;
   }
 
-  return 0;
+  return reportProfile(profiler, opts) ? 0 : 1;
 }
@@ -1,13 +1,57 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
 #include <fstream>
+#include <iostream>
+#include <iterator>
 #include <cstdio>
 #include <limits>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#if defined(XYZ2LAS_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+#if defined(XYZ2LAS_HAVE_BZIP2)
+#include <bzlib.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
 
 #include "gdal_priv.h"
+#include "AlignedFileBuf.hpp"
+#include "ColumnSchema.hpp"
+#include "CompressedInput.hpp"
 #include "PointCollector.hpp"
 #include "InputProcessor.hpp"
+#include "HeaderPatcher.hpp"
+#include "StructuralScanner.hpp"
+#include "ZHistogram.hpp"
+#include "LasEncoder.hpp"
+#include "LasOutput.hpp"
+#include "PointPipeline.hpp"
+#include "LazChunkSink.hpp"
+#include "MultiInput.hpp"
+#include "VectorReader.hpp"
+#include "SortingSink.hpp"
+#include "TileSink.hpp"
+#include "DedupeSink.hpp"
+#include "LaxIndex.hpp"
+#include "Profiler.hpp"
+#include "UringReader.hpp"
+#include "VoxelFilter.hpp"
 
 TEST_CASE("XYZ Parser handles basic files", "[parser]") {
     // Create a temporary test file
@@ -54,6 +98,56 @@ TEST_CASE("XYZ Parser handles empty and invalid files", "[parser]") {
     std::remove(test_file);
 }
 
+TEST_CASE("XYZ Parser gives identical results on multiple threads", "[parser]") {
+    const char* test_file = "test_parallel.xyz";
+    std::ofstream out(test_file);
+    for (int i = 0; i < 200000; ++i) {
+        if (i % 1000 == 0) out << "# comment\n";
+        out << i << ".5 " << (i % 97) << " " << -i << "\r\n";
+    }
+    out.close();
+
+    PointCollector serial;
+    serial.quiet = true;
+    REQUIRE(processXYZ(test_file, serial));
+
+    PointCollector parallel;
+    parallel.quiet   = true;
+    parallel.threads = 4;
+    REQUIRE(processXYZ(test_file, parallel));
+
+    REQUIRE(parallel.count == serial.count);
+    REQUIRE(parallel.count == 200000);
+    REQUIRE(parallel.minX == serial.minX);
+    REQUIRE(parallel.maxX == serial.maxX);
+    REQUIRE(parallel.minZ == serial.minZ);
+    REQUIRE(parallel.maxY == serial.maxY);
+
+    std::remove(test_file);
+}
+
+TEST_CASE("Structural scanner finds field starts and newlines", "[parser]") {
+    std::string text = "1.0 2.0\t3.0\r\n# comment\n\n   7 8 9";
+    while (text.size() < 200) {
+        text += "\n  10.5\t-11 12e1 ";
+    }
+
+    std::vector<uint32_t> expected;
+    for (size_t i = 0; i < text.size(); ++i) {
+        bool sep     = text[i] == ' ' || text[i] == '\t' || text[i] == '\r' || text[i] == '\n';
+        bool prevSep = i == 0 || text[i - 1] == ' ' || text[i - 1] == '\t' || text[i - 1] == '\r' || text[i - 1] == '\n';
+        if (text[i] == '\n' || (!sep && prevSep)) {
+            expected.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    for (int level = kScannerScalar; level <= detectScannerLevel(); ++level) {
+        std::vector<uint32_t> indices;
+        scanStructure(text.data(), text.data() + text.size(), indices, static_cast<ScannerLevel>(level));
+        REQUIRE(indices == expected);
+    }
+}
+
 TEST_CASE("XYZ Parser Benchmark", "[benchmark]") {
     const char* test_file = "test_bench.xyz";
     
@@ -73,6 +167,1171 @@ TEST_CASE("XYZ Parser Benchmark", "[benchmark]") {
     std::remove(test_file);
 }
 
+TEST_CASE("Z histogram estimates percentiles within its error bound", "[color]") {
+    ZHistogram all(0.001), even(0.001), odd(0.001);
+    for (int i = 0; i < 100000; ++i) {
+        double z = 250.0 + i * 0.01; // Z range of 1000
+        all.add(z);
+        (i % 2 ? odd : even).add(z);
+    }
+    even.merge(odd);
+
+    REQUIRE(all.total == 100000);
+    REQUIRE(even.total == 100000);
+    REQUIRE(std::fabs(all.quantile(0.02) - 270.0) <= 1.0);
+    REQUIRE(std::fabs(all.quantile(0.98) - 1230.0) <= 1.0);
+    REQUIRE(std::fabs(even.quantile(0.02) - all.quantile(0.02)) <= 1.0);
+    REQUIRE(std::fabs(even.quantile(0.98) - all.quantile(0.98)) <= 1.0);
+    REQUIRE(all.quantile(0.0) == 250.0);
+}
+
+struct MemorySink : RecordSink {
+    std::string bytes;
+    size_t      records = 0;
+    void write(const char* data, size_t count, size_t recordLength) override {
+        bytes.append(data, count * recordLength);
+        records += count;
+    }
+};
+
+// Raw X, Y, Z of point `i`, given the next value of a linear congruential
+// generator started at the fixture's seed.
+typedef std::function<void(size_t i, uint32_t random, int32_t xyz[3])> RecordPosition;
+
+// Packed point format 0 records of `count` points placed by `position`, and a
+// header that stores raw coordinates as they are (unit scale, zero offset).
+static std::vector<char> makeFormat0Records(size_t count, uint32_t seed, liblas::Header& header,
+                                            const RecordPosition& position) {
+    header.SetScale(1.0, 1.0, 1.0);
+    header.SetOffset(0.0, 0.0, 0.0);
+    header.SetDataFormatId(liblas::ePointFormat0);
+
+    std::vector<char> records(count * 20, 0);
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        int32_t xyz[3] = {0, 0, 0};
+        position(i, seed, xyz);
+        std::memcpy(&records[i * 20], xyz, sizeof(xyz));
+    }
+    return records;
+}
+
+TEST_CASE("LAS encoder packs quantized records", "[writer]") {
+    liblas::Header header;
+    header.SetScale(0.01, 0.01, 0.01);
+    header.SetOffset(100.0, 200.0, 0.0);
+    header.SetDataFormatId(liblas::ePointFormat2);
+
+    MemorySink      sink;
+    LasPointEncoder encoder(header, sink, 2);
+    encoder.add(100.5, 199.99, -1.234, 1, 2, 3);
+    REQUIRE(sink.records == 0);
+    encoder.add(101.0, 200.0, 0.005, 0, 0, 65535);
+    REQUIRE(sink.records == 2); // batch of two flushed
+    encoder.add(102.0, 201.0, 1.0, 0, 0, 0);
+    encoder.flush();
+    REQUIRE(sink.records == 3);
+    REQUIRE(sink.bytes.size() == 3 * 26);
+
+    int32_t  xyz[3];
+    uint16_t rgb[3];
+    std::memcpy(xyz, sink.bytes.data(), sizeof(xyz));
+    std::memcpy(rgb, sink.bytes.data() + 20, sizeof(rgb));
+    REQUIRE(xyz[0] == 50);
+    REQUIRE(xyz[1] == -1);
+    REQUIRE(xyz[2] == -123);
+    REQUIRE(rgb[0] == 1);
+    REQUIRE(rgb[2] == 3);
+
+    std::memcpy(xyz, sink.bytes.data() + 26, sizeof(xyz));
+    REQUIRE(xyz[2] == 1); // 0.5 rounds away from zero
+}
+
+TEST_CASE("Pipelined encode and write stages keep point order", "[writer]") {
+    liblas::Header header;
+    header.SetScale(1.0, 1.0, 1.0);
+    header.SetDataFormatId(liblas::ePointFormat0);
+
+    MemorySink      sink;
+    AsyncSink       async(sink, 1 << 20, 100 * 20);
+    LasPointEncoder encoder(header, async, 100);
+
+    PointCollector pc;
+    pc.quiet   = true;
+    pc.header  = &header;
+    pc.encoder = &encoder;
+    {
+        PointPipeline pipeline(pc, 4 * PointPipeline::batchBytes());
+        pc.pipeline = &pipeline;
+        pc.specialize();
+        for (int i = 0; i < 200000; ++i) {
+            pc.addPoint(i, 0.0, 0.0);
+        }
+        pipeline.finish();
+        pc.pipeline = nullptr;
+    }
+    encoder.flush();
+    async.close();
+
+    REQUIRE(pc.count == 200000);
+    REQUIRE(sink.records == 200000);
+    bool ordered = true;
+    for (int i = 0; i < 200000 && ordered; ++i) {
+        int32_t x;
+        std::memcpy(&x, sink.bytes.data() + i * 20, sizeof(x));
+        ordered = x == i;
+    }
+    REQUIRE(ordered);
+}
+
+TEST_CASE("Pipelined write pass keeps its rings within the in-flight budget", "[writer]") {
+    liblas::Header header;
+    header.SetScale(1.0, 1.0, 1.0);
+    header.SetDataFormatId(liblas::ePointFormat0);
+
+    const char* test_file = "test_inflight.las";
+    for (size_t megabytes : {16, 48, 100, 256}) {
+        OutputOptions options;
+        options.inflightBytes = megabytes << 20;
+        LasOutput      output;
+        PointCollector pc;
+        pc.quiet = true;
+        REQUIRE(output.open(test_file, header, options));
+        output.attach(pc);
+        REQUIRE(output.pipeline != nullptr);
+        REQUIRE(output.asyncSink != nullptr);
+        REQUIRE(output.pipeline->slotBytes() + output.asyncSink->slotBytes() <= options.inflightBytes);
+        pc.addPoint(1.0, 2.0, 3.0);
+        pc.flush();
+        REQUIRE(output.close(pc));
+    }
+    std::remove(test_file);
+}
+
+TEST_CASE("Sorting sink orders records along a space-filling curve out of core", "[writer]") {
+    // Consecutive Hilbert keys of a 16x16 grid are neighbouring cells
+    std::vector<std::pair<uint64_t, int>> cells;
+    for (int x = 0; x < 16; ++x) {
+        for (int y = 0; y < 16; ++y) {
+            cells.push_back(std::make_pair(hilbertKey(x, y), x * 16 + y));
+        }
+    }
+    std::sort(cells.begin(), cells.end());
+    for (size_t i = 1; i < cells.size(); ++i) {
+        int a = cells[i - 1].second, b = cells[i].second;
+        REQUIRE(std::abs(a / 16 - b / 16) + std::abs(a % 16 - b % 16) == 1);
+    }
+
+    const size_t      count = 100000;
+    liblas::Header    header;
+    std::vector<char> records = makeFormat0Records(count, 0, header, [](size_t i, uint32_t, int32_t xyz[3]) {
+        xyz[0] = static_cast<int32_t>((i * 7919) % 4001) - 2000;
+        xyz[1] = static_cast<int32_t>((i * 104729) % 3001) - 1500;
+        xyz[2] = static_cast<int32_t>(i);
+    });
+
+    MemorySink inMemory, spilled;
+    SortingSink whole(inMemory, kSortMorton, 64 << 20, "test_sort");
+    whole.write(records.data(), count, 20);
+    whole.close();
+    REQUIRE(whole.runCount() == 0);
+
+    SortingSink runs(spilled, kSortMorton, 1 << 20, "test_sort");
+    for (size_t i = 0; i < count; i += 1000) {
+        runs.write(&records[i * 20], 1000, 20);
+    }
+    runs.close();
+    REQUIRE(runs.runCount() > 1);
+    REQUIRE(spilled.records == count);
+    REQUIRE(spilled.bytes == inMemory.bytes);
+
+    bool sorted = true;
+    for (size_t i = 1; i < count; ++i) {
+        sorted = sorted && curveKey(kSortMorton, &spilled.bytes[(i - 1) * 20]) <= curveKey(kSortMorton, &spilled.bytes[i * 20]);
+    }
+    REQUIRE(sorted);
+    std::ifstream leftover("test_sort.sort0.tmp");
+    REQUIRE_FALSE(leftover.is_open());
+}
+
+TEST_CASE("Tile sink splits records into per-tile files with their own headers", "[writer]") {
+    // 300 tiles of 10 x 10 units, more than the sink keeps open at once
+    liblas::Header    header;
+    std::vector<char> records = makeFormat0Records(30000, 0, header, [](size_t i, uint32_t, int32_t xyz[3]) {
+        xyz[0] = static_cast<int32_t>(i % 300) * 10 + 5;
+        xyz[1] = -static_cast<int32_t>(i % 7);
+        xyz[2] = static_cast<int32_t>(i);
+    });
+    {
+        TileSink tiles(header, "test_tiles.las", 10.0, 2);
+        tiles.write(records.data(), 30000, 20);
+        tiles.close();
+        REQUIRE(tiles.tileCount() == 600);
+    }
+
+    std::string path = TileSink::tilePath("test_tiles.las", 42, -1);
+    REQUIRE(path == "test_tiles_42_-1.las");
+    std::ifstream in(path, std::ios::binary);
+    REQUIRE(in.is_open());
+    uint32_t count = 0;
+    in.seekg(107);
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    REQUIRE(count == 85); // points of column 42 with y < 0
+    double bounds[4];
+    in.seekg(179);
+    in.read(reinterpret_cast<char*>(bounds), sizeof(bounds));
+    REQUIRE(bounds[0] == 425.0); // max X
+    REQUIRE(bounds[1] == 425.0); // min X
+    REQUIRE(bounds[2] == -1.0);  // max Y
+    REQUIRE(bounds[3] == -6.0);  // min Y
+    in.close();
+
+    for (int column = 0; column < 300; ++column) {
+        std::remove(TileSink::tilePath("test_tiles.las", column, 0).c_str());
+        std::remove(TileSink::tilePath("test_tiles.las", column, -1).c_str());
+    }
+}
+
+TEST_CASE("LAX index covers every point with the intervals of its cell", "[writer]") {
+    // Runs of nearby points, as scan lines would produce
+    const uint32_t    count = 200000;
+    liblas::Header    header;
+    std::vector<char> records = makeFormat0Records(count, 12345, header, [](size_t i, uint32_t random, int32_t xyz[3]) {
+        xyz[0] = static_cast<int32_t>((i / 100) % 2000);
+        xyz[1] = static_cast<int32_t>(random % 1500) - 500;
+    });
+    header.SetMin(0.0, -500.0, 0.0);
+    header.SetMax(1999.0, 999.0, 0.0);
+    header.SetPointRecordsCount(count);
+
+    // Indexed as points pass (bounds known) and from the spooled X/Y
+    std::string files[2] = {"test_lax_direct.lax", "test_lax_spooled.lax"};
+    for (int mode = 0; mode < 2; ++mode) {
+        MemorySink   out;
+        LaxIndexSink lax(out, header, files[mode], mode == 0);
+        for (uint32_t i = 0; i < count; i += 1000) {
+            lax.write(&records[i * 20], 1000, 20);
+        }
+        lax.close();
+        REQUIRE(out.bytes == std::string(records.begin(), records.end()));
+    }
+    REQUIRE(LaxIndexSink::laxPathFor("dir.v2/out.las") == "dir.v2/out.lax");
+
+    // Point numbers are 32-bit; the batch that would wrap them is refused
+    {
+        MemorySink   out;
+        LaxIndexSink lax(out, header, "test_lax_overflow.lax", true);
+        lax.write(&records[0], 1000, 20);
+        REQUIRE_THROWS_AS(lax.write(&records[0], UINT32_MAX, 20), std::runtime_error);
+        REQUIRE(out.bytes.size() == 1000 * 20);
+    }
+
+    std::ifstream direct(files[0], std::ios::binary), spooled(files[1], std::ios::binary);
+    std::string   bytes((std::istreambuf_iterator<char>(direct)), std::istreambuf_iterator<char>());
+    std::string   other((std::istreambuf_iterator<char>(spooled)), std::istreambuf_iterator<char>());
+    REQUIRE(bytes == other);
+    REQUIRE(bytes.compare(0, 4, "LASX") == 0);
+    REQUIRE(bytes.compare(8, 4, "LASS") == 0);
+    REQUIRE(bytes.compare(16, 4, "LASQ") == 0);
+    REQUIRE(bytes.compare(52, 4, "LASV") == 0);
+
+    LaxQuadtree tree;
+    std::memcpy(&tree.levels, &bytes[24], 4);
+    std::memcpy(&tree.minX, &bytes[36], 4);
+    std::memcpy(&tree.maxX, &bytes[40], 4);
+    std::memcpy(&tree.minY, &bytes[44], 4);
+    std::memcpy(&tree.maxY, &bytes[48], 4);
+    uint32_t cellCount;
+    std::memcpy(&cellCount, &bytes[60], 4);
+    REQUIRE(cellCount > 1);
+
+    std::map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> cells;
+    uint64_t full = 0;
+    size_t   pos  = 64;
+    for (uint32_t c = 0; c < cellCount; ++c) {
+        uint32_t header3[3];
+        std::memcpy(header3, &bytes[pos], 12);
+        pos += 12;
+        full += header3[2];
+        for (uint32_t k = 0; k < header3[1]; ++k, pos += 8) {
+            uint32_t interval[2];
+            std::memcpy(interval, &bytes[pos], 8);
+            cells[header3[0]].push_back(std::make_pair(interval[0], interval[1]));
+        }
+    }
+    REQUIRE(pos == bytes.size());
+    REQUIRE(full == count);
+
+    // Each point is in an interval of its leaf cell or of the coarser cell
+    // that replaced it
+    bool covered = true;
+    for (uint32_t i = 0; i < count && covered; ++i) {
+        int32_t xy[2];
+        std::memcpy(xy, &records[i * 20], sizeof(xy));
+        uint32_t cell  = tree.cellIndex(xy[0], xy[1]);
+        uint32_t level = tree.levels;
+        while (!cells.count(cell) && level > 0) {
+            cell = LaxQuadtree::levelOffset(level - 1) + ((cell - LaxQuadtree::levelOffset(level)) >> 2);
+            level--;
+        }
+        bool found = false;
+        for (const auto& interval : cells[cell]) {
+            found = found || (interval.first <= i && i <= interval.second);
+        }
+        covered = found;
+    }
+    REQUIRE(covered);
+    std::remove(files[0].c_str());
+    std::remove(files[1].c_str());
+}
+
+TEST_CASE("Voxel filter keeps one point per voxel in memory and from spilled buckets", "[writer]") {
+    const size_t      count = 300000;
+    liblas::Header    header;
+    std::vector<char> records = makeFormat0Records(count, 777, header, [](size_t, uint32_t random, int32_t xyz[3]) {
+        xyz[0] = static_cast<int32_t>(random % 2000) - 1000;
+        xyz[1] = static_cast<int32_t>((random >> 11) % 2000);
+        xyz[2] = static_cast<int32_t>((random >> 22) % 50);
+    });
+    for (size_t i = 0; i < count; ++i) {
+        records[i * 20 + 12] = static_cast<char>(i); // intensity, to tell points apart
+    }
+
+    const VoxelMode modes[3] = {kVoxelFirst, kVoxelCenter, kVoxelAverage};
+    for (VoxelMode mode : modes) {
+        // Reference: a map of voxels, in first-seen order
+        std::map<std::vector<int32_t>, size_t> voxels;
+        std::vector<std::string>               expected;
+        std::vector<double>                    best;
+        std::vector<std::vector<int64_t>>      sums;
+        for (size_t i = 0; i < count; ++i) {
+            int32_t xyz[3];
+            std::memcpy(xyz, &records[i * 20], sizeof(xyz));
+            std::vector<int32_t> key;
+            double               d = 0.0;
+            for (int axis = 0; axis < 3; ++axis) {
+                int32_t k = static_cast<int32_t>(std::floor(xyz[axis] / 10.0));
+                key.push_back(k);
+                d += (xyz[axis] - (k + 0.5) * 10.0) * (xyz[axis] - (k + 0.5) * 10.0);
+            }
+            auto found = voxels.find(key);
+            if (found == voxels.end()) {
+                voxels[key] = expected.size();
+                expected.push_back(std::string(&records[i * 20], 20));
+                best.push_back(d);
+                sums.push_back(std::vector<int64_t>{xyz[0], xyz[1], xyz[2], 1});
+            } else if (mode == kVoxelCenter && d < best[found->second]) {
+                expected[found->second] = std::string(&records[i * 20], 20);
+                best[found->second]     = d;
+            } else {
+                for (int axis = 0; axis < 3; ++axis) {
+                    sums[found->second][axis] += xyz[axis];
+                }
+                sums[found->second][3]++;
+            }
+        }
+        if (mode == kVoxelAverage) {
+            for (size_t v = 0; v < expected.size(); ++v) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    int32_t mean = static_cast<int32_t>(std::llround(static_cast<double>(sums[v][axis]) / sums[v][3]));
+                    std::memcpy(&expected[v][4 * axis], &mean, sizeof(mean));
+                }
+            }
+        }
+
+        MemorySink      inMemory, spilled;
+        VoxelFilterSink whole(inMemory, header, 10.0, mode, static_cast<size_t>(1) << 30, "test_voxel");
+        VoxelFilterSink parts(spilled, header, 10.0, mode, 4 << 20, "test_voxel");
+        for (size_t i = 0; i < count; i += 1000) {
+            whole.write(&records[i * 20], 1000, 20);
+            parts.write(&records[i * 20], 1000, 20);
+        }
+        whole.close();
+        parts.close();
+        REQUIRE(whole.bucketCount() == 0);
+        REQUIRE(parts.bucketCount() > 1);
+        REQUIRE(whole.keptCount() == expected.size());
+        REQUIRE(parts.keptCount() == expected.size());
+
+        std::string joined;
+        for (const auto& r : expected) {
+            joined += r;
+        }
+        REQUIRE(inMemory.bytes == joined);
+
+        std::vector<std::string> fromBuckets;
+        for (size_t p = 0; p < spilled.bytes.size(); p += 20) {
+            fromBuckets.push_back(spilled.bytes.substr(p, 20));
+        }
+        std::sort(fromBuckets.begin(), fromBuckets.end());
+        std::sort(expected.begin(), expected.end());
+        REQUIRE(fromBuckets == expected);
+    }
+}
+
+TEST_CASE("Dedupe sink keeps the first of each quantized position in memory and from spilled partitions", "[writer]") {
+    const size_t      count = 600000;
+    liblas::Header    header;
+    std::vector<char> records = makeFormat0Records(count, 4242, header, [](size_t, uint32_t random, int32_t xyz[3]) {
+        xyz[0] = static_cast<int32_t>(random % 400) - 200;
+        xyz[1] = static_cast<int32_t>((random >> 9) % 400);
+        xyz[2] = static_cast<int32_t>((random >> 18) % 4);
+    });
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t tag = static_cast<uint32_t>(i); // to tell points apart
+        std::memcpy(&records[i * 20 + 12], &tag, sizeof(tag));
+    }
+
+    std::set<std::string>    seen;
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < count; ++i) {
+        if (seen.insert(std::string(&records[i * 20], 12)).second) {
+            expected.push_back(std::string(&records[i * 20], 20));
+        }
+    }
+    REQUIRE(expected.size() < count);
+
+    // A budget below the set's initial size spills at once and splits partitions
+    MemorySink inMemory, spilled, split;
+    DedupeSink whole(inMemory, header, static_cast<size_t>(1) << 30, "test_dedupe");
+    DedupeSink parts(spilled, header, 1 << 20, "test_dedupe");
+    DedupeSink quarters(split, header, 128 << 10, "test_dedupe_split");
+    for (size_t i = 0; i < count; i += 1000) {
+        whole.write(&records[i * 20], 1000, 20);
+        parts.write(&records[i * 20], 1000, 20);
+        quarters.write(&records[i * 20], 1000, 20);
+    }
+    whole.close();
+    parts.close();
+    quarters.close();
+    REQUIRE(whole.partitionCount() == 0);
+    REQUIRE(parts.partitionCount() > 1);
+    REQUIRE(quarters.partitionCount() > 1);
+
+    std::string joined;
+    for (const auto& r : expected) {
+        joined += r;
+    }
+    REQUIRE(inMemory.bytes == joined);
+
+    std::sort(expected.begin(), expected.end());
+    for (DedupeSink* sink : {&whole, &parts, &quarters}) {
+        REQUIRE(sink->keptCount() == expected.size());
+        REQUIRE(sink->duplicateCount() == count - expected.size());
+        double minXYZ[3], maxXYZ[3];
+        sink->keptBounds(minXYZ, maxXYZ);
+        REQUIRE(minXYZ[0] == -200.0);
+        REQUIRE(maxXYZ[2] == 3.0);
+    }
+    for (MemorySink* out : {&spilled, &split}) {
+        std::vector<std::string> kept;
+        for (size_t p = 0; p < out->bytes.size(); p += 20) {
+            kept.push_back(out->bytes.substr(p, 20));
+        }
+        std::sort(kept.begin(), kept.end());
+        REQUIRE(kept == expected);
+    }
+}
+
+TEST_CASE("Profiler records phases and reports progress from a background thread", "[stats]") {
+    Profiler profiler(true);
+    profiler.begin("busy");
+    volatile double sink = 0.0;
+    for (int i = 0; i < 2000000; ++i) {
+        sink = sink + std::sqrt(static_cast<double>(i));
+    }
+    std::vector<char> touched(8 << 20, 1);
+    profiler.end(2000000, 100, 200);
+    profiler.begin("idle");
+    profiler.end(0, 0, 0);
+
+    REQUIRE(profiler.phases().size() == 2);
+    const PhaseStats& busy = profiler.phases()[0];
+    REQUIRE(busy.name == "busy");
+    REQUIRE(busy.wallSeconds > 0.0);
+    REQUIRE(busy.cpuSeconds >= 0.0);
+    REQUIRE(busy.points == 2000000);
+    REQUIRE(busy.outputBytes == 200);
+    REQUIRE(profiler.peakRssMB() > 0.0);
+    RunCounters run;
+    if (profiler.runCounters(run)) {
+        REQUIRE(run.instructions > 0);
+    }
+
+    const char* path = "test_profile.json";
+    REQUIRE(profiler.writeJson(path));
+    std::ifstream in(path);
+    std::string   json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    REQUIRE(json.find("\"name\": \"busy\"") != std::string::npos);
+    REQUIRE(json.find("\"peak_rss_mb\"") != std::string::npos);
+    REQUIRE(json.find("\"run_counters\"") != std::string::npos);
+    in.close();
+    std::remove(path);
+
+    Profiler disabled(false);
+    disabled.begin("nothing");
+    disabled.end(1, 1, 1);
+    REQUIRE(disabled.phases().empty());
+
+    // The collector mirrors its count for the reporter, which ends its line
+    // with the final count once stopped
+    std::atomic<long>  written(0);
+    PointCollector     pc;
+    std::ostringstream shown;
+    std::streambuf*    console = std::cout.rdbuf(shown.rdbuf());
+    pc.progress = &written;
+    {
+        ProgressReporter progress("Counting points", 1000, written, std::chrono::milliseconds(1));
+        for (int i = 0; i < 1000; ++i) {
+            pc.addPoint(i, i, i);
+        }
+        progress.stop();
+    }
+    std::cout.rdbuf(console);
+    REQUIRE(written.load() == 1000);
+    std::string lines = shown.str();
+    std::string last  = "\rCounting points: 1000 / 1000 (100%)   \n";
+    REQUIRE(lines.size() >= last.size());
+    REQUIRE(lines.compare(lines.size() - last.size(), last.size(), last) == 0);
+}
+
+TEST_CASE("Specialized batch kernels match the per-point collector", "[writer]") {
+    PointBatch batch;
+    for (int i = 0; i < 5000; ++i) {
+        batch.addPoint(i * 0.37 - 100.0, (i % 97) * 1.5, (i % 41) - 12.25);
+    }
+
+    // Bounds-only scan with the Z histogram
+    ZHistogram     perPointZ(0.001), batchedZ(0.001);
+    PointCollector perPoint, batched;
+    perPoint.colorize   = batched.colorize   = true;
+    perPoint.zHistogram = &perPointZ;
+    batched.zHistogram  = &batchedZ;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        perPoint.addPoint(batch.xyz[i * 3], batch.xyz[i * 3 + 1], batch.xyz[i * 3 + 2]);
+    }
+    batched.specialize();
+    batched.addBatch(batch);
+    REQUIRE(batched.count == perPoint.count);
+    REQUIRE(batched.minX == perPoint.minX);
+    REQUIRE(batched.maxY == perPoint.maxY);
+    REQUIRE(batched.minZ == perPoint.minZ);
+    REQUIRE(batchedZ.total == perPointZ.total);
+    REQUIRE(batchedZ.quantile(0.5) == perPointZ.quantile(0.5));
+
+    // Write pass, for every combination of point format and color ramp
+    const liblas::PointFormatName formats[2] = {liblas::ePointFormat0, liblas::ePointFormat2};
+    for (liblas::PointFormatName format : formats) {
+        for (int colorize = 0; colorize < 2; ++colorize) {
+            liblas::Header header;
+            header.SetScale(0.01, 0.01, 0.01);
+            header.SetOffset(-100.0, 0.0, -20.0);
+            header.SetDataFormatId(format);
+            std::string outputs[2];
+            for (int batchedPass = 0; batchedPass < 2; ++batchedPass) {
+                MemorySink      sink;
+                LasPointEncoder encoder(header, sink, 1000);
+                PointCollector  pc;
+                pc.header    = &header;
+                pc.encoder   = &encoder;
+                pc.colorize  = colorize != 0;
+                pc.colorMinZ = -10.0;
+                pc.zFactor   = 1.0 / 25.0;
+                if (batchedPass) {
+                    pc.specialize();
+                    pc.addBatch(batch);
+                } else {
+                    for (size_t i = 0; i < batch.size(); ++i) {
+                        pc.addPoint(batch.xyz[i * 3], batch.xyz[i * 3 + 1], batch.xyz[i * 3 + 2]);
+                    }
+                }
+                encoder.flush();
+                REQUIRE(sink.records == batch.size());
+                outputs[batchedPass] = sink.bytes;
+            }
+            REQUIRE(outputs[0] == outputs[1]);
+        }
+    }
+}
+
+TEST_CASE("Column schema parser writes intensity, color, class and return number", "[parser]") {
+    ColumnSchema schema;
+    std::string  error;
+    REQUIRE_FALSE(ColumnSchema::parse("x,y,i", schema, error));
+    REQUIRE_FALSE(ColumnSchema::parse("x,y,z,r,g", schema, error));
+    REQUIRE_FALSE(ColumnSchema::parse("x,y,z,i,i", schema, error));
+    REQUIRE_FALSE(ColumnSchema::parse("x,y,z,q", schema, error));
+    REQUIRE(ColumnSchema::parse("x,y,z,skip", schema, error));
+    REQUIRE(schema.isDefault());
+    REQUIRE(ColumnSchema::parse("x, y, z, t", schema, error));
+    REQUIRE(schema.pointFormat(false) == 1);
+    REQUIRE(schema.pointFormat(true) == 3);
+    REQUIRE(ColumnSchema::parse("x,y,z,i,r,g,b,skip,c,n", schema, error));
+    REQUIRE(schema.pointFormat(false) == 2);
+    REQUIRE(schema.fields.size() == 10);
+
+    const char* test_file = "test_columns.xyz";
+    std::ofstream out(test_file, std::ios::binary);
+    out << "1.5 2.5 3.5 100 255 128 0 ignored 2 1\n";
+    out << "# comment\n";
+    out << "4 5 6 12.6 1 2 3 x 70000 9\r\n";   // rounded intensity, clamped class and return
+    out << "7 8 9 -5 1 2 3 x 6\n";               // too few fields: dropped
+    out << "7 8 9 abc 1 2 3 x 6 1\n";            // intensity not a number: dropped
+    out << "10 11 12 65535 65535 0 1 x 31 7 extra\n";
+    out.close();
+
+    for (int threads = 1; threads <= 2; ++threads) {
+        liblas::Header header;
+        header.SetScale(0.5, 0.5, 0.5);
+        header.SetDataFormatId(liblas::ePointFormat2);
+        MemorySink      sink;
+        LasPointEncoder encoder(header, sink, 2);
+        PointCollector  pc;
+        pc.quiet   = true;
+        pc.threads = threads;
+        pc.header  = &header;
+        pc.encoder = &encoder;
+        pc.columns = &schema;
+        pc.specialize();
+        REQUIRE(processXYZ(test_file, pc));
+        encoder.flush();
+        REQUIRE(pc.count == 3);
+        REQUIRE(sink.records == 3);
+
+        const char* rec = sink.bytes.data();
+        int32_t     xyz[3];
+        uint16_t    intensity, rgb[3];
+        std::memcpy(xyz, rec, sizeof(xyz));
+        std::memcpy(&intensity, rec + 12, sizeof(intensity));
+        std::memcpy(rgb, rec + 20, sizeof(rgb));
+        REQUIRE(xyz[0] == 3);
+        REQUIRE(xyz[2] == 7);
+        REQUIRE(intensity == 100);
+        REQUIRE(rgb[0] == 255);
+        REQUIRE(rgb[1] == 128);
+        REQUIRE(rec[15] == 2);
+        REQUIRE(rec[14] == (1 | 1 << 3)); // return 1 of 1
+
+        rec += 26;
+        std::memcpy(&intensity, rec + 12, sizeof(intensity));
+        std::memcpy(rgb, rec + 20, sizeof(rgb));
+        REQUIRE(intensity == 13);
+        REQUIRE(rgb[2] == 3);
+        REQUIRE(rec[15] == 31);
+        REQUIRE(rec[14] == (7 | 7 << 3)); // no "m" column: as many returns as the return number
+
+        rec += 26;
+        std::memcpy(&intensity, rec + 12, sizeof(intensity));
+        REQUIRE(intensity == 65535);
+        REQUIRE(rec[15] == 31);
+    }
+
+    // A common layout takes its compiled line parser, with the same grammar
+    ColumnSchema compiled;
+    REQUIRE(ColumnSchema::parse("x,y,z,i,r,g,b", compiled, error));
+    {
+        liblas::Header header;
+        header.SetScale(0.5, 0.5, 0.5);
+        header.SetDataFormatId(liblas::ePointFormat2);
+        MemorySink      sink;
+        LasPointEncoder encoder(header, sink, 2);
+        PointCollector  pc;
+        pc.quiet   = true;
+        pc.header  = &header;
+        pc.encoder = &encoder;
+        pc.columns = &compiled;
+        pc.specialize();
+        REQUIRE(processXYZ(test_file, pc));
+        encoder.flush();
+        REQUIRE(pc.count == 4); // the short line now has enough fields
+        uint16_t intensities[4], blue;
+        for (int i = 0; i < 4; ++i) {
+            std::memcpy(&intensities[i], sink.bytes.data() + i * 26 + 12, sizeof(uint16_t));
+        }
+        std::memcpy(&blue, sink.bytes.data() + 26 + 24, sizeof(blue));
+        REQUIRE(intensities[0] == 100);
+        REQUIRE(intensities[1] == 13);
+        REQUIRE(intensities[2] == 0); // negative, clamped
+        REQUIRE(intensities[3] == 65535);
+        REQUIRE(blue == 3);
+        REQUIRE(sink.bytes[26 + 14] == 0);
+    }
+
+    // Layouts are looked up by their field code; "skip" is "_"
+    auto convert = [&](const char* file, const char* spec) -> std::string {
+        ColumnSchema layout;
+        REQUIRE(ColumnSchema::parse(spec, layout, error));
+        liblas::Header header;
+        header.SetScale(1.0, 1.0, 1.0);
+        header.SetDataFormatId(liblas::ePointFormat2);
+        MemorySink      sink;
+        LasPointEncoder encoder(header, sink, 2);
+        PointCollector  pc;
+        pc.quiet   = true;
+        pc.header  = &header;
+        pc.encoder = &encoder;
+        pc.columns = &layout;
+        pc.specialize();
+        REQUIRE(processXYZ(file, pc));
+        encoder.flush();
+        return sink.bytes;
+    };
+    REQUIRE(ColumnSchema::parse("x,y,z,i,r,g,b,skip,c", compiled, error));
+    REQUIRE(compiled.code() == "xyzirgb_c");
+    std::string skipped = convert(test_file, "x,y,z,i,r,g,b,skip,c");
+    REQUIRE(skipped.size() == 4 * 26);
+    REQUIRE(skipped[15] == 2);
+    REQUIRE(skipped[26 + 15] == 31);
+    REQUIRE(skipped[2 * 26 + 15] == 6);
+    REQUIRE(skipped[14] == 0);
+    std::remove(test_file);
+
+    // The number of returns is taken from its column, or else set to the
+    // return number
+    const char* returns_file = "test_columns_returns.xyz";
+    std::ofstream returns(returns_file, std::ios::binary);
+    returns << "1 2 3 10 20 30 40 5 2 3\n";
+    returns << "4 5 6 11 21 31 41 9 1 1\n";
+    returns.close();
+    std::string classified = convert(returns_file, "x,y,z,i,r,g,b,c");
+    REQUIRE(classified.size() == 2 * 26);
+    REQUIRE(classified[15] == 5);
+    REQUIRE(classified[26 + 15] == 9);
+    REQUIRE(classified[14] == 0);
+    uint16_t red;
+    std::memcpy(&red, classified.data() + 26 + 20, sizeof(red));
+    REQUIRE(red == 21);
+    std::string counted = convert(returns_file, "x,y,z,i,r,g,b,c,n,m");
+    REQUIRE(counted[14] == (2 | 3 << 3));
+    REQUIRE(counted[26 + 14] == (1 | 1 << 3));
+    std::string inferred = convert(returns_file, "x,y,z,i,r,g,b,c,n");
+    REQUIRE(inferred[14] == (2 | 2 << 3));
+    std::remove(returns_file);
+
+    // GPS time lands in format 1, and points without attributes get zeroed fields
+    REQUIRE(ColumnSchema::parse("t,x,y,z,i", schema, error));
+    liblas::Header header;
+    header.SetScale(1.0, 1.0, 1.0);
+    header.SetDataFormatId(static_cast<liblas::PointFormatName>(schema.pointFormat(false)));
+    MemorySink      sink;
+    LasPointEncoder encoder(header, sink, 1000);
+    PointCollector  pc;
+    pc.header  = &header;
+    pc.encoder = &encoder;
+    pc.columns = &schema;
+    pc.specialize();
+    PointBatch      withAttributes, without;
+    PointAttributes a;
+    a.time      = 123456.25;
+    a.intensity = 7;
+    withAttributes.addPoint(1.0, 2.0, 3.0, a);
+    without.addPoint(4.0, 5.0, 6.0);
+    pc.addBatch(withAttributes);
+    pc.addBatch(without);
+    encoder.flush();
+    REQUIRE(sink.bytes.size() == 2 * 28);
+    double   time;
+    uint16_t intensity;
+    std::memcpy(&time, sink.bytes.data() + 20, sizeof(time));
+    REQUIRE(time == 123456.25);
+    std::memcpy(&time, sink.bytes.data() + 28 + 20, sizeof(time));
+    std::memcpy(&intensity, sink.bytes.data() + 28 + 12, sizeof(intensity));
+    REQUIRE(time == 0.0);
+    REQUIRE(intensity == 0);
+}
+
+// Writes `text` as BGZF: gzip members of at most 60000 input bytes, each
+// carrying its own compressed size in a "BC" extra field.
+static std::string bgzf(const std::string& text) {
+    std::string out;
+    for (size_t pos = 0; pos < text.size(); pos += 60000) {
+        size_t   n = std::min<size_t>(60000, text.size() - pos);
+        z_stream z;
+        std::memset(&z, 0, sizeof(z));
+        deflateInit2(&z, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        std::vector<unsigned char> body(deflateBound(&z, n));
+        z.next_in   = (Bytef*)&text[pos];
+        z.avail_in  = static_cast<uInt>(n);
+        z.next_out  = body.data();
+        z.avail_out = static_cast<uInt>(body.size());
+        deflate(&z, Z_FINISH);
+        size_t bodySize = body.size() - z.avail_out;
+        deflateEnd(&z);
+
+        size_t        blockSize = 18 + bodySize + 8;
+        unsigned char header[18] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+                                    static_cast<unsigned char>((blockSize - 1) & 0xff),
+                                    static_cast<unsigned char>((blockSize - 1) >> 8)};
+        uint32_t trailer[2] = {static_cast<uint32_t>(crc32(0, (const Bytef*)&text[pos], static_cast<uInt>(n))),
+                               static_cast<uint32_t>(n)};
+        out.append((const char*)header, sizeof(header));
+        out.append((const char*)body.data(), bodySize);
+        out.append((const char*)trailer, sizeof(trailer));
+    }
+    return out;
+}
+
+static std::string gzip(const std::string& text) {
+    const char* tmp = "test_gzip.tmp";
+    gzFile      gz  = gzopen(tmp, "wb");
+    gzwrite(gz, text.data(), static_cast<unsigned>(text.size()));
+    gzclose(gz);
+    std::ifstream in(tmp, std::ios::binary);
+    std::string   bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::remove(tmp);
+    return bytes;
+}
+
+TEST_CASE("Compressed XYZ input decodes gzip, zstd and bzip2 members, and BGZF blocks and zstd frames in parallel", "[parser]") {
+    // Enough text for several parallel BGZF tasks, so lines straddle task edges
+    std::string text;
+    uint32_t    seed = 12345;
+    char        line[64];
+    for (int i = 0; i < 1000000; ++i) {
+        double v[3];
+        for (double& x : v) {
+            seed = seed * 1664525u + 1013904223u;
+            x    = (seed >> 8) / 1000.0;
+        }
+        snprintf(line, sizeof(line), "%.3f %.3f %.3f\n", v[0], v[1], v[2]);
+        text += line;
+    }
+    text += "1 2 3"; // no final newline
+
+    auto convert = [](const std::string& bytes, int threads) {
+        const char*   test_file = "test_compressed.xyz";
+        std::ofstream out(test_file, std::ios::binary);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        out.close();
+        liblas::Header header;
+        header.SetScale(0.001, 0.001, 0.001);
+        header.SetDataFormatId(liblas::ePointFormat0);
+        MemorySink      sink;
+        LasPointEncoder encoder(header, sink);
+        PointCollector  pc;
+        pc.quiet   = true;
+        pc.threads = threads;
+        pc.header  = &header;
+        pc.encoder = &encoder;
+        pc.specialize();
+        REQUIRE(processXYZ(test_file, pc));
+        encoder.flush();
+        std::remove(test_file);
+        REQUIRE(pc.count == 1000001);
+        return sink.bytes;
+    };
+
+    std::string plain = convert(text, 1);
+    std::string half  = text.substr(0, text.size() / 2);
+    std::string gz    = gzip(text);
+    std::string multi = gzip(half) + gzip(text.substr(half.size()));
+    std::string blocks = bgzf(text);
+    REQUIRE(detectCompression(gz.data(), gz.size()) == kCompressionGzip);
+    REQUIRE(independentMembers(gz.data(), gz.size(), kCompressionGzip).size() == 1);
+    REQUIRE(independentMembers(blocks.data(), blocks.size(), kCompressionGzip).size() > 100);
+    for (int threads = 1; threads <= 4; threads += 3) {
+        REQUIRE(convert(gz, threads) == plain);
+        REQUIRE(convert(multi, threads) == plain);
+        REQUIRE(convert(blocks, threads) == plain);
+    }
+
+    // Truncated input is an error, not a short file
+    auto truncatedThrows = [](const std::string& bytes) {
+        const char*   test_file = "test_truncated.xyz.tmp";
+        std::ofstream out(test_file, std::ios::binary);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() / 2));
+        out.close();
+        PointCollector pc;
+        pc.quiet = true;
+        REQUIRE_THROWS(processXYZ(test_file, pc));
+        std::remove(test_file);
+    };
+    truncatedThrows(gz);
+
+#if defined(XYZ2LAS_HAVE_ZSTD)
+    // Independent frames decode in parallel (ZSTD_findFrameCompressedSize);
+    // lines straddle the frame edges
+    auto zstd = [](const std::string& piece) {
+        std::string out(ZSTD_compressBound(piece.size()), '\0');
+        size_t      n = ZSTD_compress(&out[0], out.size(), piece.data(), piece.size(), 3);
+        REQUIRE_FALSE(ZSTD_isError(n));
+        out.resize(n);
+        return out;
+    };
+    std::string zst    = zstd(text);
+    std::string frames;
+    for (size_t pos = 0; pos < text.size(); pos += 1000003) {
+        frames += zstd(text.substr(pos, 1000003));
+    }
+    REQUIRE(detectCompression(frames.data(), frames.size()) == kCompressionZstd);
+    REQUIRE(independentMembers(zst.data(), zst.size(), kCompressionZstd).size() == 1);
+    REQUIRE(independentMembers(frames.data(), frames.size(), kCompressionZstd).size() > 10);
+    for (int threads = 1; threads <= 4; threads += 3) {
+        REQUIRE(convert(zst, threads) == plain);
+        REQUIRE(convert(frames, threads) == plain);
+    }
+    truncatedThrows(zst);
+    // A frame cut short in the streaming decoder ends with input still pending
+    std::vector<char> decoded;
+    REQUIRE_THROWS(decompressAll(zst.data(), zst.size() / 2, kCompressionZstd, decoded));
+#endif
+
+#if defined(XYZ2LAS_HAVE_BZIP2)
+    // Concatenated streams, as parallel bzip2 tools write them, restart the decoder
+    auto bzip2 = [](const std::string& piece) {
+        std::string  out(piece.size() + piece.size() / 100 + 600, '\0');
+        unsigned int n = static_cast<unsigned int>(out.size());
+        REQUIRE(BZ2_bzBuffToBuffCompress(&out[0], &n, const_cast<char*>(piece.data()),
+                                         static_cast<unsigned int>(piece.size()), 9, 0, 0) == BZ_OK);
+        out.resize(n);
+        return out;
+    };
+    std::string bz2     = bzip2(text);
+    std::string streams = bzip2(half) + bzip2(text.substr(half.size()));
+    REQUIRE(detectCompression(streams.data(), streams.size()) == kCompressionBzip2);
+    for (int threads = 1; threads <= 4; threads += 3) {
+        REQUIRE(convert(bz2, threads) == plain);
+        REQUIRE(convert(streams, threads) == plain);
+    }
+    truncatedThrows(bz2);
+#endif
+}
+
+TEST_CASE("Uring input engine matches the memory mapped parse across block edges", "[parser]") {
+    // Several 1 MB read blocks, with lines straddling every block edge
+    const char*   test_file = "test_uring.xyz";
+    std::ofstream out(test_file, std::ios::binary);
+    char          line[64];
+    for (int i = 0; i < 300000; ++i) {
+        snprintf(line, sizeof(line), "%d.%02d %d.25 %d\n", i, i % 100, i * 7, i % 13);
+        out << line;
+    }
+    out << "4 5 6"; // no final newline
+    out.close();
+
+    auto convert = [&](InputEngine engine, bool directIO, int threads) {
+        liblas::Header header;
+        header.SetScale(0.01, 0.01, 0.01);
+        header.SetDataFormatId(liblas::ePointFormat0);
+        MemorySink      sink;
+        LasPointEncoder encoder(header, sink);
+        PointCollector  pc;
+        pc.quiet       = true;
+        pc.threads     = threads;
+        pc.inputEngine = engine;
+        pc.directIO    = directIO;
+        pc.header      = &header;
+        pc.encoder     = &encoder;
+        pc.specialize();
+        REQUIRE(processXYZ(test_file, pc));
+        encoder.flush();
+        REQUIRE(pc.count == 300001);
+        return sink.bytes;
+    };
+
+    std::string mapped = convert(kInputEngineMmap, false, 1);
+    for (int threads = 1; threads <= 4; threads += 3) {
+        REQUIRE(convert(kInputEngineUring, false, threads) == mapped);
+        // Falls back to buffered reads where the file system refuses O_DIRECT
+        REQUIRE(convert(kInputEngineUring, true, threads) == mapped);
+    }
+
+    // A ring shallower than the file recycles its buffers
+    std::ifstream     in(test_file, std::ios::binary);
+    std::string       bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    UringReader       reader(test_file, 64 * 1024, 4, true);
+    std::string       blocks;
+    REQUIRE(reader.isOpen());
+    REQUIRE(reader.blockCount() > 4);
+    for (size_t i = 0; i < reader.blockCount(); ++i) {
+        size_t      length = 0;
+        const char* data   = reader.acquire(i, length);
+        blocks.append(data, length);
+        reader.release(i);
+    }
+    REQUIRE(blocks == bytes);
+    std::remove(test_file);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_CASE("XYZ text streams from a FIFO in blocks with partial lines carried over", "[parser]") {
+    // More than one read block, so lines straddle block edges
+    std::string text;
+    char        line[64];
+    for (int i = 0; i < 400000; ++i) {
+        snprintf(line, sizeof(line), "%d.%03d %d.5 %d\n", i, i % 1000, i * 3, i % 97);
+        text += line;
+    }
+    text += "7 8 9"; // no final newline
+
+    // `probe` goes through processInput, the entry point the two-pass path uses
+    auto convert = [](const char* test_file, const std::string* feed, bool probe) {
+        liblas::Header header;
+        header.SetScale(0.001, 0.001, 0.001);
+        header.SetDataFormatId(liblas::ePointFormat0);
+        MemorySink      sink;
+        LasPointEncoder encoder(header, sink);
+        PointCollector  pc;
+        pc.quiet   = true;
+        pc.header  = &header;
+        pc.encoder = &encoder;
+        pc.specialize();
+        // The writer trickles odd-sized pieces, as a producer process would
+        std::thread writer;
+        if (feed) {
+            writer = std::thread([test_file, feed] {
+                std::FILE* out = std::fopen(test_file, "wb");
+                for (size_t at = 0; at < feed->size(); at += 65521) {
+                    std::fwrite(feed->data() + at, 1, std::min<size_t>(65521, feed->size() - at), out);
+                    std::fflush(out);
+                }
+                std::fclose(out);
+            });
+        }
+        std::string srsWKT;
+        bool        ok = probe ? processInput(test_file, pc, srsWKT) : processXYZ(test_file, pc);
+        if (writer.joinable()) {
+            writer.join();
+        }
+        encoder.flush();
+        REQUIRE(ok);
+        REQUIRE(pc.count == 400001);
+        return sink.bytes;
+    };
+
+    const char*   test_file = "test_stream.xyz";
+    std::ofstream out(test_file, std::ios::binary);
+    out << text;
+    out.close();
+    std::string mapped = convert(test_file, nullptr, false);
+    REQUIRE_FALSE(isStream(test_file));
+    std::remove(test_file);
+
+    const char* fifo = "test_stream.fifo";
+    std::remove(fifo);
+    REQUIRE(mkfifo(fifo, 0600) == 0);
+    REQUIRE(isStream(fifo));
+    REQUIRE(isStream(kStdinName));
+    REQUIRE(convert(fifo, &text, false) == mapped);
+    // GDAL must not probe the FIFO first, or it would swallow the leading text
+    GDALAllRegister();
+    REQUIRE(convert(fifo, &text, true) == mapped);
+    std::remove(fifo);
+}
+#endif
+
+TEST_CASE("Multiple inputs are scanned and written concurrently in input order", "[parser]") {
+    std::vector<std::string> files;
+    for (int f = 0; f < 6; ++f) {
+        files.push_back("test_multi_" + std::to_string(f) + ".xyz");
+        std::ofstream out(files.back());
+        for (int i = 0; i < 20000 * f; ++i) {
+            out << f << " " << i << " " << (i % 13) - f << "\n";
+        }
+    }
+
+    PointCollector serial;
+    serial.quiet = true;
+    PointCollector concurrent;
+    concurrent.quiet   = true;
+    concurrent.threads = 4;
+    std::string srs, failed;
+    REQUIRE(processInputs(files, serial, srs, failed));
+    REQUIRE(processInputs(files, concurrent, srs, failed));
+    REQUIRE(concurrent.count == serial.count);
+    REQUIRE(concurrent.count == 20000 * 15);
+    REQUIRE(concurrent.maxX == 5.0);
+    REQUIRE(concurrent.minZ == serial.minZ);
+
+    liblas::Header header;
+    header.SetScale(1.0, 1.0, 1.0);
+    header.SetDataFormatId(liblas::ePointFormat0);
+    std::string outputs[2];
+    for (int pass = 0; pass < 2; ++pass) {
+        MemorySink      sink;
+        LasPointEncoder encoder(header, sink);
+        PointCollector  pc;
+        pc.quiet   = true;
+        pc.header  = &header;
+        pc.encoder = &encoder;
+        pc.threads = pass == 0 ? 1 : 4;
+        REQUIRE(processInputs(files, pc, srs, failed));
+        encoder.flush();
+        REQUIRE(sink.records == 20000 * 15);
+        outputs[pass] = sink.bytes;
+    }
+    REQUIRE(outputs[0] == outputs[1]);
+
+    files.push_back("does_not_exist.xyz");
+    PointCollector missing;
+    missing.quiet   = true;
+    missing.threads = 4;
+    REQUIRE_FALSE(processInputs(files, missing, srs, failed));
+    REQUIRE(failed == "does_not_exist.xyz");
+
+    for (size_t f = 0; f + 1 < files.size(); ++f) {
+        std::remove(files[f].c_str());
+    }
+}
+
+struct WkbBuilder {
+    std::vector<uint8_t> bytes;
+    bool                 bigEndian = false;
+
+    void raw(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            bytes.push_back(p[bigEndian ? size - 1 - i : i]);
+        }
+    }
+    void header(uint32_t type) {
+        bytes.push_back(bigEndian ? 0 : 1);
+        raw(&type, sizeof(type));
+    }
+    void u32(uint32_t v) { raw(&v, sizeof(v)); }
+    void f64(double v) { raw(&v, sizeof(v)); }
+};
+
+TEST_CASE("WKB decoder adds the vertices of Arrow geometry blobs", "[gdal]") {
+    PointCollector pc;
+    pc.quiet = true;
+
+    WkbBuilder pointZ; // ISO POINT Z
+    pointZ.header(1001);
+    pointZ.f64(1.0); pointZ.f64(2.0); pointZ.f64(3.0);
+    REQUIRE(addWkbGeometry(pointZ.bytes.data(), pointZ.bytes.size(), pc) == pointZ.bytes.size());
+    REQUIRE(pc.count == 1);
+    REQUIRE(pc.maxZ == 3.0);
+
+    WkbBuilder line; // big endian 2D LINESTRING, Z defaults to 0
+    line.bigEndian = true;
+    line.header(2);
+    line.u32(2);
+    line.f64(-4.0); line.f64(5.0); line.f64(6.0); line.f64(7.0);
+    REQUIRE(addWkbGeometry(line.bytes.data(), line.bytes.size(), pc) == line.bytes.size());
+    REQUIRE(pc.count == 3);
+    REQUIRE(pc.minX == -4.0);
+    REQUIRE(pc.minZ == 0.0);
+
+    WkbBuilder multi; // EWKB GEOMETRYCOLLECTION Z with SRID holding a POLYGON ZM
+    multi.header(0x80000000u | 0x20000000u | 7);
+    multi.u32(4326);
+    multi.u32(1);
+    multi.header(3003);
+    multi.u32(1);
+    multi.u32(2);
+    multi.f64(8.0); multi.f64(9.0); multi.f64(10.0); multi.f64(99.0);
+    multi.f64(8.0); multi.f64(9.0); multi.f64(-10.0); multi.f64(99.0);
+    REQUIRE(addWkbGeometry(multi.bytes.data(), multi.bytes.size(), pc) == multi.bytes.size());
+    REQUIRE(pc.count == 5);
+    REQUIRE(pc.maxX == 8.0);
+    REQUIRE(pc.maxZ == 10.0);
+    REQUIRE(pc.minZ == -10.0);
+
+    REQUIRE(addWkbGeometry(line.bytes.data(), line.bytes.size() - 1, pc) == 0); // truncated
+}
+
 TEST_CASE("GDAL Parser handles GeoTIFF files", "[gdal]") {
     GDALAllRegister();
     const char* test_file = "test_gdal.tif";
@@ -156,3 +1415,290 @@ TEST_CASE("GDAL Parser handles NaN and Scale/Offset", "[gdal]") {
 
     std::remove(test_file);
 }
+
+TEST_CASE("GDAL Parser reads tiled rasters block by block on several threads", "[gdal]") {
+    GDALAllRegister();
+    const char* test_file = "test_gdal_tiled.tif";
+
+    GDALDriver* poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    REQUIRE(poDriver != nullptr);
+
+    const char* options[] = { "TILED=YES", "BLOCKXSIZE=32", "BLOCKYSIZE=32", "COMPRESS=DEFLATE", nullptr };
+    GDALDataset* poDS = poDriver->Create(test_file, 100, 70, 1, GDT_Int16, const_cast<char**>(options));
+    REQUIRE(poDS != nullptr);
+
+    double adfGeoTransform[6] = { 0.0, 1.0, 0.0, 70.0, 0.0, -1.0 };
+    poDS->SetGeoTransform(adfGeoTransform);
+    GDALRasterBand* poBand = poDS->GetRasterBand(1);
+    poBand->SetNoDataValue(-1.0);
+
+    std::vector<int16_t> rasterData(100 * 70);
+    for (int y = 0; y < 70; ++y) {
+        for (int x = 0; x < 100; ++x) {
+            rasterData[y * 100 + x] = (x + y) % 5 == 0 ? -1 : static_cast<int16_t>(x * 70 + y);
+        }
+    }
+    REQUIRE(poBand->RasterIO(GF_Write, 0, 0, 100, 70, &rasterData[0], 100, 70, GDT_Int16, 0, 0) == CE_None);
+    GDALClose(poDS);
+
+    PointBatch written[2];
+    for (int pass = 0; pass < 2; ++pass) {
+        PointCollector pc;
+        pc.quiet     = true;
+        pc.threads   = pass == 0 ? 1 : 4;
+        pc.batchSink = [&](PointBatch& batch) {
+            written[pass].xyz.insert(written[pass].xyz.end(), batch.xyz.begin(), batch.xyz.end());
+        };
+        std::string srsWKT;
+        REQUIRE(processGDAL(test_file, pc, srsWKT));
+        pc.flush();
+        REQUIRE(pc.count == 100 * 70 - 1400); // every fifth pixel is NoData
+        REQUIRE(pc.maxZ == 99 * 70 + 69);
+        REQUIRE(pc.minX == 0.5);
+        REQUIRE(pc.maxY == 69.5);
+    }
+    REQUIRE(written[0].xyz == written[1].xyz);
+
+    std::remove(test_file);
+}
+
+TEST_CASE("Single-pass collector defers points until the first chunk is full", "[writer]") {
+    PointCollector pc;
+    pc.quiet      = true;
+    pc.deferLimit = 2;
+
+    int    opened = 0;
+    double offsetX = 0;
+    pc.openWriter = [&](PointCollector& c) {
+        opened++;
+        offsetX = c.minX;
+    };
+
+    pc.addPoint(5.0, 1.0, 1.0);
+    REQUIRE(opened == 0);
+    pc.addPoint(3.0, 1.0, 1.0);
+    REQUIRE(opened == 1);
+    REQUIRE(offsetX == 3.0);
+
+    pc.addPoint(1.0, 1.0, 1.0);
+    pc.flush();
+    REQUIRE(pc.count == 3);
+    REQUIRE(pc.minX == 1.0);
+}
+
+TEST_CASE("Header patcher rewrites count and bounds", "[writer]") {
+    const char* test_file = "test_patch.las";
+    {
+        std::ofstream out(test_file, std::ios::binary);
+        std::string blank(227, '\0');
+        out.write(blank.data(), blank.size());
+    }
+
+    PointCollector pc;
+    pc.quiet = true;
+    pc.addPoint(1.0, 2.0, 3.0);
+    pc.addPoint(4.0, 5.0, 6.0);
+    REQUIRE(patchLasHeader(test_file, pc));
+
+    std::ifstream in(test_file, std::ios::binary);
+    uint32_t count = 0;
+    in.seekg(107);
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    REQUIRE(count == 2);
+
+    double bounds[6];
+    in.seekg(179);
+    in.read(reinterpret_cast<char*>(bounds), sizeof(bounds));
+    REQUIRE(bounds[0] == 4.0); // max X
+    REQUIRE(bounds[1] == 1.0); // min X
+    REQUIRE(bounds[4] == 6.0); // max Z
+    REQUIRE(bounds[5] == 3.0); // min Z
+    in.close();
+
+    std::remove(test_file);
+}
+
+TEST_CASE("Parallel LAZ output compresses several chunks that liblas reads back", "[writer]") {
+    const char*    test_file = "test_parallel.laz";
+    liblas::Header header;
+    header.SetScale(0.01, 0.01, 0.01);
+    header.SetOffset(0.0, 0.0, 0.0);
+    header.SetDataFormatId(liblas::ePointFormat0);
+    header.SetCompressed(true);
+
+    // Three and a half LASzip chunks of the default 50000 points
+    const long count = 175000;
+    OutputOptions options;
+    options.threads = 4;
+    LasOutput output;
+    REQUIRE(output.open(test_file, header, options));
+    REQUIRE((dynamic_cast<LazChunkSink*>(output.sink.get()) != nullptr) == parallelLazAvailable());
+
+    PointCollector pc;
+    pc.quiet = true;
+    output.attach(pc);
+    for (long i = 0; i < count; ++i) {
+        pc.addPoint((i % 1000) * 0.5, (i / 1000) * 0.25, (i % 37) * 0.01);
+    }
+    pc.flush();
+    REQUIRE(output.close(pc));
+
+    std::ifstream  in(test_file, std::ios::binary);
+    liblas::Reader reader = liblas::ReaderFactory().CreateWithStream(in);
+    REQUIRE(reader.GetHeader().GetPointRecordsCount() == static_cast<uint32_t>(count));
+    long read = 0;
+    bool same = true;
+    while (reader.ReadNextPoint() && same) {
+        const liblas::Point& p = reader.GetPoint();
+        same = p.GetRawX() == (read % 1000) * 50 && p.GetRawY() == (read / 1000) * 25 && p.GetRawZ() == read % 37;
+        read++;
+    }
+    REQUIRE(same);
+    REQUIRE(read == count);
+    in.close();
+    std::remove(test_file);
+}
+
+TEST_CASE("Aligned file buffer writes and patches like a plain stream", "[writer]") {
+    // Appends spanning many small buffers, patches behind the append position
+    // (already written, and still buffered) and a write that runs past the end
+    auto writeAll = [](std::ostream& os) {
+        std::string record(1000, '\0');
+        for (int i = 0; i < 100; ++i) {
+            for (size_t j = 0; j < record.size(); ++j) {
+                record[j] = static_cast<char>(i * 31 + j);
+            }
+            os.write(record.data(), static_cast<std::streamsize>(record.size()));
+            if (i == 50) {
+                std::streamoff end = os.tellp();
+                os.seekp(100);
+                os.write("patched", 7);
+                os.seekp(end - 5);
+                os.write("0123456789", 10); // five patched, five appended
+            }
+        }
+        os.seekp(8);
+        os.write("header", 6);
+        os.seekp(0, std::ios::end);
+        os.write("tail", 4);
+    };
+
+    const char*   plain_file = "test_plain_out.bin";
+    std::ofstream plain(plain_file, std::ios::binary);
+    writeAll(plain);
+    plain.close();
+    std::ifstream expectIn(plain_file, std::ios::binary);
+    std::string   expected((std::istreambuf_iterator<char>(expectIn)), std::istreambuf_iterator<char>());
+    std::remove(plain_file);
+
+    for (int direct = 0; direct < 2; ++direct) {
+        const char*    test_file = "test_aligned_out.bin";
+        AlignedFileBuf buffer;
+        REQUIRE(buffer.open(test_file, 4096, direct != 0));
+        std::ostream os(&buffer);
+        writeAll(os);
+        REQUIRE(os.good());
+        REQUIRE(buffer.close());
+        std::ifstream in(test_file, std::ios::binary);
+        std::string   written((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        REQUIRE(written == expected);
+        std::remove(test_file);
+    }
+}
+
+TEST_CASE("LAS 1.4 output writes point format 7 with a 64-bit count", "[writer]") {
+    const char*    test_file = "test_las14.las";
+    liblas::Header header;
+    header.SetScale(0.01, 0.01, 0.01);
+    header.SetOffset(100.0, 200.0, 0.0);
+    header.SetDataFormatId(liblas::ePointFormat3);
+
+    OutputOptions options;
+    options.las14 = true;
+    LasOutput output;
+    REQUIRE(output.open(test_file, header, options));
+    REQUIRE(output.encoder->formatId == 7);
+    REQUIRE(output.encoder->recordLength == 36);
+
+    PointAttributes a;
+    a.intensity       = 500;
+    a.classification  = 9;
+    a.returnNumber    = 2;
+    a.numberOfReturns = 3;
+    a.time            = 12.5;
+    uint16_t rgb[3]  = {1000, 2000, 3000};
+    output.encoder->add(101.0, 202.0, 3.0, a, rgb);
+    output.encoder->add(104.0, 205.0, 6.0, a, rgb);
+    PointCollector pc;
+    pc.count = 2;
+    pc.minX = 101.0, pc.minY = 202.0, pc.minZ = 3.0;
+    pc.maxX = 104.0, pc.maxY = 205.0, pc.maxZ = 6.0;
+    REQUIRE(output.close(pc));
+
+    std::ifstream in(test_file, std::ios::binary);
+    std::string   bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    REQUIRE(bytes.compare(0, 4, "LASF") == 0);
+    REQUIRE(bytes[24] == 1);
+    REQUIRE(bytes[25] == 4);
+    REQUIRE(bytes[104] == 7);
+    uint32_t dataOffset = 0, legacyCount = 1;
+    uint64_t count      = 0;
+    uint16_t headerSize = 0, recordLength = 0;
+    std::memcpy(&headerSize, &bytes[94], 2);
+    std::memcpy(&dataOffset, &bytes[96], 4);
+    std::memcpy(&recordLength, &bytes[105], 2);
+    std::memcpy(&legacyCount, &bytes[107], 4);
+    std::memcpy(&count, &bytes[247], 8);
+    REQUIRE(headerSize == 375);
+    REQUIRE(recordLength == 36);
+    REQUIRE(legacyCount == 0); // must be zero for formats 6 and up
+    REQUIRE(count == 2);
+    REQUIRE(bytes.size() == dataOffset + 2 * 36);
+    double maxX = 0.0;
+    std::memcpy(&maxX, &bytes[179], 8);
+    REQUIRE(maxX == 104.0);
+
+    const char* rec = &bytes[dataOffset + 36];
+    int32_t     x   = 0;
+    double      t   = 0.0;
+    uint16_t    red = 0;
+    std::memcpy(&x, rec, 4);
+    std::memcpy(&t, rec + 22, 8);
+    std::memcpy(&red, rec + 30, 2);
+    REQUIRE(x == 400);
+    REQUIRE((rec[14] & 15) == 2);
+    REQUIRE(((rec[14] >> 4) & 15) == 3); // number of returns, also 4 bits wide
+    REQUIRE(rec[16] == 9);
+    REQUIRE(t == 12.5);
+    REQUIRE(red == 1000);
+
+    // Past 2^32 points only the 64-bit count is set; LAS 1.2 cannot hold them
+    double   minXYZ[3] = {0.0, 0.0, 0.0};
+    double   maxXYZ[3] = {1.0, 1.0, 1.0};
+    uint64_t huge      = static_cast<uint64_t>(UINT32_MAX) + 10;
+    REQUIRE(patchLasHeader(test_file, huge, minXYZ, maxXYZ));
+    in.open(test_file, std::ios::binary);
+    in.seekg(247);
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    in.close();
+    REQUIRE(count == huge);
+    bytes[25] = 2;
+    std::ofstream(test_file, std::ios::binary).write(bytes.data(), bytes.size());
+    REQUIRE_FALSE(patchLasHeader(test_file, huge, minXYZ, maxXYZ));
+    std::remove(test_file);
+
+    // LAS 1.2 output refuses the batch that outgrows its count, not on close
+    LasOutput legacy;
+    REQUIRE(legacy.open(test_file, header));
+    REQUIRE(legacy.encoder->maxPoints == UINT32_MAX);
+    legacy.encoder->maxPoints = 3;
+    for (int i = 0; i < 3; ++i) {
+        legacy.encoder->add(101.0, 202.0, 3.0, a, rgb);
+    }
+    legacy.encoder->flush();
+    legacy.encoder->add(101.0, 202.0, 3.0, a, rgb);
+    REQUIRE_THROWS_AS(legacy.encoder->flush(), std::runtime_error);
+    REQUIRE(legacy.encoder->written == 3);
+    std::remove(test_file);
+}